@@ -0,0 +1,270 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#define _FILE_OFFSET_BITS	64	// 64-bit offsets for fseeko() on 32-bit systems
+#include <stdio.h>
+#include <string.h>	// for memcpy()/memcmp()
+#include <vector>
+#include <string>
+#include <mutex>
+#include "stdtype.h"
+
+#include "EnvelopeIndex.hpp"
+#include "MultiWaveFile.hpp"
+
+#ifdef _MSC_VER
+#define fseek64	_fseeki64
+#else
+#define fseek64	fseeko
+#endif
+
+#define INLINE	static inline
+
+#define ENVIDX_SIG	"WRSENVX2"	// version 2: -0x80000000 is decoded as -0x7FFFFFFF
+
+#pragma pack(1)
+struct EnvIdxHeader
+{
+	char signature[8];	// written last, so that incomplete files are rejected
+	UINT16 channels;
+	UINT8 smplFormat;
+	UINT8 levels;
+	UINT32 smplRate;
+	UINT64 totalSmpls;
+	UINT32 fileCount;
+	UINT32 tableSize;	// size of the file table that follows the header (in bytes)
+};
+#pragma pack()
+
+
+static size_t GetLastSepPos(const std::string& fileName);
+INLINE std::string GetFileTitle(const std::string& fileName);
+
+
+EnvelopeIndex::EnvelopeIndex() :
+	_hFile(NULL),
+	_channels(0),
+	_totalSmpls(0)
+{
+	memset(_levelOfs, 0x00, sizeof(_levelOfs));
+}
+
+EnvelopeIndex::~EnvelopeIndex()
+{
+	Close();
+}
+
+/*static*/ std::string EnvelopeIndex::GetDefaultFileName(const MultiWaveFile& mwf)
+{
+	if (! mwf.GetFileCount())
+		return std::string();
+	return mwf.GetFileName(0) + ".envidx";
+}
+
+/*static*/ UINT32 EnvelopeIndex::GetBlockSize(UINT8 level)
+{
+	return 1U << (ENVIDX_LEVEL_SHIFT * (level + 1));
+}
+
+/*static*/ void EnvelopeIndex::GenerateFileTable(const MultiWaveFile& mwf, std::vector<UINT8>& result)
+{
+	size_t curFile;
+	
+	// per file: sample count, file size, modification time, length of the file title, file title
+	// (The path isn't included, so that the recording can be moved along with its index.)
+	result.clear();
+	for (curFile = 0; curFile < mwf.GetFileCount(); curFile ++)
+	{
+		UINT8 fileItm[0x1A];
+		UINT64 smplCount = mwf.GetFileSamples(curFile);
+		UINT64 fileSize = 0;
+		INT64 mtime = 0;
+		std::string fileTitle = GetFileTitle(mwf.GetFileName(curFile));
+		UINT16 nameLen = (UINT16)fileTitle.length();
+		
+		mwf.GetFileStamp(curFile, fileSize, mtime);
+		memcpy(&fileItm[0x00], &smplCount, 0x08);
+		memcpy(&fileItm[0x08], &fileSize, 0x08);
+		memcpy(&fileItm[0x10], &mtime, 0x08);
+		memcpy(&fileItm[0x18], &nameLen, 0x02);
+		result.insert(result.end(), fileItm, fileItm + sizeof(fileItm));
+		result.insert(result.end(), fileTitle.begin(), fileTitle.begin() + nameLen);
+	}
+	
+	return;
+}
+
+void EnvelopeIndex::SetupLevels(UINT64 dataOfs)
+{
+	UINT8 curLvl;
+	
+	for (curLvl = 0; curLvl < ENVIDX_LEVELS; curLvl ++)
+	{
+		_levelOfs[curLvl] = dataOfs;
+		dataOfs += GetBlockCount(curLvl) * _channels * sizeof(EnvelopeEntry);
+	}
+	
+	return;
+}
+
+UINT8 EnvelopeIndex::Create(const std::string& fileName, const MultiWaveFile& mwf)
+{
+	EnvIdxHeader hdr;
+	std::vector<UINT8> fileTbl;
+	
+	Close();
+	
+	GenerateFileTable(mwf, fileTbl);
+	memset(&hdr, 0x00, sizeof(EnvIdxHeader));
+	hdr.channels = mwf.GetChannels();
+	hdr.smplFormat = mwf.GetSampleFormat();
+	hdr.levels = ENVIDX_LEVELS;
+	hdr.smplRate = mwf.GetSampleRate();
+	hdr.totalSmpls = mwf.GetTotalSamples();
+	hdr.fileCount = (UINT32)mwf.GetFileCount();
+	hdr.tableSize = (UINT32)fileTbl.size();
+	
+	_hFile = fopen(fileName.c_str(), "wb");
+	if (_hFile == NULL)
+		return 0xFF;
+	if (fwrite(&hdr, sizeof(EnvIdxHeader), 1, _hFile) != 1 ||
+		fwrite(fileTbl.data(), 1, fileTbl.size(), _hFile) != fileTbl.size())
+	{
+		Close();
+		return 0xFF;
+	}
+	
+	_channels = hdr.channels;
+	_totalSmpls = hdr.totalSmpls;
+	SetupLevels(sizeof(EnvIdxHeader) + fileTbl.size());
+	
+	return 0x00;
+}
+
+UINT8 EnvelopeIndex::WriteBlocks(UINT8 level, UINT64 blkStart, size_t blkCount, const EnvelopeEntry* entries)
+{
+	std::lock_guard<std::mutex> lock(_fileMutex);
+	size_t entryCnt = blkCount * _channels;
+	
+	if (_hFile == NULL || blkStart + blkCount > GetBlockCount(level))
+		return 0x80;
+	if (fseek64(_hFile, _levelOfs[level] + blkStart * _channels * sizeof(EnvelopeEntry), SEEK_SET))
+		return 0xFF;
+	if (fwrite(entries, sizeof(EnvelopeEntry), entryCnt, _hFile) != entryCnt)
+		return 0xFF;
+	
+	return 0x00;
+}
+
+UINT8 EnvelopeIndex::Finish(void)
+{
+	int result;
+	
+	if (_hFile == NULL)
+		return 0x80;
+	
+	result = fseek64(_hFile, 0, SEEK_SET);
+	if (! result)
+		result = (fwrite(ENVIDX_SIG, 1, 8, _hFile) != 8);
+	result |= fclose(_hFile);
+	_hFile = NULL;
+	
+	return result ? 0xFF : 0x00;
+}
+
+UINT8 EnvelopeIndex::Open(const std::string& fileName, const MultiWaveFile& mwf)
+{
+	EnvIdxHeader hdr;
+	std::vector<UINT8> fileTbl;
+	std::vector<UINT8> idxFileTbl;
+	
+	Close();
+	
+	_hFile = fopen(fileName.c_str(), "rb");
+	if (_hFile == NULL)
+		return 0xFF;
+	if (fread(&hdr, sizeof(EnvIdxHeader), 1, _hFile) != 1 || memcmp(hdr.signature, ENVIDX_SIG, 8))
+	{
+		Close();
+		return 0x80;	// not an index file or incomplete
+	}
+	
+	GenerateFileTable(mwf, fileTbl);
+	if (hdr.channels != mwf.GetChannels() || hdr.smplFormat != mwf.GetSampleFormat() ||
+		hdr.levels != ENVIDX_LEVELS || hdr.smplRate != mwf.GetSampleRate() ||
+		hdr.totalSmpls != mwf.GetTotalSamples() || hdr.fileCount != mwf.GetFileCount() ||
+		hdr.tableSize != fileTbl.size())
+	{
+		Close();
+		return 0x01;
+	}
+	idxFileTbl.resize(hdr.tableSize);
+	if (fread(idxFileTbl.data(), 1, idxFileTbl.size(), _hFile) != idxFileTbl.size() || idxFileTbl != fileTbl)
+	{
+		Close();
+		return 0x01;
+	}
+	
+	_channels = hdr.channels;
+	_totalSmpls = hdr.totalSmpls;
+	SetupLevels(sizeof(EnvIdxHeader) + fileTbl.size());
+	
+	return 0x00;
+}
+
+void EnvelopeIndex::Close(void)
+{
+	if (_hFile != NULL)
+	{
+		fclose(_hFile);
+		_hFile = NULL;
+	}
+	
+	return;
+}
+
+UINT16 EnvelopeIndex::GetChannels(void) const
+{
+	return _channels;
+}
+
+UINT64 EnvelopeIndex::GetBlockCount(UINT8 level) const
+{
+	UINT32 blkSize = GetBlockSize(level);
+	return (_totalSmpls + blkSize - 1) / blkSize;
+}
+
+UINT8 EnvelopeIndex::ReadBlocks(UINT8 level, UINT64 blkStart, size_t blkCount, std::vector<EnvelopeEntry>& result)
+{
+	std::lock_guard<std::mutex> lock(_fileMutex);
+	size_t entryCnt = blkCount * _channels;
+	
+	result.resize(entryCnt);
+	if (_hFile == NULL || blkStart + blkCount > GetBlockCount(level))
+		return 0x80;
+	if (fseek64(_hFile, _levelOfs[level] + blkStart * _channels * sizeof(EnvelopeEntry), SEEK_SET))
+		return 0xFF;
+	if (fread(result.data(), sizeof(EnvelopeEntry), entryCnt, _hFile) != entryCnt)
+		return 0xFF;
+	
+	return 0x00;
+}
+
+static size_t GetLastSepPos(const std::string& fileName)
+{
+	size_t sepPos;
+	size_t wSepPos;	// Windows separator
+	
+	sepPos = fileName.rfind('/');
+	wSepPos = fileName.rfind('\\');
+	if (wSepPos == std::string::npos)
+		return sepPos;
+	else if (sepPos == std::string::npos)
+		return wSepPos;
+	return (wSepPos > sepPos) ? wSepPos : sepPos;
+}
+
+INLINE std::string GetFileTitle(const std::string& fileName)
+{
+	size_t sepPos = GetLastSepPos(fileName);
+	return (sepPos == std::string::npos) ? fileName : fileName.substr(sepPos + 1);
+}
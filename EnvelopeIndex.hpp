@@ -0,0 +1,63 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#ifndef __ENVELOPEINDEX_HPP__
+#define __ENVELOPEINDEX_HPP__
+
+#include <stdio.h>
+#include <stddef.h>	// for size_t
+#include <vector>
+#include <string>
+#include <mutex>
+#include "stdtype.h"
+
+class MultiWaveFile;
+
+#define ENVIDX_LEVELS		3
+#define ENVIDX_LEVEL_SHIFT	6	// each level combines 64 blocks of the previous one, level 0 has 64 frames per block
+
+// amplitude envelope of one channel in a block of frames
+struct EnvelopeEntry
+{
+	INT32 minVal;
+	INT32 maxVal;
+	UINT64 sumAbs;	// sum of abs(value)
+};
+
+// Sidecar file with a pyramid of amplitude envelopes of a recording. (blocks of 64, 4096 and 262144 frames)
+// The values are the ones of SBLK_INT32 blocks. The entries of a level are stored as [block][channel].
+// The header identifies the files of the recording, so that a stale index isn't used.
+class EnvelopeIndex
+{
+public:
+	EnvelopeIndex();
+	~EnvelopeIndex();
+	// default file name: name of the first WAV file + ".envidx"
+	static std::string GetDefaultFileName(const MultiWaveFile& mwf);
+	static UINT32 GetBlockSize(UINT8 level);
+	
+	// Create a new index for the recording. The file is valid after all levels were written and Finish() was called.
+	UINT8 Create(const std::string& fileName, const MultiWaveFile& mwf);
+	// Write the entries of blocks [blkStart, blkStart + blkCount). (can be called from multiple threads)
+	UINT8 WriteBlocks(UINT8 level, UINT64 blkStart, size_t blkCount, const EnvelopeEntry* entries);
+	UINT8 Finish(void);
+	// returns 0x00 on success, 0x01 if the index doesn't belong to the recording (or the files were changed), 0x80+ on errors
+	UINT8 Open(const std::string& fileName, const MultiWaveFile& mwf);
+	void Close(void);
+	
+	UINT16 GetChannels(void) const;
+	UINT64 GetBlockCount(UINT8 level) const;
+	// Read the entries of blocks [blkStart, blkStart + blkCount). (blkCount * channels values)
+	UINT8 ReadBlocks(UINT8 level, UINT64 blkStart, size_t blkCount, std::vector<EnvelopeEntry>& result);
+
+private:
+	static void GenerateFileTable(const MultiWaveFile& mwf, std::vector<UINT8>& result);
+	void SetupLevels(UINT64 dataOfs);
+	
+	FILE* _hFile;
+	std::mutex _fileMutex;
+	UINT16 _channels;
+	UINT64 _totalSmpls;
+	UINT64 _levelOfs[ENVIDX_LEVELS];	// file offsets of the levels
+};
+
+#endif	// __ENVELOPEINDEX_HPP__
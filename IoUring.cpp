@@ -0,0 +1,327 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <vector>
+#include <string.h>	// for memset()
+#include "stdtype.h"
+
+#include "IoUring.hpp"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>	// for __NR_io_uring_*
+#include <sys/mman.h>	// for mmap()
+#include <sys/uio.h>	// for struct iovec
+#include <unistd.h>	// for syscall()/close()
+#include <errno.h>
+#endif
+
+
+IoUring::IoUring() :
+	_ringFd(-1),
+	_sqRing(NULL),
+	_cqRing(NULL),
+	_sqes(NULL),
+	_sqPending(0),
+	_bufsRegistered(false)
+{
+}
+
+IoUring::~IoUring()
+{
+	Deinit();
+}
+
+bool IoUring::IsReady(void) const
+{
+	return (_ringFd != -1);
+}
+
+#ifdef HAVE_IO_URING
+
+static bool IsOpcodeSupported(int ringFd, UINT8 opcode)
+{
+	const size_t opCount = 0x100;
+	std::vector<UINT8> probeBuf(sizeof(struct io_uring_probe) + opCount * sizeof(struct io_uring_probe_op));
+	struct io_uring_probe* probe = (struct io_uring_probe*)probeBuf.data();
+	
+	// IORING_REGISTER_PROBE was added in Linux 5.6, along with IORING_OP_READ.
+	// Kernels without it fail here as well, which is correct, as they would reject all our reads.
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, (unsigned)opCount) < 0)
+		return false;
+	if (opcode > probe->last_op || opcode >= probe->ops_len)
+		return false;
+	return (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+UINT8 IoUring::Init(UINT32 entries)
+{
+	struct io_uring_params params;
+	
+	if (_ringFd != -1)
+		return 0x01;	// already initialized
+	
+	memset(&params, 0x00, sizeof(params));
+	_ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (_ringFd < 0)
+	{
+		_ringFd = -1;
+		return 0xFF;	// not supported (old kernel, disabled or blocked)
+	}
+	if (! IsOpcodeSupported(_ringFd, IORING_OP_READ) || ! IsOpcodeSupported(_ringFd, IORING_OP_READ_FIXED))
+	{
+		close(_ringFd);
+		_ringFd = -1;
+		return 0xFD;	// the ring works, but the read requests don't
+	}
+	
+	_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(UINT32);
+	_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (_cqRingSize > _sqRingSize)
+			_sqRingSize = _cqRingSize;
+		_cqRingSize = _sqRingSize;
+	}
+	_sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+	if (_sqRing == MAP_FAILED)
+	{
+		_sqRing = NULL;
+		Deinit();
+		return 0xFE;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		_cqRing = _sqRing;
+	}
+	else
+	{
+		_cqRing = mmap(NULL, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING);
+		if (_cqRing == MAP_FAILED)
+		{
+			_cqRing = NULL;
+			Deinit();
+			return 0xFE;
+		}
+	}
+	_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	_sqes = mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES);
+	if (_sqes == MAP_FAILED)
+	{
+		_sqes = NULL;
+		Deinit();
+		return 0xFE;
+	}
+	
+	UINT8* sqPtr = (UINT8*)_sqRing;
+	UINT8* cqPtr = (UINT8*)_cqRing;
+	_sqHead = (UINT32*)(sqPtr + params.sq_off.head);
+	_sqTail = (UINT32*)(sqPtr + params.sq_off.tail);
+	_sqMask = (UINT32*)(sqPtr + params.sq_off.ring_mask);
+	_sqArray = (UINT32*)(sqPtr + params.sq_off.array);
+	_sqEntries = params.sq_entries;
+	_cqHead = (UINT32*)(cqPtr + params.cq_off.head);
+	_cqTail = (UINT32*)(cqPtr + params.cq_off.tail);
+	_cqMask = (UINT32*)(cqPtr + params.cq_off.ring_mask);
+	_cqes = cqPtr + params.cq_off.cqes;
+	_sqPending = 0;
+	
+	return 0x00;
+}
+
+void IoUring::Deinit(void)
+{
+	if (_ringFd == -1)
+		return;
+	
+	UnregisterBuffers();
+	if (_sqes != NULL)
+		munmap(_sqes, _sqesSize);
+	if (_cqRing != NULL && _cqRing != _sqRing)
+		munmap(_cqRing, _cqRingSize);
+	if (_sqRing != NULL)
+		munmap(_sqRing, _sqRingSize);
+	_sqes = NULL;
+	_cqRing = NULL;
+	_sqRing = NULL;
+	close(_ringFd);
+	_ringFd = -1;
+	
+	return;
+}
+
+UINT8 IoUring::RegisterBuffers(size_t bufCount, UINT8* const* buffers, size_t bufSize)
+{
+	std::vector<struct iovec> iovs(bufCount);
+	size_t curBuf;
+	
+	UnregisterBuffers();
+	for (curBuf = 0; curBuf < bufCount; curBuf ++)
+	{
+		iovs[curBuf].iov_base = buffers[curBuf];
+		iovs[curBuf].iov_len = bufSize;
+	}
+	// This can fail due to RLIMIT_MEMLOCK. Unregistered buffers work as well, they are just a bit slower.
+	if (syscall(__NR_io_uring_register, _ringFd, IORING_REGISTER_BUFFERS, iovs.data(), (unsigned)bufCount) < 0)
+		return 0xFF;
+	_bufsRegistered = true;
+	
+	return 0x00;
+}
+
+void IoUring::UnregisterBuffers(void)
+{
+	if (! _bufsRegistered)
+		return;
+	
+	syscall(__NR_io_uring_register, _ringFd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+	_bufsRegistered = false;
+	
+	return;
+}
+
+bool IoUring::QueueRead(int fd, void* buffer, UINT32 size, UINT64 offset, int bufIdx, UINT64 userData)
+{
+	UINT32 tail = *_sqTail;	// only written by us
+	UINT32 head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+	if (tail - head >= _sqEntries)
+		return false;	// queue full
+	
+	UINT32 sqIdx = tail & *_sqMask;
+	struct io_uring_sqe* sqe = &((struct io_uring_sqe*)_sqes)[sqIdx];
+	memset(sqe, 0x00, sizeof(struct io_uring_sqe));
+	sqe->opcode = (bufIdx >= 0) ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (UINT64)(size_t)buffer;
+	sqe->len = size;
+	sqe->off = offset;
+	sqe->buf_index = (bufIdx >= 0) ? (UINT16)bufIdx : 0;
+	sqe->user_data = userData;
+	_sqArray[sqIdx] = sqIdx;
+	__atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+	_sqPending ++;
+	
+	return true;
+}
+
+UINT8 IoUring::Submit(void)
+{
+	while(_sqPending > 0)
+	{
+		int ret = (int)syscall(__NR_io_uring_enter, _ringFd, _sqPending, 0, 0, NULL, 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			// EAGAIN/EBUSY: Retrying right away doesn't help, completions have to be reaped first.
+			return (errno == EAGAIN || errno == EBUSY) ? 0x01 : 0xFF;
+		}
+		if (ret == 0)
+			return 0xFF;	// nothing was submitted, so retrying would loop forever
+		_sqPending -= (UINT32)ret;
+	}
+	
+	return 0x00;
+}
+
+bool IoUring::UnqueueRead(UINT64& userData)
+{
+	if (_sqPending == 0)
+		return false;
+	
+	// The kernel only consumes entries in io_uring_enter(), so the unsubmitted ones can be taken back.
+	UINT32 tail = *_sqTail - 1;	// only written by us
+	const struct io_uring_sqe* sqe = &((const struct io_uring_sqe*)_sqes)[tail & *_sqMask];
+	userData = sqe->user_data;
+	__atomic_store_n(_sqTail, tail, __ATOMIC_RELEASE);
+	_sqPending --;
+	
+	return true;
+}
+
+UINT8 IoUring::PeekCompletion(UINT64& userData, INT32& result)
+{
+	UINT32 head = *_cqHead;	// only written by us
+	UINT32 tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+	if (head == tail)
+		return 0x01;	// no completion available
+	
+	const struct io_uring_cqe* cqe = &((const struct io_uring_cqe*)_cqes)[head & *_cqMask];
+	userData = cqe->user_data;
+	result = cqe->res;
+	__atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+	
+	return 0x00;
+}
+
+UINT8 IoUring::WaitCompletion(UINT64& userData, INT32& result)
+{
+	while(PeekCompletion(userData, result))
+	{
+		// submits pending requests and waits for at least one completion
+		int ret = (int)syscall(__NR_io_uring_enter, _ringFd, _sqPending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return 0xFF;
+		}
+		_sqPending -= (UINT32)ret;
+	}
+	
+	return 0x00;
+}
+
+#else	// ! HAVE_IO_URING
+
+UINT8 IoUring::Init(UINT32 entries)
+{
+	return 0xFF;	// not supported
+}
+
+void IoUring::Deinit(void)
+{
+	return;
+}
+
+UINT8 IoUring::RegisterBuffers(size_t bufCount, UINT8* const* buffers, size_t bufSize)
+{
+	return 0xFF;
+}
+
+void IoUring::UnregisterBuffers(void)
+{
+	return;
+}
+
+bool IoUring::QueueRead(int fd, void* buffer, UINT32 size, UINT64 offset, int bufIdx, UINT64 userData)
+{
+	return false;
+}
+
+UINT8 IoUring::Submit(void)
+{
+	return 0xFF;
+}
+
+bool IoUring::UnqueueRead(UINT64& userData)
+{
+	return false;
+}
+
+UINT8 IoUring::PeekCompletion(UINT64& userData, INT32& result)
+{
+	return 0xFF;
+}
+
+UINT8 IoUring::WaitCompletion(UINT64& userData, INT32& result)
+{
+	return 0xFF;
+}
+
+#endif	// HAVE_IO_URING
@@ -0,0 +1,60 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#ifndef __IOURING_HPP__
+#define __IOURING_HPP__
+
+#include <stddef.h>	// for size_t
+#include "stdtype.h"
+
+// Minimal io_uring wrapper for asynchronous file reads.
+// It uses the raw system calls, so liburing isn't required.
+// On systems without io_uring, Init() fails and the caller is expected to fall back to normal reads.
+class IoUring
+{
+public:
+	IoUring();
+	~IoUring();
+	UINT8 Init(UINT32 entries);
+	void Deinit(void);
+	bool IsReady(void) const;
+	
+	// register buffers for IORING_OP_READ_FIXED (all buffers have the same size)
+	UINT8 RegisterBuffers(size_t bufCount, UINT8* const* buffers, size_t bufSize);
+	void UnregisterBuffers(void);
+	
+	// Queue a read request. bufIdx = index of the registered buffer, -1 for unregistered buffers.
+	// Returns false when the submission queue is full.
+	bool QueueRead(int fd, void* buffer, UINT32 size, UINT64 offset, int bufIdx, UINT64 userData);
+	// Submit all queued requests. Returns 0x01 when the kernel is temporarily out of resources, 0xFF on other errors.
+	// The requests that weren't submitted stay queued.
+	UINT8 Submit(void);
+	// Remove the last queued request that wasn't submitted yet. Returns false when there is none.
+	bool UnqueueRead(UINT64& userData);
+	// get a completion (Wait blocks until there is one, Peek returns 0x01 if there is none)
+	UINT8 WaitCompletion(UINT64& userData, INT32& result);
+	UINT8 PeekCompletion(UINT64& userData, INT32& result);
+	
+private:
+	int _ringFd;
+	void* _sqRing;
+	size_t _sqRingSize;
+	void* _cqRing;
+	size_t _cqRingSize;
+	void* _sqes;
+	size_t _sqesSize;
+	
+	UINT32* _sqHead;
+	UINT32* _sqTail;
+	UINT32* _sqMask;
+	UINT32* _sqArray;
+	UINT32 _sqEntries;
+	UINT32* _cqHead;
+	UINT32* _cqTail;
+	UINT32* _cqMask;
+	void* _cqes;
+	
+	UINT32 _sqPending;	// queued, but not yet submitted
+	bool _bufsRegistered;
+};
+
+#endif	// __IOURING_HPP__
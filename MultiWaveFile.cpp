@@ -1,13 +1,86 @@
 // Copyright 2021, Valley Bell
 // SPDX-License-Identifier: GPL-2.0-or-later
+#define _FILE_OFFSET_BITS	64	// 64-bit off_t for pread()/mmap() on 32-bit systems
 #include <vector>
 #include <string>
+#include <map>
+#include <atomic>
+#include <algorithm>	// for std::upper_bound()
 #include <stdio.h>
-#include <string.h>	// for memset()/memcmp()
+#include <stdlib.h>	// for _fullpath()
+#include <string.h>	// for memset()/memcmp()/memcpy()/strerror()
+#include <ctype.h>	// for iscntrl()
+#include <chrono>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>	// for CreateFileMapping()/MapViewOfFile()/ReadFile()
+#include <io.h>	// for _open()/_get_osfhandle()
+#include <process.h>	// for _getpid()
+#include <fcntl.h>	// for _O_RDONLY
+#include <sys/stat.h>	// for _fstat64()
+#else
+#include <sys/mman.h>	// for mmap()/madvise()
+#include <sys/stat.h>	// for fstat()
+#include <fcntl.h>	// for open()/posix_fadvise()
+#include <unistd.h>	// for pread()/sysconf()/getcwd()/getpid()
+#include <errno.h>
+#endif
 #include "stdtype.h"
 
 #include "MultiWaveFile.hpp"
 
+// Sony Wave64 chunk GUIDs
+static const UINT8 W64_GUID_RIFF[0x10] = {0x72, 0x69, 0x66, 0x66, 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const UINT8 W64_GUID_WAVE[0x10] = {0x77, 0x61, 0x76, 0x65, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const UINT8 W64_GUID_FMT[0x10]  = {0x66, 0x6D, 0x74, 0x20, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const UINT8 W64_GUID_DATA[0x10] = {0x64, 0x61, 0x74, 0x61, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+// alignment of offsets, sizes and buffers for direct I/O
+#define DIO_ALIGN	0x1000
+
+// number of threads for probing the file headers (mostly waiting for the storage)
+#define PROBE_THREADS	16
+
+#define META_CACHE_SIG	"# wavrec-split metadata cache v2"
+
+struct MetaCacheEntry
+{
+	UINT64 fileSize;
+	INT64 mtime;	// modification time in nanoseconds
+	WaveInfo wi;
+};
+typedef std::map<std::string, MetaCacheEntry> MetaCache;	// key: absolute path
+
+struct ProbeItem
+{
+	std::string path;	// absolute path (empty = not cacheable)
+	MetaCacheEntry mce;
+	bool cacheHit;
+	UINT8 retVal;
+};
+
+// read-ahead states
+#define RA_IDLE		0x00
+#define RA_QUEUED	0x01
+#define RA_READING	0x02
+#define RA_DONE		0x03
+
+// io_uring settings
+#define UR_RING_SIZE	64	// number of ring entries = maximum queue depth
+#define UR_PIECE_SIZE	0x100000	// maximum size of a single read request (1 MB)
+#define UR_AHEAD_SIZE	0x4000000	// amount of data to read ahead (64 MB)
+#define UR_MIN_BLOCKS	3
+#define UR_MAX_BLOCKS	64
+#define UR_BUF_ALIGN	0x1000
+
+// page cache hints
+#define CACHE_STEP_SIZE	0x1000000	// granularity of the cache hints (16 MB), data is read ahead by 2 steps
+#define CACHE_DROP_OVERLAP	0x200000	// start drops 2 MB early, so that large folios at the previous end get dropped as well
+#define CACHE_ADV_READ	0x00	// sequential access, read ahead
+#define CACHE_ADV_DROP	0x01	// drop from the page cache
+#define CACHE_ADV_RANDOM	0x02	// random access, no read-ahead
+
 #ifndef INLINE
 #if defined(_MSC_VER)
 #define INLINE	static __inline
@@ -19,14 +92,44 @@
 #endif	// INLINE
 
 
+static UINT8 ReadRiffChunks(int fd, WaveInfo& wi, UINT64& dataSize);
+static void ReadExtensibleFormat(int fd, WaveInfo& wi, UINT64 fmtPos, UINT64 fmtSize);
+static UINT8 SampleFormatFromWave(UINT16 compression, UINT8 bits);
+static bool IsValidFormat(const WAVEFORMAT& wf);
+static UINT8 ReadWave64Chunks(int fd, WaveInfo& wi, UINT64& dataSize);
+static int OpenFileRO(const std::string& fileName);
+static void CloseFile(int fd);
+static UINT8 SetDirectIO(int fd, bool enable);
+static size_t ReadFileAt(int fd, void* buffer, size_t size, UINT64 offset);
+static UINT64 GetFileSize(int fd);
+static UINT8 GetFileStat(const std::string& fileName, UINT64& size, INT64& mtime);
+static std::string GetAbsolutePath(const std::string& fileName);
+static void ProbeWaveFile(const std::string& fileName, const MetaCache* cache, ProbeItem& pi, WaveInfo& wi);
+static UINT8 LoadMetaCache(const std::string& fileName, MetaCache& cache);
+static UINT8 SaveMetaCache(const std::string& fileName, const MetaCache& cache);
+INLINE double GetTimeSec(void);
 static std::string GetTimeStrHMS(UINT32 smplRate, UINT64 smplPos);
 static size_t GetLastSepPos(const std::string& fileName);
 INLINE std::string GetFileTitle(const std::string& fileName);
 
 
 MultiWaveFile::MultiWaveFile() :
-	_totalSamples(0)
+	_totalSamples(0),
+	_fhUseCnt(0),
+	_fhMaxOpen(64),
+	_ioMode(MWF_IO_READ),
+	_readAhead(false),
+	_raEnable(false),
+	_raState(RA_IDLE),
+	_raExit(false),
+	_cacheMode(MWF_CACHE_NORMAL),
+	_urEnable(false),
+	_urFixedBufs(false),
+	_urSubmitWarned(false),
+	_urHeld((size_t)-1),
+	_urInFlight(0)
 {
+	memset(&_raStats, 0x00, sizeof(ReadAheadStats));
 }
 
 MultiWaveFile::~MultiWaveFile()
@@ -54,6 +157,11 @@ UINT8 MultiWaveFile::GetBitDepth(void) const
 	return _bitDepth;
 }
 
+UINT8 MultiWaveFile::GetSampleFormat(void) const
+{
+	return _smplFormat;
+}
+
 UINT32 MultiWaveFile::GetSampleSize(void) const
 {
 	return _channels * _bitDepth / 8;
@@ -69,156 +177,441 @@ UINT64 MultiWaveFile::GetSampleReadOffset(void) const
 	return _smplOfs;
 }
 
+size_t MultiWaveFile::GetFileCount(void) const
+{
+	return _files.size();
+}
+
+const std::string& MultiWaveFile::GetFileName(size_t fileID) const
+{
+	return _files[fileID].fileName;
+}
+
+UINT64 MultiWaveFile::GetFileSamples(size_t fileID) const
+{
+	return _files[fileID].smplCount;
+}
+
+UINT8 MultiWaveFile::GetFileStamp(size_t fileID, UINT64& size, INT64& mtime) const
+{
+	return GetFileStat(_files[fileID].fileName, size, mtime);
+}
+
+void MultiWaveFile::SetIOMode(UINT8 ioMode)
+{
+	_ioMode = ioMode;
+}
+
+UINT8 MultiWaveFile::GetIOMode(void) const
+{
+	return _ioMode;
+}
+
+void MultiWaveFile::SetMaxOpenFiles(size_t maxFiles)
+{
+	_fhMaxOpen = (maxFiles > 0) ? maxFiles : 1;
+}
+
+size_t MultiWaveFile::GetMaxOpenFiles(void) const
+{
+	return _fhMaxOpen;
+}
+
+void MultiWaveFile::SetMetaCache(const std::string& fileName)
+{
+	_metaCachePath = fileName;
+}
+
+void MultiWaveFile::SetReadAhead(bool enable)
+{
+	_readAhead = enable;
+}
+
+bool MultiWaveFile::GetReadAhead(void) const
+{
+	return _readAhead;
+}
+
+const ReadAheadStats& MultiWaveFile::GetReadAheadStats(void) const
+{
+	return _raStats;
+}
+
+void MultiWaveFile::SetCacheMode(UINT8 mode)
+{
+	_cacheMode = mode;
+}
+
+UINT8 MultiWaveFile::GetCacheMode(void) const
+{
+	return _cacheMode;
+}
+
 void MultiWaveFile::SetSampleReadOffset(UINT64 readOffset)
 {
 	_smplOfs = readOffset;
 	if (_smplOfs >= GetTotalSamples())
 		_smplOfs = 0;
+	// Disable the kernel's read-ahead for random accesses, as nothing would drop the extra data from the cache.
+	if (_cacheMode != MWF_CACHE_NORMAL && _smplOfs != _cacheLastEnd)
+		AdviseSamples(_smplOfs, _smplOfs + 1, CACHE_ADV_RANDOM);
 }
 
-size_t MultiWaveFile::GetFileFromSample(UINT64 sample)
+size_t MultiWaveFile::GetFileFromSample(UINT64 sample) const
 {
-	size_t curFile;
+	// binary search for the last file that starts at or before the sample
+	std::vector<WaveItem>::const_iterator fileIt = std::upper_bound(_files.begin(), _files.end(), sample,
+		[](UINT64 smpl, const WaveItem& wItm) { return smpl < wItm.startSmpl; });
+	if (fileIt == _files.begin())
+		return (size_t)-1;
+	--fileIt;
+	if (sample >= fileIt->startSmpl + fileIt->smplCount)
+		return (size_t)-1;
+	return (size_t)(fileIt - _files.begin());
+}
+
+int MultiWaveFile::AcquireFile(size_t fileID)
+{
+	std::lock_guard<std::mutex> lock(_fhMutex);
+	FileHandle& fh = _fHandles[fileID];
 	
-	for (curFile = 0; curFile < _files.size(); curFile ++)
+	if (fh.fd == -1)
 	{
-		const WaveItem& wItm = _files[curFile];
-		if (sample < wItm.startSmpl + wItm.smplCount)
-			return curFile;
+		if (_fhOpen.size() >= _fhMaxOpen)
+		{
+			// close the least recently used file that isn't being read from right now
+			size_t lruIdx = (size_t)-1;
+			size_t curIdx;
+			for (curIdx = 0; curIdx < _fhOpen.size(); curIdx ++)
+			{
+				const FileHandle& ofh = _fHandles[_fhOpen[curIdx]];
+				if (ofh.refCnt == 0 && (lruIdx == (size_t)-1 || ofh.lastUse < _fHandles[_fhOpen[lruIdx]].lastUse))
+					lruIdx = curIdx;
+			}
+			if (lruIdx != (size_t)-1)
+			{
+				FileHandle& lruFh = _fHandles[_fhOpen[lruIdx]];
+				CloseFile(lruFh.fd);
+				lruFh.fd = -1;
+				_fhOpen[lruIdx] = _fhOpen.back();
+				_fhOpen.pop_back();
+			}
+		}
+		fh.fd = OpenFileRO(_files[fileID].fileName);
+		if (fh.fd == -1)
+			return -1;
+		if (_ioMode == MWF_IO_DIRECT)
+			SetDirectIO(fh.fd, true);	// on failure, the aligned reads still work (through the cache)
+		_fhOpen.push_back(fileID);
 	}
-	return (size_t)-1;
+	fh.refCnt ++;
+	fh.lastUse = ++_fhUseCnt;
+	
+	return fh.fd;
+}
+
+void MultiWaveFile::ReleaseFile(size_t fileID)
+{
+	std::lock_guard<std::mutex> lock(_fhMutex);
+	_fHandles[fileID].refCnt --;
+	return;
 }
 
 /*static*/ UINT8 MultiWaveFile::LoadSingleWave(const std::string& fileName, WaveInfo& wi)
 {
-	FILE* hFile;
-	size_t readEl;
-	char chnkFCC[4];
-	UINT32 chnkSize;
+	int fd;
+	UINT8 fileHdr[0x28];
+	UINT64 dataSize;
 	UINT8 found;
 	
 	memset(&wi, 0x00, sizeof(WaveInfo));
+	memset(fileHdr, 0x00, sizeof(fileHdr));
+	wi.fd = -1;
 	
-	hFile = fopen(fileName.c_str(), "rb");
-	if (hFile == NULL)
+	fd = OpenFileRO(fileName);
+	if (fd == -1)
 	{
 		fprintf(stderr, "Error opening file!\n");
 		return 0xFF;
 	}
 	
-	readEl = fread(chnkFCC, 0x04, 1, hFile);
-	if (readEl == 0 || memcmp(chnkFCC, "RIFF", 4))
+	dataSize = 0;
+	ReadFileAt(fd, fileHdr, sizeof(fileHdr), 0);
+	if (! memcmp(&fileHdr[0x00], "RIFF", 4) || ! memcmp(&fileHdr[0x00], "RF64", 4) ||
+		! memcmp(&fileHdr[0x00], "BW64", 4))
 	{
-		fclose(hFile);
-		fprintf(stderr, "Bad file.\n");
-		return 0xF0;
+		if (memcmp(&fileHdr[0x08], "WAVE", 4))
+		{
+			CloseFile(fd);
+			fprintf(stderr, "Bad file.\n");
+			return 0xF1;
+		}
+		found = ReadRiffChunks(fd, wi, dataSize);
 	}
-	fseek(hFile, 0x08, SEEK_SET);
-	readEl = fread(chnkFCC, 0x04, 1, hFile);
-	if (readEl == 0 || memcmp(chnkFCC, "WAVE", 4))
+	else if (! memcmp(&fileHdr[0x00], W64_GUID_RIFF, 0x10))
 	{
-		fclose(hFile);
+		if (memcmp(&fileHdr[0x18], W64_GUID_WAVE, 0x10))
+		{
+			CloseFile(fd);
+			fprintf(stderr, "Bad file.\n");
+			return 0xF1;
+		}
+		found = ReadWave64Chunks(fd, wi, dataSize);
+	}
+	else
+	{
+		CloseFile(fd);
 		fprintf(stderr, "Bad file.\n");
-		return 0xF1;
+		return 0xF0;
 	}
-	
-	found = 0x00;
-	while(! feof(hFile) && ! ferror(hFile))
+	if (found & 0x80)
 	{
-		readEl = fread(chnkFCC, 0x04, 1, hFile);
-		readEl += fread(&chnkSize, 0x04, 1, hFile);
-		if (readEl < 2)
-			break;
-		size_t fPos = ftell(hFile);
-		if (! memcmp(chnkFCC, "data", 4))
-		{
-			found |= 0x02;
-			wi.dataOfs = (UINT32)ftell(hFile);
-			break;
-		}
-		else if (! memcmp(chnkFCC, "fmt ", 4))
-		{
-			found |= 0x01;
-			readEl = fread(&wi.format, sizeof(WAVEFORMAT), 1, hFile);
-			if (readEl == 0)
-			{
-				fclose(hFile);
-				fprintf(stderr, "Error reading format chunk.\n");
-				return 0xFE;
-			}
-		}
-		fseek(hFile, (long)(fPos + chnkSize), SEEK_SET);
+		CloseFile(fd);
+		fprintf(stderr, "Error reading format chunk.\n");
+		return 0xFE;
 	}
 	if (! (found & 0x01))
 	{
-		fclose(hFile);
+		CloseFile(fd);
 		fprintf(stderr, "Format chunk not found.\n");
 		return 0xF2;
 	}
 	if (! (found & 0x02))
 	{
-		fclose(hFile);
+		CloseFile(fd);
 		fprintf(stderr, "Data chunk not found.\n");
 		return 0xF3;
 	}
+	if (! IsValidFormat(wi.format))
+	{
+		CloseFile(fd);
+		fprintf(stderr, "Invalid format.\n");
+		return 0xF4;
+	}
+	
+	wi.fd = fd;
+	wi.smplCount = dataSize / wi.format.nBlockAlign;
+	
+	return 0x00;
+}
+
+/*static*/ UINT8 MultiWaveFile::MapWaveData(WaveItem& wItm, int fd, UINT32 smplSize)
+{
+	UINT64 fileSize;
+	UINT64 mapOfs;
+	UINT64 mapEnd;
+	
+	wItm.mapBase = NULL;
+	wItm.mapSize = 0;
+	wItm.mapData = NULL;
 	
-	wi.hFile = hFile;
-	wi.smplCount = chnkSize / wi.format.nBlockAlign;
+	// never map beyond the end of the file (truncated recordings), as accessing those pages would crash
+	mapEnd = wItm.wi.dataOfs + wItm.smplCount * smplSize;
+	fileSize = GetFileSize(fd);
+	if (mapEnd > fileSize)
+		mapEnd = fileSize;
+	if (mapEnd <= wItm.wi.dataOfs)
+		return 0x01;	// nothing to map
+	
+#ifdef _WIN32
+	SYSTEM_INFO sysInfo;
+	HANDLE hMap;
+	
+	GetSystemInfo(&sysInfo);
+	mapOfs = wItm.wi.dataOfs - wItm.wi.dataOfs % sysInfo.dwAllocationGranularity;
+	if (mapEnd - mapOfs > (size_t)-1)
+		return 0x80;	// doesn't fit into the address space
+	hMap = CreateFileMapping((HANDLE)_get_osfhandle(fd), NULL, PAGE_READONLY,
+		(DWORD)(mapEnd >> 32), (DWORD)mapEnd, NULL);
+	if (hMap == NULL)
+		return 0xFF;
+	wItm.mapBase = MapViewOfFile(hMap, FILE_MAP_READ, (DWORD)(mapOfs >> 32), (DWORD)mapOfs, (SIZE_T)(mapEnd - mapOfs));
+	CloseHandle(hMap);	// the view keeps its own reference to the mapping object
+	if (wItm.mapBase == NULL)
+		return 0xFF;
+#else
+	void* mapPtr;
+	
+	mapOfs = wItm.wi.dataOfs - wItm.wi.dataOfs % (UINT64)sysconf(_SC_PAGESIZE);
+	if (mapEnd - mapOfs > (size_t)-1)
+		return 0x80;	// doesn't fit into the address space
+	mapPtr = mmap(NULL, (size_t)(mapEnd - mapOfs), PROT_READ, MAP_SHARED, fd, (off_t)mapOfs);
+	if (mapPtr == MAP_FAILED)
+		return 0xFF;
+	wItm.mapBase = mapPtr;
+#endif
+	wItm.mapSize = (size_t)(mapEnd - mapOfs);
+	wItm.mapData = (const UINT8*)wItm.mapBase + (size_t)(wItm.wi.dataOfs - mapOfs);
 	
 	return 0x00;
 }
 
+/*static*/ void MultiWaveFile::UnmapWaveData(WaveItem& wItm)
+{
+	if (wItm.mapBase == NULL)
+		return;
+	
+#ifdef _WIN32
+	UnmapViewOfFile(wItm.mapBase);
+#else
+	munmap(wItm.mapBase, wItm.mapSize);
+#endif
+	wItm.mapBase = NULL;
+	wItm.mapSize = 0;
+	wItm.mapData = NULL;
+	
+	return;
+}
+
 UINT8 MultiWaveFile::LoadWaveFiles(const std::vector<std::string>& fileList)
 {
 	size_t curFile;
 	UINT8 retVal;
+	MetaCache metaCache;
+	bool useCache = ! _metaCachePath.empty();
+	bool cacheDirty = false;
 	
 	CloseFiles();
 	
+	if (useCache)
+		LoadMetaCache(_metaCachePath, metaCache);
+	
+	// Probe all headers in parallel, as opening a file on network storage takes a while.
+	std::vector<WaveItem> wItms(fileList.size());
+	std::vector<ProbeItem> probes(fileList.size());
+	{
+		std::atomic<size_t> nextFile(0);
+		size_t fhMaxOpen = _fhMaxOpen;
+		auto probeWorker = [&]()
+		{
+			size_t fileID;
+			while((fileID = nextFile ++) < fileList.size())
+			{
+				WaveInfo& wi = wItms[fileID].wi;
+				ProbeWaveFile(fileList[fileID], useCache ? &metaCache : NULL, probes[fileID], wi);
+				if (fileID >= fhMaxOpen && wi.fd != -1)
+				{
+					// only the first files are kept open for the handle pool
+					CloseFile(wi.fd);
+					wi.fd = -1;
+				}
+			}
+		};
+		std::vector<std::thread> threads;
+		size_t thrCount = (fileList.size() < PROBE_THREADS) ? fileList.size() : PROBE_THREADS;
+		size_t curThr;
+		for (curThr = 1; curThr < thrCount; curThr ++)
+			threads.push_back(std::thread(probeWorker));
+		probeWorker();
+		for (curThr = 0; curThr < threads.size(); curThr ++)
+			threads[curThr].join();
+	}
+	
 	_totalSamples = 0;
 	for (curFile = 0; curFile < fileList.size(); curFile ++)
 	{
-		WaveItem wItm;
+		WaveItem& wItm = wItms[curFile];
+		const ProbeItem& pi = probes[curFile];
 		std::string fileTitle;
 		
 		wItm.fileName = fileList[curFile];
+		wItm.mapTried = false;
+		wItm.mapBase = NULL;
+		wItm.mapSize = 0;
+		wItm.mapData = NULL;
 		fileTitle = GetFileTitle(wItm.fileName);
-		retVal = MultiWaveFile::LoadSingleWave(wItm.fileName, wItm.wi);
-		if (retVal)
+		retVal = pi.retVal;
+		if (! retVal)
 		{
-			fprintf(stderr, "Error 0x%02X opening %s!\n", retVal, fileTitle.c_str());
-			return retVal;
-		}
-		if (curFile == 0)
-		{
-			_compression = wItm.wi.format.wFormatTag;
-			_channels = wItm.wi.format.nChannels;
-			_bitDepth = (UINT8)wItm.wi.format.wBitsPerSample;
-			_sampleRate = wItm.wi.format.nSamplesPerSec;
-		}
-		else
-		{
-			if (_compression != wItm.wi.format.wFormatTag ||
+			if (curFile == 0)
+			{
+				_compression = wItm.wi.format.wFormatTag;
+				_channels = wItm.wi.format.nChannels;
+				_bitDepth = (UINT8)wItm.wi.format.wBitsPerSample;
+				_sampleRate = wItm.wi.format.nSamplesPerSec;
+			}
+			else if (_compression != wItm.wi.format.wFormatTag ||
 				_channels != wItm.wi.format.nChannels ||
 				_bitDepth != wItm.wi.format.wBitsPerSample ||
 				_sampleRate != wItm.wi.format.nSamplesPerSec)
 			{
-				fclose(wItm.wi.hFile);
 				fprintf(stderr, "File %s has a different format!\n", fileTitle.c_str());
-				return 0x80;
+				retVal = 0x80;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Error 0x%02X opening %s!\n", retVal, fileTitle.c_str());
+		}
+		if (retVal)
+		{
+			// close the files that weren't handed over to the pool yet
+			for (; curFile < wItms.size(); curFile ++)
+			{
+				if (wItms[curFile].wi.fd != -1)
+					CloseFile(wItms[curFile].wi.fd);
 			}
+			return retVal;
+		}
+		if (! pi.path.empty() && ! pi.cacheHit)
+		{
+			MetaCacheEntry& mce = metaCache[pi.path];
+			mce = pi.mce;
+			mce.wi.fd = -1;
+			cacheDirty = true;
 		}
 		wItm.startSmpl = _totalSamples;
 		wItm.smplCount = wItm.wi.smplCount;
 		_totalSamples += wItm.smplCount;
+		
+		// hand the file over to the handle pool, keep it open while there is room for it
+		FileHandle fh = {-1, 0, 0};
+		if (wItm.wi.fd != -1)
+		{
+			if (_fhOpen.size() < _fhMaxOpen)
+			{
+				fh.fd = wItm.wi.fd;
+				_fhOpen.push_back(_fHandles.size());
+			}
+			else
+			{
+				CloseFile(wItm.wi.fd);
+			}
+		}
+		wItm.wi.fd = -1;
+		_fHandles.push_back(fh);
 		_files.push_back(wItm);
 	}
+	if (cacheDirty && SaveMetaCache(_metaCachePath, metaCache))
+		fprintf(stderr, "Warning: Unable to write metadata cache %s!\n", _metaCachePath.c_str());
+	
+	if (_ioMode == MWF_IO_DIRECT && ! _files.empty())
+	{
+		size_t curFH;
+		UINT8 dioErr = 0x00;
+		for (curFH = 0; curFH < _fhOpen.size(); curFH ++)
+			dioErr |= SetDirectIO(_fHandles[_fhOpen[curFH]].fd, true);
+		if (_fhOpen.empty())
+		{
+			// check the first file (AcquireFile enables direct I/O)
+			int fd = AcquireFile(0);
+			dioErr = (fd == -1 || SetDirectIO(fd, true)) ? 0xFF : 0x00;
+			if (fd != -1)
+				ReleaseFile(0);
+		}
+		if (dioErr)
+		{
+			fprintf(stderr, "Warning: Direct I/O is not supported, using normal reads.\n");
+			for (curFH = 0; curFH < _fhOpen.size(); curFH ++)
+				SetDirectIO(_fHandles[_fhOpen[curFH]].fd, false);
+			_ioMode = MWF_IO_READ;
+		}
+	}
 	
 	//_dBufSmpls = 0x10000;	// 64k samples
 	//_dataBuf.resize(GetSampleSize() * _dBufSmpls);
 	
-	_smplOfs = 0;
-	_smplOfsFile = 0;
+	InitReadState();
 	
 	std::string duratStr = GetTimeStrHMS(_sampleRate, _totalSamples);
 	fprintf(stderr, "Opened %u %s. Format %u, Channels %u, Bits %u, Rate %u, Total Duration: %s\n",
@@ -228,60 +621,1342 @@ UINT8 MultiWaveFile::LoadWaveFiles(const std::vector<std::string>& fileList)
 	return 0x00;
 }
 
-void MultiWaveFile::CloseFiles(void)
+UINT8 MultiWaveFile::LoadWaveFiles(const MultiWaveFile& src)
 {
 	size_t curFile;
 	
+	CloseFiles();
+	
+	_ioMode = src._ioMode;	// after the fallbacks of the source
+	_readAhead = src._readAhead;
+	_fhMaxOpen = src._fhMaxOpen;
+	_cacheMode = src._cacheMode;
+	
+	_files = src._files;
 	for (curFile = 0; curFile < _files.size(); curFile ++)
 	{
-		const WaveInfo& wi = _files[curFile].wi;
-		if (wi.hFile != NULL)
-			fclose(wi.hFile);
+		WaveItem& wItm = _files[curFile];
+		wItm.wi.fd = -1;
+		wItm.mapTried = false;
+		wItm.mapBase = NULL;
+		wItm.mapSize = 0;
+		wItm.mapData = NULL;
+		FileHandle fh = {-1, 0, 0};
+		_fHandles.push_back(fh);
+	}
+	_totalSamples = src._totalSamples;
+	_compression = src._compression;
+	_channels = src._channels;
+	_bitDepth = src._bitDepth;
+	_sampleRate = src._sampleRate;
+	
+	InitReadState();
+	
+	return 0x00;
+}
+
+void MultiWaveFile::InitReadState(void)
+{
+	_smplOfs = 0;
+	_smplOfsFile = 0;
+	
+	if (_ioMode == MWF_IO_URING && ! _uring.IsReady())
+	{
+		if (_uring.Init(UR_RING_SIZE))
+		{
+			fprintf(stderr, "Warning: io_uring is not available, using normal reads.\n");
+			_ioMode = MWF_IO_READ;
+		}
+		else
+		{
+			size_t curPiece;
+			_urPieces.resize(UR_RING_SIZE);
+			_urFreePieces.clear();
+			for (curPiece = 0; curPiece < _urPieces.size(); curPiece ++)
+				_urFreePieces.push_back(curPiece);
+		}
+	}
+	_urEnable = (_ioMode == MWF_IO_URING);
+	_cacheLastEnd = 0;
+	_cacheAdvEnd = 0;
+	_cacheDropPos = 0;
+	_cacheDropLimit = (UINT64)-1;
+	_cacheKeep.clear();
+	_raEnable = _readAhead && (_ioMode == MWF_IO_READ);
+	_raFileID = 0;
+	_raLastEnd = 0;
+	memset(&_raStats, 0x00, sizeof(ReadAheadStats));
+	
+	_smplFormat = SampleFormatFromWave(_compression, _bitDepth);
+	
+	return;
+}
+
+void MultiWaveFile::CloseFiles(void)
+{
+	size_t curFile;
+	
+	StopReadAhead();	// The I/O thread must not access the files anymore.
+	UringDrain();	// same for requests in flight
+	if (_cacheMode != MWF_CACHE_NORMAL && ! _files.empty())
+	{
+		FlushCacheDrop(_cacheLastEnd);
+		ReleaseCacheRanges();
 	}
+	for (curFile = 0; curFile < _files.size(); curFile ++)
+		UnmapWaveData(_files[curFile]);
+	for (curFile = 0; curFile < _fhOpen.size(); curFile ++)
+		CloseFile(_fHandles[_fhOpen[curFile]].fd);
 	_files.clear();
+	_fHandles.clear();
+	_fhOpen.clear();
 	
 	return;
 }
 
-size_t MultiWaveFile::ReadSamples(size_t bufSize, void* buffer)
+size_t MultiWaveFile::ReadFileSamples(UINT64 smplOfs, size_t smplCount, UINT8* buffer, size_t& fileID)
 {
 	size_t smplSize = GetSampleSize();
-	size_t remSmpls = bufSize / smplSize;
+	size_t remSmpls = smplCount;
 	size_t bufPos = 0;
-	UINT8* bufPtr = (UINT8*)buffer;
-	WaveItem* wItm = (_smplOfsFile < _files.size()) ? &_files[_smplOfsFile] : NULL;
+	const WaveItem* wItm = (fileID < _files.size()) ? &_files[fileID] : NULL;
 	
-	if (wItm == NULL || _smplOfs < wItm->startSmpl || _smplOfs >= (wItm->startSmpl + wItm->smplCount))
+	if (wItm == NULL || smplOfs < wItm->startSmpl || smplOfs >= (wItm->startSmpl + wItm->smplCount))
 	{
-		_smplOfsFile = GetFileFromSample(_smplOfs);
-		wItm = (_smplOfsFile != (size_t)-1) ? &_files[_smplOfsFile] : NULL;
+		fileID = GetFileFromSample(smplOfs);
+		wItm = (fileID != (size_t)-1) ? &_files[fileID] : NULL;
 	}
 	
 	while(wItm != NULL && remSmpls > 0)
 	{
-		size_t fileSmpl = (UINT32)(_smplOfs - wItm->startSmpl);
-		size_t fileOfs = wItm->wi.dataOfs + fileSmpl * smplSize;
-		size_t readSmpls;
+		UINT64 fileSmpl = smplOfs - wItm->startSmpl;
+		UINT64 fileOfs = wItm->wi.dataOfs + fileSmpl * smplSize;
+		UINT64 readSmpls;
 		
-		fseek(wItm->wi.hFile, (long)fileOfs, SEEK_SET);
-		readSmpls = (UINT32)wItm->smplCount - fileSmpl;
+		int fd = AcquireFile(fileID);
+		if (fd == -1)
+			break;
+		// positioned read: no seeking, no stdio buffering, safe for concurrent use
+		readSmpls = wItm->smplCount - fileSmpl;
 		if (readSmpls > remSmpls)
 			readSmpls = remSmpls;
-		readSmpls = (UINT32)fread(&bufPtr[bufPos], smplSize, readSmpls, wItm->wi.hFile);
+		readSmpls = ReadFileAt(fd, &buffer[bufPos], (size_t)readSmpls * smplSize, fileOfs) / smplSize;
+		ReleaseFile(fileID);
 		if (readSmpls == 0)
 			break;
 		
-		bufPos += readSmpls * smplSize;
-		remSmpls -= readSmpls;
-		_smplOfs += readSmpls;
-		while(wItm != NULL && _smplOfs >= (wItm->startSmpl + wItm->smplCount))
+		bufPos += (size_t)readSmpls * smplSize;
+		remSmpls -= (size_t)readSmpls;
+		smplOfs += readSmpls;
+		while(wItm != NULL && smplOfs >= (wItm->startSmpl + wItm->smplCount))
+		{
+			fileID ++;
+			wItm = (fileID < _files.size()) ? &_files[fileID] : NULL;
+		}
+	}
+	
+	return smplCount - remSmpls;
+}
+
+size_t MultiWaveFile::ReadSamples(size_t bufSize, void* buffer)
+{
+	UINT64 readStart = _smplOfs;
+	size_t readSmpls = DoReadSamples(bufSize, buffer);
+	UpdateCacheHints(readStart);
+	return readSmpls;
+}
+
+size_t MultiWaveFile::DoReadSamples(size_t bufSize, void* buffer)
+{
+	size_t smplSize = GetSampleSize();
+	size_t smplCount = bufSize / smplSize;
+	size_t readSmpls;
+	
+	if (_ioMode == MWF_IO_DIRECT)
+	{
+		std::vector<SampleSpan> spans;
+		size_t curSpan;
+		UINT8* dstPtr = (UINT8*)buffer;
+		
+		readSmpls = ReadDirectSpans(smplCount, spans);
+		for (curSpan = 0; curSpan < spans.size(); curSpan ++)
+		{
+			memcpy(dstPtr, spans[curSpan].data, spans[curSpan].smplCount * smplSize);
+			dstPtr += spans[curSpan].smplCount * smplSize;
+		}
+		return readSmpls;
+	}
+	
+	if (_raEnable)
+	{
+		readSmpls = FetchReadAhead(smplCount);
+		if (readSmpls != (size_t)-1)
+		{
+			memcpy(buffer, _raBuf.data(), readSmpls * smplSize);
+			_smplOfs += readSmpls;
+			StartReadAhead(_smplOfs - readSmpls, smplCount);
+			return readSmpls;
+		}
+	}
+	else if (_urEnable)
+	{
+		const UINT8* data;
+		readSmpls = UringFetch(smplCount, data);
+		if (readSmpls != (size_t)-1)
+		{
+			memcpy(buffer, data, readSmpls * smplSize);
+			_smplOfs += readSmpls;
+			StartReadAhead(_smplOfs - readSmpls, smplCount);
+			return readSmpls;
+		}
+	}
+	
+	readSmpls = ReadFileSamples(_smplOfs, smplCount, (UINT8*)buffer, _smplOfsFile);
+	_smplOfs += readSmpls;
+	StartReadAhead(_smplOfs - readSmpls, smplCount);
+	return readSmpls;
+}
+
+size_t MultiWaveFile::ReadIntoBuffer(size_t smplCount, const UINT8*& data)
+{
+	size_t smplSize = GetSampleSize();
+	size_t readSmpls;
+	
+	if (_raEnable)
+	{
+		readSmpls = FetchReadAhead(smplCount);
+		if (readSmpls != (size_t)-1)
+		{
+			_dataBuf.swap(_raBuf);	// The I/O thread will fill the previous buffer next.
+			data = _dataBuf.data();
+			_smplOfs += readSmpls;
+			StartReadAhead(_smplOfs - readSmpls, smplCount);
+			return readSmpls;
+		}
+	}
+	else if (_urEnable)
+	{
+		// The data is returned directly from the ring buffer block. It stays valid until the next read.
+		readSmpls = UringFetch(smplCount, data);
+		if (readSmpls != (size_t)-1)
 		{
-			_smplOfsFile ++;
-			wItm = (_smplOfsFile < _files.size()) ? &_files[_smplOfsFile] : NULL;
+			_smplOfs += readSmpls;
+			StartReadAhead(_smplOfs - readSmpls, smplCount);
+			return readSmpls;
 		}
 	}
 	
-	return bufSize / smplSize - remSmpls;
+	if (_dataBuf.size() < smplCount * smplSize)
+		_dataBuf.resize(smplCount * smplSize);
+	readSmpls = ReadFileSamples(_smplOfs, smplCount, _dataBuf.data(), _smplOfsFile);
+	data = _dataBuf.data();
+	_smplOfs += readSmpls;
+	StartReadAhead(_smplOfs - readSmpls, smplCount);
+	return readSmpls;
+}
+
+void MultiWaveFile::StartReadAhead(UINT64 readStart, size_t smplCount)
+{
+	if (! _raEnable && ! _urEnable)
+		return;
+	
+	// Only read ahead when the caller reads sequentially, so that seeking doesn't cause useless reads.
+	bool seqRead = (readStart == _raLastEnd);
+	_raLastEnd = _smplOfs;
+	if (! seqRead || _smplOfs >= _totalSamples)
+		return;
+	
+	if (_urEnable)
+	{
+		// When the last block came from the ring, the pipeline is still running.
+		if (_urQueue.empty() && _urHeld == (size_t)-1)
+			UringStart(_smplOfs, smplCount);
+		return;
+	}
+	
+	if (! _raThread.joinable())
+		_raThread = std::thread(&MultiWaveFile::ReadAheadThread, this);
+	
+	std::lock_guard<std::mutex> lock(_raMutex);
+	_raBuf.resize(smplCount * GetSampleSize());
+	_raSmplOfs = _smplOfs;
+	_raSmplCount = smplCount;
+	_raState = RA_QUEUED;
+	_raCond.notify_all();
+	
+	return;
+}
+
+size_t MultiWaveFile::FetchReadAhead(size_t smplCount)
+{
+	std::unique_lock<std::mutex> lock(_raMutex);
+	bool stalled;
+	
+	if (_raState == RA_IDLE)
+		return (size_t)-1;
+	
+	// Always wait for the I/O thread to finish, as it owns the read-ahead buffer until then.
+	stalled = (_raState != RA_DONE);
+	if (stalled)
+	{
+		std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+		_raCond.wait(lock, [this]{ return _raState == RA_DONE; });
+		std::chrono::duration<double> waitTime = std::chrono::steady_clock::now() - waitStart;
+		_raStats.waitTime += waitTime.count();
+	}
+	_raState = RA_IDLE;
+	
+	// a smaller block (usually at the end of a section) can be served from the read-ahead buffer as well
+	if (_raSmplOfs != _smplOfs || _raSmplCount < smplCount)
+	{
+		_raStats.misses ++;
+		return (size_t)-1;
+	}
+	_raStats.blocks ++;
+	if (stalled)
+		_raStats.stalls ++;
+	return (_raReadSmpls < smplCount) ? _raReadSmpls : smplCount;
+}
+
+void MultiWaveFile::StopReadAhead(void)
+{
+	if (! _raThread.joinable())
+		return;
+	
+	{
+		std::lock_guard<std::mutex> lock(_raMutex);
+		_raExit = true;
+		_raCond.notify_all();
+	}
+	_raThread.join();
+	_raExit = false;
+	_raState = RA_IDLE;
+	
+	return;
+}
+
+void MultiWaveFile::ReadAheadThread(void)
+{
+	std::unique_lock<std::mutex> lock(_raMutex);
+	
+	while(true)
+	{
+		_raCond.wait(lock, [this]{ return _raExit || _raState == RA_QUEUED; });
+		if (_raExit)
+			break;
+		
+		_raState = RA_READING;
+		UINT64 smplOfs = _raSmplOfs;
+		size_t smplCount = _raSmplCount;
+		lock.unlock();
+		size_t readSmpls = ReadFileSamples(smplOfs, smplCount, _raBuf.data(), _raFileID);
+		lock.lock();
+		_raReadSmpls = readSmpls;
+		_raState = RA_DONE;
+		_raCond.notify_all();
+	}
+	
+	return;
+}
+
+void MultiWaveFile::UringStart(UINT64 smplOfs, size_t smplCount)
+{
+	size_t smplSize = GetSampleSize();
+	size_t blkBytes = smplCount * smplSize;
+	size_t blkCount;
+	size_t curBlk;
+	
+	UringDrain();
+	if (blkBytes == 0 || blkBytes > 0x7FFFFFFF)
+		return;
+	
+	blkCount = UR_AHEAD_SIZE / blkBytes;
+	if (blkCount < UR_MIN_BLOCKS)
+		blkCount = UR_MIN_BLOCKS;
+	else if (blkCount > UR_MAX_BLOCKS)
+		blkCount = UR_MAX_BLOCKS;
+	if (_urBlocks.size() != blkCount || _urBlocks[0].smplCount != smplCount)
+	{
+		std::vector<UINT8*> bufPtrs(blkCount);
+		
+		_uring.UnregisterBuffers();
+		_urBlocks.resize(blkCount);
+		for (curBlk = 0; curBlk < blkCount; curBlk ++)
+		{
+			UringBlock& blk = _urBlocks[curBlk];
+			blk.mem.resize(blkBytes + UR_BUF_ALIGN);
+			blk.data = (UINT8*)(((size_t)blk.mem.data() + UR_BUF_ALIGN - 1) & ~(size_t)(UR_BUF_ALIGN - 1));
+			blk.smplCount = smplCount;
+			bufPtrs[curBlk] = blk.data;
+		}
+		_urFixedBufs = ! _uring.RegisterBuffers(blkCount, bufPtrs.data(), blkBytes);
+	}
+	
+	for (curBlk = 0; curBlk < blkCount && smplOfs < _totalSamples; curBlk ++, smplOfs += smplCount)
+		UringQueueBlock(curBlk, smplOfs);
+	UringSubmit();
+	
+	return;
+}
+
+void MultiWaveFile::UringQueueBlock(size_t blockID, UINT64 smplOfs)
+{
+	UringBlock& blk = _urBlocks[blockID];
+	UINT64 smplCount = _totalSamples - smplOfs;
+	if (smplCount > blk.smplCount)
+		smplCount = blk.smplCount;
+	
+	blk.smplOfs = smplOfs;
+	blk.totalBytes = (size_t)smplCount * GetSampleSize();
+	blk.queuedBytes = 0;
+	blk.validBytes = blk.totalBytes;
+	blk.pending = 0;
+	_urQueue.push_back(blockID);
+	
+	return;
+}
+
+void MultiWaveFile::UringSubmit(void)
+{
+	size_t smplSize = GetSampleSize();
+	size_t qIdx;
+	
+	// split the blocks into pieces (at most 1 per ring entry) and queue them in file order
+	for (qIdx = 0; qIdx < _urQueue.size() && ! _urFreePieces.empty(); qIdx ++)
+	{
+		size_t blkID = _urQueue[qIdx];
+		UringBlock& blk = _urBlocks[blkID];
+		while(blk.queuedBytes < blk.totalBytes && ! _urFreePieces.empty())
+		{
+			UINT64 absOfs = blk.smplOfs * smplSize + blk.queuedBytes;
+			size_t fileID = GetFileFromSample(absOfs / smplSize);
+			int fd = (fileID != (size_t)-1) ? AcquireFile(fileID) : -1;	// The file stays pinned until the request completes.
+			if (fd == -1)
+			{
+				// unable to open the file - end the block here
+				blk.totalBytes = blk.validBytes = blk.queuedBytes;
+				break;
+			}
+			const WaveItem& wItm = _files[fileID];
+			UINT64 fileOfs = absOfs - wItm.startSmpl * smplSize;
+			UINT64 pieceSize = wItm.smplCount * smplSize - fileOfs;	// pieces must not cross file boundaries
+			if (pieceSize > blk.totalBytes - blk.queuedBytes)
+				pieceSize = blk.totalBytes - blk.queuedBytes;
+			if (pieceSize > UR_PIECE_SIZE)
+				pieceSize = UR_PIECE_SIZE;
+			
+			size_t pieceID = _urFreePieces.back();
+			if (! _uring.QueueRead(fd, blk.data + blk.queuedBytes, (UINT32)pieceSize,
+				wItm.wi.dataOfs + fileOfs, _urFixedBufs ? (int)blkID : -1, pieceID))
+			{
+				ReleaseFile(fileID);
+				break;
+			}
+			_urFreePieces.pop_back();
+			UringPiece& piece = _urPieces[pieceID];
+			piece.blockID = blkID;
+			piece.bufOfs = blk.queuedBytes;
+			piece.size = (UINT32)pieceSize;
+			piece.fileID = fileID;
+			blk.queuedBytes += (size_t)pieceSize;
+			blk.pending ++;
+			
+			if (_urInFlight == 0)
+				_urBusyStart = GetTimeSec();
+			_urInFlight ++;
+			_raStats.ioRequests ++;
+		}
+		if (blk.queuedBytes < blk.totalBytes)
+			break;	// keep the file order
+	}
+	if (_uring.Submit())
+	{
+		// The kernel didn't take (all of) the requests, so read the remaining ones synchronously.
+		UINT64 pieceID;
+		if (! _urSubmitWarned)
+			fprintf(stderr, "Warning: io_uring submission failed, using normal reads for the affected requests.\n");
+		_urSubmitWarned = true;
+		while(_uring.UnqueueRead(pieceID))
+			UringComplete((size_t)pieceID, UringReadPiece(_urPieces[(size_t)pieceID]));
+	}
+	
+	return;
+}
+
+// returns the number of completed requests
+size_t MultiWaveFile::UringReap(bool wait)
+{
+	UINT64 pieceID;
+	INT32 result;
+	size_t reapCnt = 0;
+	
+	// with wait == true, wait for at least one completion, then collect all that are available
+	while(_urInFlight > 0)
+	{
+		UINT8 retVal = wait ? _uring.WaitCompletion(pieceID, result) : _uring.PeekCompletion(pieceID, result);
+		if (retVal)
+			break;
+		wait = false;
+		
+		_raStats.ioDepthSum += _urInFlight;
+		if (result < 0)
+		{
+			// The request failed (e.g. -EAGAIN/-EINTR or an unsupported opcode), so retry it with a normal read.
+			fprintf(stderr, "Warning: io_uring read failed (%s), retrying with normal read.\n", strerror(-result));
+			result = UringReadPiece(_urPieces[(size_t)pieceID]);
+		}
+		UringComplete((size_t)pieceID, result);
+		reapCnt ++;
+	}
+	
+	return reapCnt;
+}
+
+// Read the data of a request with a normal read. The file is still pinned by the request.
+INT32 MultiWaveFile::UringReadPiece(const UringPiece& piece)
+{
+	const UringBlock& blk = _urBlocks[piece.blockID];
+	const WaveItem& wItm = _files[piece.fileID];
+	size_t smplSize = GetSampleSize();
+	UINT64 fileOfs = blk.smplOfs * smplSize + piece.bufOfs - wItm.startSmpl * smplSize;
+	
+	return (INT32)ReadFileAt(_fHandles[piece.fileID].fd, blk.data + piece.bufOfs, piece.size, wItm.wi.dataOfs + fileOfs);
+}
+
+// result = number of bytes read, negative on errors
+void MultiWaveFile::UringComplete(size_t pieceID, INT32 result)
+{
+	const UringPiece& piece = _urPieces[pieceID];
+	UringBlock& blk = _urBlocks[piece.blockID];
+	
+	if (result > 0)
+		_raStats.ioBytes += (UINT32)result;
+	if (result < (INT32)piece.size)
+	{
+		// short read (end of a truncated file): the data ends here
+		size_t validEnd = piece.bufOfs + ((result > 0) ? (size_t)result : 0);
+		if (blk.validBytes > validEnd)
+			blk.validBytes = validEnd;
+	}
+	blk.pending --;
+	ReleaseFile(piece.fileID);
+	_urFreePieces.push_back(pieceID);
+	_urInFlight --;
+	if (_urInFlight == 0)
+		_raStats.ioTime += GetTimeSec() - _urBusyStart;
+	
+	return;
+}
+
+size_t MultiWaveFile::UringFetch(size_t smplCount, const UINT8*& data)
+{
+	size_t smplSize = GetSampleSize();
+	bool stalled;
+	
+	// The caller is done with the previous block, so reuse it for the next one.
+	if (_urHeld != (size_t)-1)
+	{
+		if (! _urQueue.empty())
+		{
+			const UringBlock& lastBlk = _urBlocks[_urQueue.back()];
+			UINT64 nextOfs = lastBlk.smplOfs + lastBlk.smplCount;
+			if (nextOfs < _totalSamples)
+				UringQueueBlock(_urHeld, nextOfs);
+		}
+		_urHeld = (size_t)-1;
+	}
+	if (_urQueue.empty())
+		return (size_t)-1;
+	
+	UringBlock& blk = _urBlocks[_urQueue.front()];
+	// a smaller block (usually at the end of a section) can be served from the block as well
+	if (blk.smplOfs != _smplOfs || blk.smplCount < smplCount)
+	{
+		_raStats.misses ++;
+		UringDrain();
+		return (size_t)-1;
+	}
+	
+	UringReap(false);
+	UringSubmit();
+	stalled = (blk.pending > 0 || blk.queuedBytes < blk.totalBytes);
+	if (stalled)
+	{
+		double waitStart = GetTimeSec();
+		while(blk.pending > 0 || blk.queuedBytes < blk.totalBytes)
+		{
+			size_t queuedBytes = blk.queuedBytes;
+			size_t reapCnt = UringReap(true);
+			UringSubmit();
+			if (reapCnt == 0 && blk.queuedBytes == queuedBytes)
+				break;	// no progress (ring error)
+		}
+		if (blk.validBytes > blk.queuedBytes)
+			blk.validBytes = blk.queuedBytes;
+		_raStats.waitTime += GetTimeSec() - waitStart;
+		_raStats.stalls ++;
+	}
+	_raStats.blocks ++;
+	
+	_urHeld = _urQueue.front();
+	_urQueue.pop_front();
+	data = blk.data;
+	return (blk.validBytes / smplSize < smplCount) ? (blk.validBytes / smplSize) : smplCount;
+}
+
+void MultiWaveFile::UringDrain(void)
+{
+	// Wait for all requests, the buffers and file handles must not be reused while they are in flight.
+	while(_urInFlight > 0)
+	{
+		if (! UringReap(true))
+			break;	// ring error
+	}
+	_urQueue.clear();
+	_urHeld = (size_t)-1;
+	
+	return;
+}
+
+size_t MultiWaveFile::ReadSampleSpans(size_t smplCount, std::vector<SampleSpan>& spans)
+{
+	size_t smplSize = GetSampleSize();
+	size_t remSmpls = smplCount;
+	size_t bufPos = 0;
+	UINT64 readStart = _smplOfs;
+	SampleSpan span;
+	
+	spans.clear();
+	if (_ioMode == MWF_IO_DIRECT)
+		return ReadDirectSpans(smplCount, spans);
+	if (_ioMode != MWF_IO_MMAP)
+	{
+		span.smplCount = ReadIntoBuffer(smplCount, span.data);
+		if (span.smplCount > 0)
+			spans.push_back(span);
+		UpdateCacheHints(readStart);
+		return span.smplCount;
+	}
+	
+	while(remSmpls > 0)
+	{
+		WaveItem* wItm = (_smplOfsFile < _files.size()) ? &_files[_smplOfsFile] : NULL;
+		if (wItm == NULL || _smplOfs < wItm->startSmpl || _smplOfs >= (wItm->startSmpl + wItm->smplCount))
+		{
+			_smplOfsFile = GetFileFromSample(_smplOfs);
+			if (_smplOfsFile == (size_t)-1)
+				break;
+			wItm = &_files[_smplOfsFile];
+		}
+		
+		if (! wItm->mapTried)
+		{
+			int fd = AcquireFile(_smplOfsFile);
+			UINT8 retVal = (fd != -1) ? MapWaveData(*wItm, fd, smplSize) : 0xFF;
+			if (fd != -1)
+				ReleaseFile(_smplOfsFile);	// the mapping stays valid after closing the file
+			wItm->mapTried = true;
+			if (retVal & 0x80)
+				fprintf(stderr, "Warning: Unable to memory-map %s, reading it instead.\n", GetFileTitle(wItm->fileName).c_str());
+		}
+		
+		UINT64 fileSmpl = _smplOfs - wItm->startSmpl;
+		UINT64 availSmpls = wItm->smplCount - fileSmpl;
+		if (availSmpls > remSmpls)
+			availSmpls = remSmpls;
+		if (wItm->mapData != NULL)
+		{
+			UINT64 mapSmpls = (wItm->mapSize - (size_t)(wItm->mapData - (const UINT8*)wItm->mapBase)) / smplSize;
+			if (fileSmpl >= mapSmpls)
+				break;	// reached the end of a truncated file
+			if (availSmpls > mapSmpls - fileSmpl)
+				availSmpls = mapSmpls - fileSmpl;
+			span.data = &wItm->mapData[fileSmpl * smplSize];
+			span.smplCount = (size_t)availSmpls;
+			_smplOfs += span.smplCount;
+		}
+		else
+		{
+			// This fragment couldn't be mapped, so read it into the buffer.
+			// The buffer is sized for the whole request at once, so that earlier spans stay valid.
+			if (bufPos == 0 && _dataBuf.size() < smplCount * smplSize)
+				_dataBuf.resize(smplCount * smplSize);
+			span.data = &_dataBuf[bufPos];
+			span.smplCount = DoReadSamples((size_t)availSmpls * smplSize, &_dataBuf[bufPos]);
+			if (span.smplCount == 0)
+				break;
+			bufPos += span.smplCount * smplSize;
+		}
+		spans.push_back(span);
+		remSmpls -= span.smplCount;
+		if (span.smplCount < availSmpls)
+			break;
+	}
+	UpdateCacheHints(readStart);
+	
+	return smplCount - remSmpls;
+}
+
+size_t MultiWaveFile::ReadBlock(size_t smplCount, SampleBlock& block, UINT8 type)
+{
+	size_t readSmpls;
+	size_t blkPos;
+	size_t curSpan;
+	
+	block.Setup(type, _channels, smplCount);
+	readSmpls = ReadSampleSpans(smplCount, _blkSpans);
+	blkPos = 0;
+	for (curSpan = 0; curSpan < _blkSpans.size(); curSpan ++)
+	{
+		DecodeSamples(_blkSpans[curSpan].data, _blkSpans[curSpan].smplCount, _smplFormat, block, blkPos);
+		blkPos += _blkSpans[curSpan].smplCount;
+	}
+	block.SetSampleCount(readSmpls);
+	
+	return readSmpls;
+}
+
+size_t MultiWaveFile::ReadDirectSpans(size_t smplCount, std::vector<SampleSpan>& spans)
+{
+	size_t smplSize = GetSampleSize();
+	UINT64 startSmpl = _smplOfs;
+	UINT64 endSmpl = (_smplOfs + smplCount < _totalSamples) ? (_smplOfs + smplCount) : _totalSamples;
+	UINT64 smplPos;
+	size_t bufSize;
+	size_t fileID;
+	UINT8* bufPtr;
+	SampleSpan span;
+	
+	// Direct I/O needs aligned offsets, sizes and buffers, so each fragment gets its own aligned part of the buffer.
+	// The spans then point to the requested samples inside these parts. (no copying)
+	spans.clear();
+	bufSize = 0;
+	fileID = GetFileFromSample(_smplOfs);
+	for (smplPos = _smplOfs; fileID < _files.size() && smplPos < endSmpl; fileID ++)
+	{
+		const WaveItem& wItm = _files[fileID];
+		UINT64 pieceEnd = wItm.startSmpl + wItm.smplCount;
+		if (pieceEnd > endSmpl)
+			pieceEnd = endSmpl;
+		UINT64 fileOfs = wItm.wi.dataOfs + (smplPos - wItm.startSmpl) * smplSize;
+		UINT64 alignStart = fileOfs & ~(UINT64)(DIO_ALIGN - 1);
+		UINT64 alignEnd = (fileOfs + (pieceEnd - smplPos) * smplSize + DIO_ALIGN - 1) & ~(UINT64)(DIO_ALIGN - 1);
+		bufSize += (size_t)(alignEnd - alignStart);
+		smplPos = pieceEnd;
+	}
+	if (_dioBuf.size() < bufSize + DIO_ALIGN)
+		_dioBuf.resize(bufSize + DIO_ALIGN);
+	bufPtr = (UINT8*)(((size_t)_dioBuf.data() + DIO_ALIGN - 1) & ~(size_t)(DIO_ALIGN - 1));
+	
+	fileID = GetFileFromSample(_smplOfs);
+	while(fileID < _files.size() && _smplOfs < endSmpl)
+	{
+		const WaveItem& wItm = _files[fileID];
+		UINT64 pieceEnd = wItm.startSmpl + wItm.smplCount;
+		if (pieceEnd > endSmpl)
+			pieceEnd = endSmpl;
+		UINT64 fileOfs = wItm.wi.dataOfs + (_smplOfs - wItm.startSmpl) * smplSize;
+		UINT64 alignStart = fileOfs & ~(UINT64)(DIO_ALIGN - 1);
+		UINT64 alignEnd = (fileOfs + (pieceEnd - _smplOfs) * smplSize + DIO_ALIGN - 1) & ~(UINT64)(DIO_ALIGN - 1);
+		size_t headSkip = (size_t)(fileOfs - alignStart);
+		size_t readBytes;
+		
+		int fd = AcquireFile(fileID);
+		if (fd == -1)
+			break;
+		// may be short at the end of the file, as alignEnd can be beyond it
+		readBytes = ReadFileAt(fd, bufPtr, (size_t)(alignEnd - alignStart), alignStart);
+		ReleaseFile(fileID);
+		
+		span.data = bufPtr + headSkip;
+		span.smplCount = (readBytes > headSkip) ? (readBytes - headSkip) / smplSize : 0;
+		if (span.smplCount > pieceEnd - _smplOfs)
+			span.smplCount = (size_t)(pieceEnd - _smplOfs);
+		if (span.smplCount == 0)
+			break;
+		spans.push_back(span);
+		_smplOfs += span.smplCount;
+		if (_smplOfs < pieceEnd)
+			break;	// truncated file
+		bufPtr += (size_t)(alignEnd - alignStart);
+		fileID ++;
+	}
+	
+	return (size_t)(_smplOfs - startSmpl);
+}
+
+void MultiWaveFile::KeepCacheRange(UINT64 smplStart, UINT64 smplEnd)
+{
+	CacheRange cr = {smplStart, smplEnd};
+	std::vector<CacheRange>::iterator crIt = std::upper_bound(_cacheKeep.begin(), _cacheKeep.end(), smplStart,
+		[](UINT64 smpl, const CacheRange& range) { return smpl < range.smplStart; });
+	_cacheKeep.insert(crIt, cr);
+	
+	return;
+}
+
+void MultiWaveFile::SetCacheDropLimit(UINT64 smplPos)
+{
+	_cacheDropLimit = smplPos;
+}
+
+void MultiWaveFile::ReleaseCacheRanges(void)
+{
+	size_t curRange;
+	
+	if (_cacheMode != MWF_CACHE_NORMAL)
+	{
+		// The surrounding data was dropped already, so extend the ranges to catch large folios at the edges.
+		UINT64 overlap = CACHE_DROP_OVERLAP / GetSampleSize();
+		for (curRange = 0; curRange < _cacheKeep.size(); curRange ++)
+		{
+			const CacheRange& cr = _cacheKeep[curRange];
+			AdviseSamples((cr.smplStart > overlap) ? (cr.smplStart - overlap) : 0, cr.smplEnd + overlap, CACHE_ADV_DROP);
+		}
+	}
+	_cacheKeep.clear();
+	
+	return;
+}
+
+void MultiWaveFile::UpdateCacheHints(UINT64 readStart)
+{
+	UINT64 stepSmpls;
+	
+	if (_cacheMode == MWF_CACHE_NORMAL)
+		return;
+	
+	if (readStart != _cacheLastEnd)
+	{
+		// The caller seeked: drop the rest of the previous range and don't read ahead for random accesses.
+		FlushCacheDrop(_cacheLastEnd);
+		_cacheDropPos = readStart;
+		_cacheAdvEnd = _smplOfs;
+		_cacheLastEnd = _smplOfs;
+		return;
+	}
+	_cacheLastEnd = _smplOfs;
+	
+	stepSmpls = CACHE_STEP_SIZE / GetSampleSize();
+	if (_smplOfs + stepSmpls > _cacheAdvEnd && _smplOfs < _totalSamples)
+	{
+		UINT64 advStart = (_cacheAdvEnd > _smplOfs) ? _cacheAdvEnd : _smplOfs;
+		UINT64 advEnd = _smplOfs + stepSmpls * 2;
+		if (advEnd > _totalSamples)
+			advEnd = _totalSamples;
+		AdviseSamples(advStart, advEnd, CACHE_ADV_READ);
+		_cacheAdvEnd = advEnd;
+	}
+	
+	// The caller is done with everything before the current read.
+	if (readStart >= _cacheDropPos + stepSmpls)
+		FlushCacheDrop(readStart);
+	
+	return;
+}
+
+void MultiWaveFile::FlushCacheDrop(UINT64 dropEnd)
+{
+	if (_cacheMode == MWF_CACHE_BOUNDS && dropEnd > _cacheDropLimit)
+		dropEnd = _cacheDropLimit;
+	if (dropEnd <= _cacheDropPos)
+		return;
+	
+	// The kernel only drops folios that are completely inside the range.
+	UINT64 overlap = CACHE_DROP_OVERLAP / GetSampleSize();
+	DropCacheSamples((_cacheDropPos > overlap) ? (_cacheDropPos - overlap) : 0, dropEnd);
+	_cacheDropPos = dropEnd;
+	
+	return;
+}
+
+void MultiWaveFile::DropCacheSamples(UINT64 smplStart, UINT64 smplEnd)
+{
+	size_t curRange;
+	
+	// skip the ranges that the caller wants to keep
+	for (curRange = 0; curRange < _cacheKeep.size(); curRange ++)
+	{
+		const CacheRange& cr = _cacheKeep[curRange];
+		if (cr.smplStart >= smplEnd)
+			break;
+		if (cr.smplEnd <= smplStart)
+			continue;
+		if (cr.smplStart > smplStart)
+			AdviseSamples(smplStart, cr.smplStart, CACHE_ADV_DROP);
+		smplStart = cr.smplEnd;
+		if (smplStart >= smplEnd)
+			return;
+	}
+	AdviseSamples(smplStart, smplEnd, CACHE_ADV_DROP);
+	
+	return;
+}
+
+void MultiWaveFile::AdviseSamples(UINT64 smplStart, UINT64 smplEnd, UINT8 advice)
+{
+#ifndef _WIN32
+	size_t smplSize = GetSampleSize();
+	size_t fileID = GetFileFromSample(smplStart);
+	
+	while(fileID < _files.size() && smplStart < smplEnd)
+	{
+		const WaveItem& wItm = _files[fileID];
+		UINT64 fileEnd = wItm.startSmpl + wItm.smplCount;
+		UINT64 rangeEnd = (smplEnd < fileEnd) ? smplEnd : fileEnd;
+		UINT64 rangeOfs = wItm.wi.dataOfs + (smplStart - wItm.startSmpl) * smplSize;
+		UINT64 rangeLen = (rangeEnd - smplStart) * smplSize;
+		
+		if (advice == CACHE_ADV_DROP && wItm.mapData != NULL)
+		{
+			// Pages that are still mapped can't be dropped from the cache, so unmap them first.
+			// (They are read from the file again when accessed later.)
+			UINT64 pageMask = (UINT64)sysconf(_SC_PAGESIZE) - 1;
+			UINT64 mapOfs = wItm.wi.dataOfs - (size_t)(wItm.mapData - (const UINT8*)wItm.mapBase);
+			UINT64 mStart = (rangeOfs - mapOfs + pageMask) & ~pageMask;
+			UINT64 mEnd = (rangeOfs + rangeLen - mapOfs) & ~pageMask;
+			if (mEnd > wItm.mapSize)
+				mEnd = wItm.mapSize & ~pageMask;
+			if (mEnd > mStart)
+				madvise((UINT8*)wItm.mapBase + mStart, (size_t)(mEnd - mStart), MADV_DONTNEED);
+		}
+		// Only use files that are open already. Opening one just for a hint could close a file that is in use.
+		int fd;
+		{
+			std::lock_guard<std::mutex> lock(_fhMutex);
+			fd = _fHandles[fileID].fd;
+			if (fd != -1)
+				_fHandles[fileID].refCnt ++;	// keep it open until the hint is sent
+		}
+		if (fd != -1)
+		{
+			if (advice == CACHE_ADV_READ)
+			{
+				posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);	// increases the kernel's read-ahead window
+				posix_fadvise(fd, (off_t)rangeOfs, (off_t)rangeLen, POSIX_FADV_WILLNEED);
+			}
+			else if (advice == CACHE_ADV_RANDOM)
+			{
+				posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+			}
+			else
+			{
+				posix_fadvise(fd, (off_t)rangeOfs, (off_t)rangeLen, POSIX_FADV_DONTNEED);
+			}
+			ReleaseFile(fileID);
+		}
+		smplStart = rangeEnd;
+		fileID ++;
+	}
+#endif
+	
+	return;
+}
+
+// RIFF/RF64/BW64 chunk list
+// returns flags: 0x01 = found format, 0x02 = found data, 0x80 = error reading format
+static UINT8 ReadRiffChunks(int fd, WaveInfo& wi, UINT64& dataSize)
+{
+	UINT8 chnkHdr[0x08];
+	UINT32 chnkSize;
+	UINT64 ds64DataSize;
+	UINT64 filePos;
+	UINT8 found;
+	
+	found = 0x00;
+	ds64DataSize = (UINT64)-1;
+	filePos = 0x0C;
+	while(true)
+	{
+		if (ReadFileAt(fd, chnkHdr, 0x08, filePos) < 0x08)
+			break;
+		memcpy(&chnkSize, &chnkHdr[0x04], 0x04);
+		filePos += 0x08;
+		if (! memcmp(&chnkHdr[0x00], "data", 4))
+		{
+			found |= 0x02;
+			wi.dataOfs = filePos;
+			// RF64/BW64 set the size to -1 and store the actual size in the 'ds64' chunk
+			dataSize = (chnkSize == 0xFFFFFFFF && ds64DataSize != (UINT64)-1) ? ds64DataSize : chnkSize;
+			break;
+		}
+		else if (! memcmp(&chnkHdr[0x00], "fmt ", 4))
+		{
+			found |= 0x01;
+			if (ReadFileAt(fd, &wi.format, sizeof(WAVEFORMAT), filePos) < sizeof(WAVEFORMAT))
+				return found | 0x80;
+			ReadExtensibleFormat(fd, wi, filePos, chnkSize);
+		}
+		else if (! memcmp(&chnkHdr[0x00], "ds64", 4))
+		{
+			// ds64 chunk: RIFF size (64 bit), data size (64 bit), sample count (64 bit), table
+			UINT8 ds64Data[0x10];
+			if (ReadFileAt(fd, ds64Data, 0x10, filePos) == 0x10)
+				memcpy(&ds64DataSize, &ds64Data[0x08], 0x08);
+		}
+		filePos += chnkSize;
+	}
+	
+	return found;
+}
+
+// Sony Wave64 chunk list
+// Chunks use GUIDs as IDs, 64-bit sizes that include the chunk header and are 8-byte aligned.
+static UINT8 ReadWave64Chunks(int fd, WaveInfo& wi, UINT64& dataSize)
+{
+	UINT8 chnkHdr[0x18];
+	UINT64 chnkSize;
+	UINT64 filePos;
+	UINT8 found;
+	
+	found = 0x00;
+	filePos = 0x28;
+	while(true)
+	{
+		if (ReadFileAt(fd, chnkHdr, 0x18, filePos) < 0x18)
+			break;
+		memcpy(&chnkSize, &chnkHdr[0x10], 0x08);
+		if (chnkSize < 0x18)
+			break;	// invalid chunk size
+		if (! memcmp(&chnkHdr[0x00], W64_GUID_DATA, 0x10))
+		{
+			found |= 0x02;
+			wi.dataOfs = filePos + 0x18;
+			dataSize = chnkSize - 0x18;
+			break;
+		}
+		else if (! memcmp(&chnkHdr[0x00], W64_GUID_FMT, 0x10))
+		{
+			found |= 0x01;
+			if (ReadFileAt(fd, &wi.format, sizeof(WAVEFORMAT), filePos + 0x18) < sizeof(WAVEFORMAT))
+				return found | 0x80;
+			ReadExtensibleFormat(fd, wi, filePos + 0x18, chnkSize - 0x18);
+		}
+		filePos += (chnkSize + 0x07) & ~(UINT64)0x07;
+	}
+	
+	return found;
+}
+
+// WAVEFORMATEXTENSIBLE: replace the format tag with the one from the sub-format GUID
+// (KSDATAFORMAT_SUBTYPE_PCM/IEEE_FLOAT etc. all are {tag}-0000-0010-8000-00AA00389B71)
+static void ReadExtensibleFormat(int fd, WaveInfo& wi, UINT64 fmtPos, UINT64 fmtSize)
+{
+	static const UINT8 GUID_BASE[0x0C] = {0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+	UINT8 subFmt[0x10];
+	UINT32 fmtTag;
+	
+	if (wi.format.wFormatTag != WAVE_FORMAT_EXTENSIBLE || fmtSize < 0x28)
+		return;
+	// WAVEFORMATEX (0x12 bytes) + valid bits (2) + channel mask (4) + sub-format GUID (0x10)
+	if (ReadFileAt(fd, subFmt, 0x10, fmtPos + 0x18) < 0x10)
+		return;
+	if (memcmp(&subFmt[0x04], GUID_BASE, 0x0C))
+		return;	// unknown sub-format, keep WAVE_FORMAT_EXTENSIBLE so that it is rejected
+	memcpy(&fmtTag, &subFmt[0x00], 0x04);
+	if (fmtTag <= 0xFFFF)
+		wi.format.wFormatTag = (UINT16)fmtTag;
+	
+	return;
+}
+
+static UINT8 SampleFormatFromWave(UINT16 compression, UINT8 bits)
+{
+	if (compression == WAVE_FORMAT_PCM)
+	{
+		switch(bits)
+		{
+		case 8:
+			return SFMT_U8;
+		case 16:
+			return SFMT_S16;
+		case 24:
+			return SFMT_S24;
+		case 32:
+			return SFMT_S32;
+		}
+	}
+	else if (compression == WAVE_FORMAT_IEEE_FLOAT)
+	{
+		switch(bits)
+		{
+		case 32:
+			return SFMT_F32;
+		case 64:
+			return SFMT_F64;
+		}
+	}
+	return SFMT_NONE;
+}
+
+// checks the values that the sample size and count are calculated from
+static bool IsValidFormat(const WAVEFORMAT& wf)
+{
+	return (wf.nChannels != 0 && wf.wBitsPerSample != 0 && wf.nBlockAlign != 0 && wf.nSamplesPerSec != 0);
+}
+
+static int OpenFileRO(const std::string& fileName)
+{
+#ifdef _WIN32
+	return _open(fileName.c_str(), _O_RDONLY | _O_BINARY);
+#else
+	return open(fileName.c_str(), O_RDONLY);
+#endif
+}
+
+static UINT8 SetDirectIO(int fd, bool enable)
+{
+#if defined(_WIN32)
+	return 0xFF;	// would require CreateFile() with FILE_FLAG_NO_BUFFERING
+#elif defined(O_DIRECT)
+	int flags = fcntl(fd, F_GETFL);
+	if (flags == -1)
+		return 0xFF;
+	flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+	return (fcntl(fd, F_SETFL, flags) == -1) ? 0xFF : 0x00;
+#elif defined(F_NOCACHE)
+	return (fcntl(fd, F_NOCACHE, enable ? 1 : 0) == -1) ? 0xFF : 0x00;	// macOS
+#else
+	return 0xFF;
+#endif
+}
+
+static void CloseFile(int fd)
+{
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+	return;
+}
+
+// Read data from an absolute file offset without changing any shared file position.
+// Returns the number of bytes read. (may be less than "size" at the end of the file or on errors)
+static size_t ReadFileAt(int fd, void* buffer, size_t size, UINT64 offset)
+{
+	UINT8* bufPtr = (UINT8*)buffer;
+	size_t bufPos = 0;
+	
+	while(bufPos < size)
+	{
+#ifdef _WIN32
+		OVERLAPPED ovl;
+		DWORD readBytes;
+		DWORD reqBytes = (size - bufPos > 0x40000000) ? 0x40000000 : (DWORD)(size - bufPos);
+		
+		memset(&ovl, 0x00, sizeof(OVERLAPPED));
+		ovl.Offset = (DWORD)offset;
+		ovl.OffsetHigh = (DWORD)(offset >> 32);
+		if (! ReadFile((HANDLE)_get_osfhandle(fd), &bufPtr[bufPos], reqBytes, &readBytes, &ovl))
+			break;
+#else
+		ssize_t readBytes = pread(fd, &bufPtr[bufPos], size - bufPos, (off_t)offset);
+		if (readBytes < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+#endif
+		if (readBytes == 0)
+			break;	// end of file
+		bufPos += (size_t)readBytes;
+		offset += (UINT64)readBytes;
+	}
+	
+	return bufPos;
+}
+
+static UINT64 GetFileSize(int fd)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_fstat64(fd, &st))
+		return 0;
+#else
+	struct stat st;
+	if (fstat(fd, &st))
+		return 0;
+#endif
+	return (UINT64)st.st_size;
+}
+
+INLINE double GetTimeSec(void)
+{
+	std::chrono::duration<double> time = std::chrono::steady_clock::now().time_since_epoch();
+	return time.count();
+}
+
+static UINT8 GetFileStat(const std::string& fileName, UINT64& size, INT64& mtime)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(fileName.c_str(), &st) != 0)
+		return 0xFF;
+	size = (UINT64)st.st_size;
+	mtime = (INT64)st.st_mtime * 1000000000;
+#else
+	struct stat st;
+	if (stat(fileName.c_str(), &st) != 0)
+		return 0xFF;
+	size = (UINT64)st.st_size;
+#if defined(__APPLE__)
+	mtime = (INT64)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	mtime = (INT64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+	return 0x00;
+}
+
+static std::string GetAbsolutePath(const std::string& fileName)
+{
+#ifdef _WIN32
+	char* absPath = _fullpath(NULL, fileName.c_str(), 0);
+	if (absPath == NULL)
+		return std::string();
+	std::string result(absPath);
+	free(absPath);
+	return result;
+#else
+	if (! fileName.empty() && fileName[0] == '/')
+		return fileName;
+	std::vector<char> cwd(0x400);
+	while(getcwd(cwd.data(), cwd.size()) == NULL)
+	{
+		if (errno != ERANGE)
+			return std::string();
+		cwd.resize(cwd.size() * 2);
+	}
+	return std::string(cwd.data()) + "/" + fileName;
+#endif
+}
+
+static void ProbeWaveFile(const std::string& fileName, const MetaCache* cache, ProbeItem& pi, WaveInfo& wi)
+{
+	pi.cacheHit = false;
+	if (cache != NULL && ! GetFileStat(fileName, pi.mce.fileSize, pi.mce.mtime))
+	{
+		pi.path = GetAbsolutePath(fileName);
+		MetaCache::const_iterator mcIt = cache->find(pi.path);
+		if (mcIt != cache->end() && mcIt->second.fileSize == pi.mce.fileSize && mcIt->second.mtime == pi.mce.mtime)
+		{
+			// file is unchanged - no need to open it now
+			wi = mcIt->second.wi;
+			wi.fd = -1;
+			pi.cacheHit = true;
+			pi.retVal = 0x00;
+			return;
+		}
+	}
+	
+	pi.retVal = MultiWaveFile::LoadSingleWave(fileName, wi);
+	pi.mce.wi = wi;
+	return;
+}
+
+static UINT8 LoadMetaCache(const std::string& fileName, MetaCache& cache)
+{
+	FILE* hFile;
+	std::vector<char> line(0x1000);
+	
+	cache.clear();
+	hFile = fopen(fileName.c_str(), "rt");
+	if (hFile == NULL)
+		return 0xFF;	// no cache yet
+	
+	if (fgets(line.data(), (int)line.size(), hFile) == NULL || strncmp(line.data(), META_CACHE_SIG, strlen(META_CACHE_SIG)))
+	{
+		fclose(hFile);
+		return 0x80;	// unknown format, will be overwritten
+	}
+	while(fgets(line.data(), (int)line.size(), hFile) != NULL)
+	{
+		MetaCacheEntry mce;
+		WAVEFORMAT& wf = mce.wi.format;
+		unsigned long long fileSize, dataOfs, smplCount;
+		long long mtime;
+		unsigned int fmtTag, chnCnt, smplRate, byteRate, blkAlign, bits;
+		int pathPos = -1;
+		int itemCnt;
+		
+		itemCnt = sscanf(line.data(), "%llu\t%lld\t%u\t%u\t%u\t%u\t%u\t%u\t%llu\t%llu\t%n",
+			&fileSize, &mtime, &fmtTag, &chnCnt, &smplRate, &byteRate, &blkAlign, &bits, &dataOfs, &smplCount, &pathPos);
+		if (itemCnt != 10 || pathPos < 0)
+			continue;	// invalid line
+		if (chnCnt > 0xFFFF || blkAlign > 0xFFFF || bits > 0xFFFF)
+			continue;
+		std::string path(&line[pathPos]);
+		while(! path.empty() && iscntrl((UINT8)path.back()))
+			path.pop_back();
+		
+		memset(&mce, 0x00, sizeof(MetaCacheEntry));
+		mce.fileSize = fileSize;
+		mce.mtime = mtime;
+		wf.wFormatTag = (UINT16)fmtTag;
+		wf.nChannels = (UINT16)chnCnt;
+		wf.nSamplesPerSec = smplRate;
+		wf.nAvgBytesPerSec = byteRate;
+		wf.nBlockAlign = (UINT16)blkAlign;
+		wf.wBitsPerSample = (UINT16)bits;
+		mce.wi.fd = -1;
+		mce.wi.dataOfs = dataOfs;
+		mce.wi.smplCount = smplCount;
+		if (! IsValidFormat(wf))
+			continue;	// would be rejected when reading the file, so the entry must be damaged
+		cache[path] = mce;
+	}
+	
+	fclose(hFile);
+	return 0x00;
+}
+
+static UINT8 SaveMetaCache(const std::string& fileName, const MetaCache& cache)
+{
+	static std::atomic<unsigned int> tempCounter(0);
+	char tempSuffix[0x20];
+	std::string tempName;
+	FILE* hFile;
+	MetaCache::const_iterator mcIt;
+	
+	// write to a temporary file first, so that concurrent runs never see a partial cache
+	// (The name is unique per process and call, so that concurrent runs don't write into the same file.)
+#ifdef _WIN32
+	snprintf(tempSuffix, sizeof(tempSuffix), ".tmp%d_%u", _getpid(), tempCounter ++);
+#else
+	snprintf(tempSuffix, sizeof(tempSuffix), ".tmp%ld_%u", (long)getpid(), tempCounter ++);
+#endif
+	tempName = fileName + tempSuffix;
+	hFile = fopen(tempName.c_str(), "wt");
+	if (hFile == NULL)
+		return 0xFF;
+	
+	fprintf(hFile, "%s\n", META_CACHE_SIG);
+	for (mcIt = cache.begin(); mcIt != cache.end(); ++mcIt)
+	{
+		const MetaCacheEntry& mce = mcIt->second;
+		const WAVEFORMAT& wf = mce.wi.format;
+		fprintf(hFile, "%llu\t%lld\t%u\t%u\t%u\t%u\t%u\t%u\t%llu\t%llu\t%s\n",
+			(unsigned long long)mce.fileSize, (long long)mce.mtime,
+			wf.wFormatTag, wf.nChannels, wf.nSamplesPerSec, wf.nAvgBytesPerSec, wf.nBlockAlign, wf.wBitsPerSample,
+			(unsigned long long)mce.wi.dataOfs, (unsigned long long)mce.wi.smplCount, mcIt->first.c_str());
+	}
+	if (fclose(hFile))
+	{
+		remove(tempName.c_str());
+		return 0xFE;
+	}
+#ifdef _WIN32
+	remove(fileName.c_str());	// rename() doesn't replace existing files on Windows
+#endif
+	if (rename(tempName.c_str(), fileName.c_str()))
+	{
+		remove(tempName.c_str());
+		return 0xFD;
+	}
+	
+	return 0x00;
 }
 
 static std::string GetTimeStrHMS(UINT32 smplRate, UINT64 smplPos)
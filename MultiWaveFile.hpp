@@ -4,9 +4,14 @@
 #define __MULTIWAVEFILE_HPP__
 
 #include <vector>
+#include <deque>
 #include <string>
-#include <stdio.h>	// for FILE
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "stdtype.h"
+#include "IoUring.hpp"
+#include "SampleBlock.hpp"
 
 #pragma pack(1)
 typedef struct
@@ -23,13 +28,25 @@ typedef struct
 
 #define WAVE_FORMAT_PCM			0x0001
 #define WAVE_FORMAT_IEEE_FLOAT	0x0003
+#define WAVE_FORMAT_EXTENSIBLE	0xFFFE	// replaced with the sub-format tag when loading
+
+// I/O modes
+#define MWF_IO_READ		0x00	// read samples into a buffer
+#define MWF_IO_MMAP		0x01	// memory-map the data chunks, sample spans point directly into the mapping
+#define MWF_IO_URING	0x02	// read samples using a queue of asynchronous io_uring requests (Linux only)
+#define MWF_IO_DIRECT	0x03	// read samples with O_DIRECT into page-aligned buffers, bypassing the page cache (POSIX only)
+
+// page cache modes
+#define MWF_CACHE_NORMAL	0x00	// no access pattern hints
+#define MWF_CACHE_STREAM	0x01	// sequential access: read ahead of the cursor, drop the data behind it from the cache
+#define MWF_CACHE_BOUNDS	0x02	// like STREAM, but keep the ranges selected by the caller and drop only up to a caller-defined limit
 
 struct WaveInfo
 {
-	FILE* hFile;
+	int fd;	// file descriptor, -1 = not open
 	WAVEFORMAT format;
-	UINT32 dataOfs;
-	UINT32 smplCount;
+	UINT64 dataOfs;
+	UINT64 smplCount;
 };
 
 struct WaveItem
@@ -38,6 +55,62 @@ struct WaveItem
 	UINT64 startSmpl;
 	UINT64 smplCount;
 	WaveInfo wi;
+	bool mapTried;	// memory mapping is done on first access
+	void* mapBase;	// base pointer of the memory mapping (NULL = not mapped)
+	size_t mapSize;
+	const UINT8* mapData;	// pointer to the beginning of the data chunk
+};
+
+struct FileHandle
+{
+	int fd;	// -1 = closed
+	UINT32 refCnt;	// number of reads in progress
+	UINT64 lastUse;	// for closing the least recently used file
+};
+
+struct SampleSpan
+{
+	const UINT8* data;
+	size_t smplCount;
+};
+
+struct ReadAheadStats
+{
+	UINT64 blocks;	// number of blocks that were served from the read-ahead buffer
+	UINT64 stalls;	// number of blocks where the caller had to wait for the I/O thread
+	UINT64 misses;	// number of read-ahead blocks that were discarded (caller seeked or increased the block size)
+	double waitTime;	// total time spent waiting for the I/O thread (in seconds)
+	// io_uring only
+	UINT64 ioRequests;	// number of read requests
+	UINT64 ioBytes;	// number of bytes read
+	UINT64 ioDepthSum;	// sum of the queue depth at each completion
+	double ioTime;	// total time with read requests in flight (in seconds)
+};
+
+struct CacheRange
+{
+	UINT64 smplStart;
+	UINT64 smplEnd;
+};
+
+struct UringBlock
+{
+	std::vector<UINT8> mem;
+	UINT8* data;	// page-aligned pointer into mem
+	UINT64 smplOfs;
+	size_t smplCount;	// block size in samples
+	size_t totalBytes;	// number of bytes to read (smaller at the end of the last file)
+	size_t queuedBytes;	// number of bytes submitted to the ring
+	size_t validBytes;	// end of valid data (reduced by short reads)
+	UINT32 pending;	// number of read requests in flight
+};
+
+struct UringPiece
+{
+	size_t blockID;
+	size_t bufOfs;
+	UINT32 size;
+	size_t fileID;
 };
 
 class MultiWaveFile
@@ -47,35 +120,144 @@ public:
 	~MultiWaveFile();
 	static UINT8 LoadSingleWave(const std::string& fileName, WaveInfo& wi);
 	UINT8 LoadWaveFiles(const std::vector<std::string>& fileList);
+	// Opens the files of another instance with its I/O settings, without reading the headers again.
+	// (for reading the same recording in another thread)
+	UINT8 LoadWaveFiles(const MultiWaveFile& src);
 	void CloseFiles(void);
 	
+	void SetIOMode(UINT8 ioMode);	// must be called before LoadWaveFiles()
+	UINT8 GetIOMode(void) const;
+	// Files are opened on demand. When more than this number of files is open, the least recently used one is closed.
+	void SetMaxOpenFiles(size_t maxFiles);
+	size_t GetMaxOpenFiles(void) const;
+	// Header information is cached in this file (path, size, time stamp, format, data offset, sample count).
+	// Unchanged files are then loaded without opening them. (empty = no cache)
+	void SetMetaCache(const std::string& fileName);	// must be called before LoadWaveFiles()
+	// When enabled, an I/O thread reads the next block while the caller processes the current one.
+	// This works for sequential reads with a constant block size. (MWF_IO_READ only, MWF_IO_URING always reads ahead)
+	void SetReadAhead(bool enable);	// must be called before LoadWaveFiles()
+	bool GetReadAhead(void) const;
+	const ReadAheadStats& GetReadAheadStats(void) const;
+	// Page cache hints (POSIX only), see MWF_CACHE_* for the modes.
+	void SetCacheMode(UINT8 mode);
+	UINT8 GetCacheMode(void) const;
+	void KeepCacheRange(UINT64 smplStart, UINT64 smplEnd);	// MWF_CACHE_BOUNDS: don't drop these samples
+	void SetCacheDropLimit(UINT64 smplPos);	// MWF_CACHE_BOUNDS: don't drop anything at or after this sample yet
+	void ReleaseCacheRanges(void);	// drop all kept ranges from the cache
+	
 	size_t ReadSamples(size_t bufSize, void* buffer);	// returns the number of samples read
+	// Returns up to smplCount samples as a list of spans (one per file fragment).
+	// The spans are valid until the next call to ReadSampleSpans(), LoadWaveFiles() or CloseFiles().
+	size_t ReadSampleSpans(size_t smplCount, std::vector<SampleSpan>& spans);	// returns the number of samples read
+	// Reads up to smplCount samples and decodes them into the block. (one array per channel, see SBLK_* for the types)
+	size_t ReadBlock(size_t smplCount, SampleBlock& block, UINT8 type = SBLK_INT32);	// returns the number of samples read
 	
 	UINT64 GetTotalSamples(void) const;
 	UINT16 GetCompression(void) const;
 	UINT16 GetChannels(void) const;
 	UINT8 GetBitDepth(void) const;
+	UINT8 GetSampleFormat(void) const;	// SFMT_* value, SFMT_NONE for unsupported formats
 	UINT32 GetSampleSize(void) const;
 	UINT32 GetSampleRate(void) const;
 	UINT64 GetSampleReadOffset(void) const;
 	void SetSampleReadOffset(UINT64 readOffset);
 	
+	size_t GetFileCount(void) const;
+	const std::string& GetFileName(size_t fileID) const;
+	UINT64 GetFileSamples(size_t fileID) const;
+	// size and modification time (in nanoseconds) of a file, for detecting changes
+	UINT8 GetFileStamp(size_t fileID, UINT64& size, INT64& mtime) const;
+	
 private:
-	size_t GetFileFromSample(UINT64 sample);
+	void InitReadState(void);
+	size_t GetFileFromSample(UINT64 sample) const;
+	size_t ReadFileSamples(UINT64 smplOfs, size_t smplCount, UINT8* buffer, size_t& fileID);
+	size_t DoReadSamples(size_t bufSize, void* buffer);
+	size_t ReadDirectSpans(size_t smplCount, std::vector<SampleSpan>& spans);
+	size_t ReadIntoBuffer(size_t smplCount, const UINT8*& data);
+	void StartReadAhead(UINT64 readStart, size_t smplCount);
+	size_t FetchReadAhead(size_t smplCount);
+	void StopReadAhead(void);
+	void ReadAheadThread(void);
+	void UringStart(UINT64 smplOfs, size_t smplCount);
+	void UringQueueBlock(size_t blockID, UINT64 smplOfs);
+	void UringSubmit(void);
+	size_t UringReap(bool wait);
+	INT32 UringReadPiece(const UringPiece& piece);
+	void UringComplete(size_t pieceID, INT32 result);
+	size_t UringFetch(size_t smplCount, const UINT8*& data);
+	void UringDrain(void);
+	void UpdateCacheHints(UINT64 readStart);
+	void FlushCacheDrop(UINT64 dropEnd);
+	void DropCacheSamples(UINT64 smplStart, UINT64 smplEnd);
+	void AdviseSamples(UINT64 smplStart, UINT64 smplEnd, UINT8 advice);
+	static UINT8 MapWaveData(WaveItem& wItm, int fd, UINT32 smplSize);
+	static void UnmapWaveData(WaveItem& wItm);
+	int AcquireFile(size_t fileID);
+	void ReleaseFile(size_t fileID);
 	
-	std::vector<WaveItem> _files;
+	std::vector<WaveItem> _files;	// sorted by startSmpl
 	UINT64 _totalSamples;
 	
+	// file handle pool
+	std::mutex _fhMutex;
+	std::vector<FileHandle> _fHandles;	// one per file
+	std::vector<size_t> _fhOpen;	// IDs of the currently opened files
+	UINT64 _fhUseCnt;
+	size_t _fhMaxOpen;
+	std::string _metaCachePath;
+	
 	UINT16 _compression;
 	UINT8 _bitDepth;
+	UINT8 _smplFormat;
 	UINT16 _channels;
 	UINT32 _sampleRate;
+	UINT8 _ioMode;
 	
 	UINT64 _smplOfs;	// current sample read offset
 	size_t _smplOfsFile;
 	
 	UINT32 _dBufSmpls;
 	std::vector<UINT8> _dataBuf;
+	std::vector<UINT8> _dioBuf;	// for direct I/O, used via an aligned pointer
+	std::vector<SampleSpan> _blkSpans;	// for ReadBlock()
+	
+	// read-ahead
+	bool _readAhead;	// read-ahead requested by the user
+	bool _raEnable;	// read-ahead active for the loaded files
+	std::thread _raThread;
+	std::mutex _raMutex;
+	std::condition_variable _raCond;
+	UINT8 _raState;
+	bool _raExit;
+	UINT64 _raSmplOfs;
+	size_t _raSmplCount;
+	size_t _raReadSmpls;
+	size_t _raFileID;
+	UINT64 _raLastEnd;	// end of the previous read, used for detecting sequential reads
+	std::vector<UINT8> _raBuf;
+	ReadAheadStats _raStats;
+	
+	// page cache hints
+	UINT8 _cacheMode;
+	UINT64 _cacheLastEnd;	// end of the previous read, used for detecting sequential reads
+	UINT64 _cacheAdvEnd;	// end of the range that was requested to be read ahead
+	UINT64 _cacheDropPos;	// everything before this was dropped already
+	UINT64 _cacheDropLimit;
+	std::vector<CacheRange> _cacheKeep;	// sorted by smplStart
+	
+	// io_uring
+	IoUring _uring;
+	bool _urEnable;
+	bool _urFixedBufs;	// blocks are registered with the ring
+	bool _urSubmitWarned;	// a failed submission was reported already
+	std::vector<UringBlock> _urBlocks;
+	std::deque<size_t> _urQueue;	// blocks in file order, the front one is returned next
+	size_t _urHeld;	// block that is currently used by the caller, -1 = none
+	std::vector<UringPiece> _urPieces;	// one per ring entry
+	std::vector<size_t> _urFreePieces;
+	UINT32 _urInFlight;
+	double _urBusyStart;
 };
 
 #endif	// __MULTIWAVEFILE_HPP__
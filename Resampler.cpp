@@ -0,0 +1,203 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#define _USE_MATH_DEFINES
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "stdtype.h"
+
+#include "Resampler.hpp"
+#include "SampleBlock.hpp"
+#include "SampleOps.hpp"
+
+#define INLINE	static inline
+
+#define RSMPL_MAX_PHASES	0x1000	// limits the coefficient table to a few MB
+#define RSMPL_MAX_TAPS		0x1000	// limits the decimation factor to about 25
+#define RSMPL_BASE_TAPS		160	// filter length (in input samples) without decimation
+#define RSMPL_PASSBAND		0.93	// filter cutoff, relative to the Nyquist frequency of the lower rate
+#define RSMPL_KAISER_BETA	9.0	// about 90 db stopband attenuation
+
+
+static UINT32 GCD(UINT32 a, UINT32 b);
+static double BesselI0(double x);
+INLINE double Sinc(double x);
+
+
+Resampler::Resampler() :
+	_upFactor(1),
+	_downFactor(1),
+	_taps(0),
+	_histStart(0),
+	_inCount(0),
+	_outPos(0)
+{
+}
+
+UINT8 Resampler::Init(UINT32 inRate, UINT32 outRate, UINT16 channels)
+{
+	UINT32 rateGCD;
+	std::vector<double> coefs;
+	double ratio;
+	double cutoff;
+	double betaI0;
+	UINT32 halfTaps;
+	UINT32 curPhase;
+	UINT32 curTap;
+	UINT16 curChn;
+	
+	if (! inRate || ! outRate)
+		return 0x80;
+	rateGCD = GCD(inRate, outRate);
+	_upFactor = outRate / rateGCD;
+	_downFactor = inRate / rateGCD;
+	if (_upFactor > RSMPL_MAX_PHASES)
+		return 0x80;
+	
+	// When decimating, the cutoff frequency goes down and the filter has to be longer for the same steepness.
+	ratio = std::min((double)outRate / inRate, 1.0);
+	cutoff = 0.5 * ratio * RSMPL_PASSBAND;	// in cycles per input sample
+	_taps = (UINT32)ceil(RSMPL_BASE_TAPS / ratio);
+	_taps = (_taps + 0x0F) & ~0x0F;	// multiple of 16 for the DotProduct() kernels
+	if (_taps > RSMPL_MAX_TAPS)
+		return 0x80;
+	halfTaps = _taps / 2;
+	betaI0 = BesselI0(RSMPL_KAISER_BETA);
+	
+	// Phase p is used for output samples at input position n + p / upFactor.
+	// It is applied to the input samples n - halfTaps + 1 .. n + halfTaps.
+	_coefs.resize((size_t)_upFactor * _taps);
+	coefs.resize(_taps);
+	for (curPhase = 0; curPhase < _upFactor; curPhase ++)
+	{
+		float* phaseCoefs = &_coefs[(size_t)curPhase * _taps];
+		double coefSum = 0.0;
+		for (curTap = 0; curTap < _taps; curTap ++)
+		{
+			// distance of the input sample from the output sample
+			double dist = (double)curTap - (halfTaps - 1) - (double)curPhase / _upFactor;
+			double winPos = dist / halfTaps;
+			double window = (fabs(winPos) < 1.0) ? BesselI0(RSMPL_KAISER_BETA * sqrt(1.0 - winPos * winPos)) / betaI0 : 0.0;
+			coefs[curTap] = 2.0 * cutoff * Sinc(2.0 * cutoff * dist) * window;
+			coefSum += coefs[curTap];
+		}
+		// normalize each phase to a DC gain of 1.0
+		for (curTap = 0; curTap < _taps; curTap ++)
+			phaseCoefs[curTap] = (float)(coefs[curTap] / coefSum);
+	}
+	
+	// The first output sample needs the input samples before the start, which are silent.
+	_history.resize(channels);
+	for (curChn = 0; curChn < channels; curChn ++)
+		_history[curChn].assign(halfTaps - 1, 0.0f);
+	_histStart = -(INT64)(halfTaps - 1);
+	_inCount = 0;
+	_outPos = 0;
+	
+	return 0x00;
+}
+
+size_t Resampler::GetMaxOutput(size_t inCount) const
+{
+	return (size_t)(((UINT64)inCount + _taps) * _upFactor / _downFactor) + 1;
+}
+
+size_t Resampler::Process(const SampleBlock& src, size_t inCount, SampleBlock& dst, bool flush)
+{
+	const UINT32 halfTaps = _taps / 2;
+	UINT16 chnCnt = (UINT16)_history.size();
+	UINT64 outEnd;	// output sample to stop at
+	UINT64 startPos;
+	INT64 dropCnt;
+	size_t outCnt;
+	UINT16 curChn;
+	
+	for (curChn = 0; curChn < chnCnt; curChn ++)
+	{
+		std::vector<float>& hist = _history[curChn];
+		if (inCount > 0)
+			hist.insert(hist.end(), src.GetFloat(curChn), src.GetFloat(curChn) + inCount);
+		if (flush)
+			hist.insert(hist.end(), halfTaps, 0.0f);	// silence after the end
+	}
+	_inCount += inCount;
+	
+	if (flush)
+	{
+		// all output samples within the input signal
+		outEnd = (_inCount * _upFactor + _downFactor - 1) / _downFactor;
+	}
+	else
+	{
+		// output samples whose filter window is completely within the input so far
+		// (position + halfTaps < inCount  <=>  k * downFactor < (inCount - halfTaps) * upFactor)
+		outEnd = (_inCount > halfTaps) ? ((_inCount - halfTaps) * _upFactor + _downFactor - 1) / _downFactor : 0;
+	}
+	if (outEnd < _outPos)
+		outEnd = _outPos;
+	
+	startPos = _outPos;
+	for (curChn = 0; curChn < chnCnt; curChn ++)
+	{
+		const float* hist = _history[curChn].data();
+		float* dstData = dst.GetFloat(curChn);
+		UINT64 outPos;
+		for (outPos = startPos; outPos < outEnd; outPos ++)
+		{
+			UINT64 inPos = outPos * _downFactor;
+			UINT64 smplPos = inPos / _upFactor;
+			UINT32 phase = (UINT32)(inPos % _upFactor);
+			size_t histPos = (size_t)((INT64)smplPos - (halfTaps - 1) - _histStart);
+			dstData[outPos - startPos] = (float)DotProduct(&_coefs[(size_t)phase * _taps], &hist[histPos], _taps);
+		}
+	}
+	outCnt = (size_t)(outEnd - startPos);
+	_outPos = outEnd;
+	
+	// drop the input samples that aren't needed by the next output sample anymore
+	dropCnt = (INT64)(_outPos * _downFactor / _upFactor) - (halfTaps - 1) - _histStart;
+	if (dropCnt > 0)
+	{
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			_history[curChn].erase(_history[curChn].begin(), _history[curChn].begin() + (size_t)dropCnt);
+		_histStart += dropCnt;
+	}
+	dst.SetSampleCount(outCnt);
+	
+	return outCnt;
+}
+
+
+static UINT32 GCD(UINT32 a, UINT32 b)
+{
+	while(b != 0)
+	{
+		UINT32 rem = a % b;
+		a = b;
+		b = rem;
+	}
+	return a;
+}
+
+// modified Bessel function of the first kind, order 0 (for the Kaiser window)
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	UINT32 k;
+	
+	for (k = 1; k < 100; k ++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-15)
+			break;
+	}
+	return sum;
+}
+
+INLINE double Sinc(double x)
+{
+	return (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+}
@@ -0,0 +1,38 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#ifndef __RESAMPLER_HPP__
+#define __RESAMPLER_HPP__
+
+#include <stddef.h>	// for size_t
+#include <vector>
+#include "stdtype.h"
+#include "SampleBlock.hpp"
+
+// Polyphase FIR sample rate converter for SBLK_FLOAT blocks.
+// The filter history is kept between calls, so a signal can be converted block by block.
+// The output is aligned with the input: output sample k is at input sample position k * inRate / outRate.
+class Resampler
+{
+public:
+	Resampler();
+	// returns 0x00 on success, 0x80 for unsupported ratios
+	UINT8 Init(UINT32 inRate, UINT32 outRate, UINT16 channels);
+	
+	// maximum number of output samples for a Process() call with inCount samples (including the flushing)
+	size_t GetMaxOutput(size_t inCount) const;
+	// Converts inCount samples from src and writes the output to dst. Returns the number of output samples.
+	// With flush = true, the signal ends after src and the remaining output is generated.
+	size_t Process(const SampleBlock& src, size_t inCount, SampleBlock& dst, bool flush);
+
+private:
+	UINT32 _upFactor;	// interpolation factor (number of filter phases)
+	UINT32 _downFactor;	// decimation factor
+	UINT32 _taps;	// filter taps per phase
+	std::vector<float> _coefs;	// [phase][tap]
+	std::vector< std::vector<float> > _history;	// input samples of each channel, starting at _histStart
+	INT64 _histStart;	// input sample position of the first history value
+	UINT64 _inCount;	// number of input samples so far
+	UINT64 _outPos;	// next output sample
+};
+
+#endif	// __RESAMPLER_HPP__
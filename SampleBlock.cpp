@@ -0,0 +1,509 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <stddef.h>
+#include <string.h>	// for memcpy()
+#include <vector>
+#include <type_traits>
+#include "stdtype.h"
+
+#include "SampleBlock.hpp"
+#include "SampleOps.hpp"
+
+#define INLINE	static inline
+
+#define SBLK_ALIGN	0x40	// cache line size
+#define CONV_VALS	0x1000	// number of values per conversion chunk (interleaved)
+
+
+INLINE INT32 ReadLE16s(const UINT8* data);
+INLINE INT32 ReadLE24s(const UINT8* data);
+INLINE INT32 ReadLE32s(const UINT8* data);
+template<UINT8 FMT> INLINE UINT8 FormatBytes(void);
+template<typename T, UINT8 FMT> INLINE T ReadSample(const UINT8* data, T scale);
+template<UINT8 FMT> INLINE void WriteSample(UINT8* data, INT32 value);
+template<UINT8 FMT> INLINE void ConvertChunk(const UINT8* src, INT32* dst, size_t count);
+template<typename T, UINT8 FMT, UINT16 CHN> static void DecodeFrames(const UINT8* src, size_t smplCount, SampleBlock& block, size_t blkOfs, T scale);
+template<typename T, UINT8 FMT> static void DecodeChannels(const UINT8* src, size_t smplCount, SampleBlock& block, size_t blkOfs, T scale);
+template<typename T> static void DecodeFormat(const UINT8* src, size_t smplCount, UINT8 smplFmt, SampleBlock& block, size_t blkOfs, T scale);
+template<UINT8 FMT, UINT16 CHN> static void EncodeFrames(const SampleBlock& block, size_t blkOfs, size_t smplCount, UINT8* dst);
+template<UINT8 FMT> static void EncodeChannels(const SampleBlock& block, size_t blkOfs, size_t smplCount, UINT8* dst);
+
+
+SampleBlock::SampleBlock() :
+	_base(NULL),
+	_chnStride(0),
+	_type(SBLK_INT32),
+	_channels(0),
+	_capacity(0),
+	_smplCount(0)
+{
+}
+
+void SampleBlock::Setup(UINT8 type, UINT16 channels, size_t capacity)
+{
+	// INT32 and float have the same size, so the layout doesn't depend on the type
+	size_t chnStride = (capacity * sizeof(INT32) + SBLK_ALIGN - 1) & ~(size_t)(SBLK_ALIGN - 1);
+	size_t memSize = chnStride * channels + SBLK_ALIGN;
+	
+	if (_mem.size() < memSize)
+		_mem.resize(memSize);
+	_base = (UINT8*)(((size_t)_mem.data() + SBLK_ALIGN - 1) & ~(size_t)(SBLK_ALIGN - 1));
+	_chnStride = chnStride;
+	_type = type;
+	_channels = channels;
+	_capacity = capacity;
+	_smplCount = 0;
+	
+	return;
+}
+
+UINT8 SampleBlock::GetType(void) const
+{
+	return _type;
+}
+
+UINT16 SampleBlock::GetChannels(void) const
+{
+	return _channels;
+}
+
+size_t SampleBlock::GetCapacity(void) const
+{
+	return _capacity;
+}
+
+size_t SampleBlock::GetSampleCount(void) const
+{
+	return _smplCount;
+}
+
+void SampleBlock::SetSampleCount(size_t smplCount)
+{
+	_smplCount = smplCount;
+}
+
+INT32* SampleBlock::GetInt(UINT16 chn)
+{
+	return (INT32*)(_base + chn * _chnStride);
+}
+
+const INT32* SampleBlock::GetInt(UINT16 chn) const
+{
+	return (const INT32*)(_base + chn * _chnStride);
+}
+
+float* SampleBlock::GetFloat(UINT16 chn)
+{
+	return (float*)(_base + chn * _chnStride);
+}
+
+const float* SampleBlock::GetFloat(UINT16 chn) const
+{
+	return (const float*)(_base + chn * _chnStride);
+}
+
+
+UINT8 GetSampleFormatBytes(UINT8 smplFmt)
+{
+	switch(smplFmt)
+	{
+	case SFMT_U8:
+		return 1;
+	case SFMT_S16:
+		return 2;
+	case SFMT_S24:
+		return 3;
+	case SFMT_S32:
+	case SFMT_F32:
+		return 4;
+	case SFMT_F64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+UINT8 GetSampleFormatIntBits(UINT8 smplFmt)
+{
+	switch(smplFmt)
+	{
+	case SFMT_F32:
+	case SFMT_F64:
+		return 32;
+	default:
+		return GetSampleFormatBytes(smplFmt) * 8;
+	}
+}
+
+
+// The decoding/encoding is specialized for the sample format and common channel counts.
+// With a fixed channel count, the compiler can unroll the channel loops and use constant strides.
+// CHN == 0 is the generic version that works with any channel count.
+// 8/16/24-bit data goes through the SIMD unpack kernels in chunks, the deinterleaving is done separately.
+// The same is done for float data that is decoded into SBLK_INT32 blocks. (24-bit encoding uses the pack kernel.)
+template<typename T, UINT8 FMT, UINT16 CHN> static void DecodeFrames(const UINT8* src, size_t smplCount, SampleBlock& block, size_t blkOfs, T scale)
+{
+	INT32 convBuf[CONV_VALS];
+	const bool isFloatFmt = (FMT == SFMT_F32 || FMT == SFMT_F64);
+	const bool useKernel = (FMT == SFMT_U8 || FMT == SFMT_S16 || FMT == SFMT_S24) || (isFloatFmt && ! std::is_floating_point<T>::value);
+	const UINT16 chnCnt = CHN ? CHN : block.GetChannels();
+	const UINT32 smplSize = chnCnt * FormatBytes<FMT>();
+	const size_t chunkSmpls = CONV_VALS / chnCnt;
+	size_t smplPos;
+	UINT16 curChn;
+	size_t curSmpl;
+	
+	if (! useKernel || chunkSmpls == 0)
+	{
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			const UINT8* chnSrc = &src[curChn * FormatBytes<FMT>()];
+			T* dst = (T*)block.GetInt(curChn) + blkOfs;	// INT32 and float arrays have the same layout
+			for (curSmpl = 0; curSmpl < smplCount; curSmpl ++, chnSrc += smplSize)
+				dst[curSmpl] = ReadSample<T, FMT>(chnSrc, scale);
+		}
+		return;
+	}
+	
+	for (smplPos = 0; smplPos < smplCount; smplPos += chunkSmpls)
+	{
+		size_t smpls = (smplCount - smplPos < chunkSmpls) ? (smplCount - smplPos) : chunkSmpls;
+		ConvertChunk<FMT>(&src[smplPos * smplSize], convBuf, smpls * chnCnt);
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			const INT32* chnSrc = &convBuf[curChn];
+			T* dst = (T*)block.GetInt(curChn) + blkOfs + smplPos;
+			for (curSmpl = 0; curSmpl < smpls; curSmpl ++)
+				dst[curSmpl] = (T)chnSrc[curSmpl * chnCnt] * scale;
+		}
+	}
+	
+	return;
+}
+
+template<typename T, UINT8 FMT> static void DecodeChannels(const UINT8* src, size_t smplCount, SampleBlock& block, size_t blkOfs, T scale)
+{
+	switch(block.GetChannels())
+	{
+	case 1:
+		DecodeFrames<T, FMT, 1>(src, smplCount, block, blkOfs, scale);
+		break;
+	case 2:
+		DecodeFrames<T, FMT, 2>(src, smplCount, block, blkOfs, scale);
+		break;
+	case 4:
+		DecodeFrames<T, FMT, 4>(src, smplCount, block, blkOfs, scale);
+		break;
+	case 6:
+		DecodeFrames<T, FMT, 6>(src, smplCount, block, blkOfs, scale);
+		break;
+	case 8:
+		DecodeFrames<T, FMT, 8>(src, smplCount, block, blkOfs, scale);
+		break;
+	default:
+		DecodeFrames<T, FMT, 0>(src, smplCount, block, blkOfs, scale);
+		break;
+	}
+	
+	return;
+}
+
+template<typename T> static void DecodeFormat(const UINT8* src, size_t smplCount, UINT8 smplFmt, SampleBlock& block, size_t blkOfs, T scale)
+{
+	UINT16 curChn;
+	size_t curSmpl;
+	
+	switch(smplFmt)
+	{
+	case SFMT_U8:
+		DecodeChannels<T, SFMT_U8>(src, smplCount, block, blkOfs, scale);
+		break;
+	case SFMT_S16:
+		DecodeChannels<T, SFMT_S16>(src, smplCount, block, blkOfs, scale);
+		break;
+	case SFMT_S24:
+		DecodeChannels<T, SFMT_S24>(src, smplCount, block, blkOfs, scale);
+		break;
+	case SFMT_S32:
+		DecodeChannels<T, SFMT_S32>(src, smplCount, block, blkOfs, scale);
+		break;
+	case SFMT_F32:
+		DecodeChannels<T, SFMT_F32>(src, smplCount, block, blkOfs, scale);
+		break;
+	case SFMT_F64:
+		DecodeChannels<T, SFMT_F64>(src, smplCount, block, blkOfs, scale);
+		break;
+	default:
+		for (curChn = 0; curChn < block.GetChannels(); curChn ++)
+		{
+			T* dst = (T*)block.GetInt(curChn) + blkOfs;
+			for (curSmpl = 0; curSmpl < smplCount; curSmpl ++)
+				dst[curSmpl] = 0;
+		}
+		break;
+	}
+	
+	return;
+}
+
+void DecodeSamples(const UINT8* src, size_t smplCount, UINT8 smplFmt, SampleBlock& block, size_t blkOfs)
+{
+	UINT8 bits = GetSampleFormatIntBits(smplFmt);
+	
+	if (block.GetChannels() == 1 && (block.GetType() == SBLK_INT32 || (block.GetType() == SBLK_INT24 && bits >= 24)))
+	{
+		// nothing to deinterleave
+		switch(smplFmt)
+		{
+		case SFMT_U8:
+			Unpack8to32(src, &block.GetInt(0)[blkOfs], smplCount);
+			return;
+		case SFMT_S16:
+			Unpack16to32(src, &block.GetInt(0)[blkOfs], smplCount);
+			return;
+		case SFMT_S24:
+			Unpack24to32(src, &block.GetInt(0)[blkOfs], smplCount);
+			return;
+		case SFMT_F32:
+			ConvF32to32(src, &block.GetInt(0)[blkOfs], smplCount);
+			return;
+		case SFMT_F64:
+			ConvF64to32(src, &block.GetInt(0)[blkOfs], smplCount);
+			return;
+		}
+	}
+	if (block.GetType() == SBLK_FLOAT)
+	{
+		// float samples are passed through (scale 1.0)
+		float scale = (smplFmt == SFMT_F32 || smplFmt == SFMT_F64 || ! bits) ? 1.0f : 1.0f / (float)(1ULL << (bits - 1));
+		DecodeFormat<float>(src, smplCount, smplFmt, block, blkOfs, scale);
+	}
+	else
+	{
+		INT32 scale = (block.GetType() == SBLK_INT24 && bits < 24) ? (1 << (24 - bits)) : 1;
+		DecodeFormat<INT32>(src, smplCount, smplFmt, block, blkOfs, scale);
+	}
+	
+	return;
+}
+
+template<UINT8 FMT, UINT16 CHN> static void EncodeFrames(const SampleBlock& block, size_t blkOfs, size_t smplCount, UINT8* dst)
+{
+	INT32 convBuf[CONV_VALS];
+	const UINT16 chnCnt = CHN ? CHN : block.GetChannels();
+	const UINT32 smplSize = chnCnt * FormatBytes<FMT>();
+	const size_t chunkSmpls = CONV_VALS / chnCnt;
+	size_t smplPos;
+	UINT16 curChn;
+	size_t curSmpl;
+	
+	if (FMT != SFMT_S24 || chunkSmpls == 0)
+	{
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			const INT32* src = &block.GetInt(curChn)[blkOfs];
+			UINT8* chnDst = &dst[curChn * FormatBytes<FMT>()];
+			for (curSmpl = 0; curSmpl < smplCount; curSmpl ++, chnDst += smplSize)
+				WriteSample<FMT>(chnDst, src[curSmpl]);
+		}
+		return;
+	}
+	
+	for (smplPos = 0; smplPos < smplCount; smplPos += chunkSmpls)
+	{
+		size_t smpls = (smplCount - smplPos < chunkSmpls) ? (smplCount - smplPos) : chunkSmpls;
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			const INT32* src = &block.GetInt(curChn)[blkOfs + smplPos];
+			INT32* chnDst = &convBuf[curChn];
+			for (curSmpl = 0; curSmpl < smpls; curSmpl ++)
+				chnDst[curSmpl * chnCnt] = src[curSmpl];
+		}
+		Pack32to24(convBuf, &dst[smplPos * smplSize], smpls * chnCnt);
+	}
+	
+	return;
+}
+
+template<UINT8 FMT> static void EncodeChannels(const SampleBlock& block, size_t blkOfs, size_t smplCount, UINT8* dst)
+{
+	switch(block.GetChannels())
+	{
+	case 1:
+		EncodeFrames<FMT, 1>(block, blkOfs, smplCount, dst);
+		break;
+	case 2:
+		EncodeFrames<FMT, 2>(block, blkOfs, smplCount, dst);
+		break;
+	case 4:
+		EncodeFrames<FMT, 4>(block, blkOfs, smplCount, dst);
+		break;
+	case 6:
+		EncodeFrames<FMT, 6>(block, blkOfs, smplCount, dst);
+		break;
+	case 8:
+		EncodeFrames<FMT, 8>(block, blkOfs, smplCount, dst);
+		break;
+	default:
+		EncodeFrames<FMT, 0>(block, blkOfs, smplCount, dst);
+		break;
+	}
+	
+	return;
+}
+
+void EncodeSamples(const SampleBlock& block, size_t blkOfs, size_t smplCount, UINT8 smplFmt, UINT8* dst)
+{
+	switch(smplFmt)
+	{
+	case SFMT_U8:
+		EncodeChannels<SFMT_U8>(block, blkOfs, smplCount, dst);
+		break;
+	case SFMT_S16:
+		EncodeChannels<SFMT_S16>(block, blkOfs, smplCount, dst);
+		break;
+	case SFMT_S24:
+		if (block.GetChannels() == 1)
+			Pack32to24(&block.GetInt(0)[blkOfs], dst, smplCount);	// nothing to interleave
+		else
+			EncodeChannels<SFMT_S24>(block, blkOfs, smplCount, dst);
+		break;
+	case SFMT_S32:
+		EncodeChannels<SFMT_S32>(block, blkOfs, smplCount, dst);
+		break;
+	case SFMT_F32:
+		EncodeChannels<SFMT_F32>(block, blkOfs, smplCount, dst);
+		break;
+	case SFMT_F64:
+		EncodeChannels<SFMT_F64>(block, blkOfs, smplCount, dst);
+		break;
+	}
+	
+	return;
+}
+
+template<UINT8 FMT> INLINE UINT8 FormatBytes(void)
+{
+	switch(FMT)
+	{
+	case SFMT_U8:
+		return 1;
+	case SFMT_S16:
+		return 2;
+	case SFMT_S24:
+		return 3;
+	case SFMT_S32:
+	case SFMT_F32:
+		return 4;
+	case SFMT_F64:
+		return 8;
+	default:
+		return 1;	// avoid a stride of 0
+	}
+}
+
+template<typename T, UINT8 FMT> INLINE T ReadSample(const UINT8* data, T scale)
+{
+	INT32 intVal;
+	float fltVal;
+	double dblVal;
+	
+	switch(FMT)
+	{
+	case SFMT_U8:
+		return (T)((INT32)data[0x00] - 0x80) * scale;
+	case SFMT_S16:
+		return (T)ReadLE16s(data) * scale;
+	case SFMT_S24:
+		return (T)ReadLE24s(data) * scale;
+	case SFMT_S32:
+		// -0x80000000 is clamped like in the float conversion, so that all decoded values work with abs()
+		intVal = ReadLE32s(data);
+		return (T)((intVal == (INT32)0x80000000) ? -0x7FFFFFFF : intVal) * scale;
+	case SFMT_F32:	// only used for float blocks, integer blocks use ConvertChunk()
+		memcpy(&fltVal, data, 0x04);
+		return (T)fltVal;
+	case SFMT_F64:
+		memcpy(&dblVal, data, 0x08);
+		return (T)dblVal;
+	default:
+		return 0;
+	}
+}
+
+template<UINT8 FMT> INLINE void WriteSample(UINT8* data, INT32 value)
+{
+	float fltVal;
+	double dblVal;
+	
+	switch(FMT)
+	{
+	case SFMT_U8:
+		data[0x00] = (UINT8)(value + 0x80);
+		break;
+	case SFMT_S16:
+		data[0x00] = (value >> 0) & 0xFF;
+		data[0x01] = (value >> 8) & 0xFF;
+		break;
+	case SFMT_S24:
+		data[0x00] = (value >>  0) & 0xFF;
+		data[0x01] = (value >>  8) & 0xFF;
+		data[0x02] = (value >> 16) & 0xFF;
+		break;
+	case SFMT_S32:
+		data[0x00] = (value >>  0) & 0xFF;
+		data[0x01] = (value >>  8) & 0xFF;
+		data[0x02] = (value >> 16) & 0xFF;
+		data[0x03] = (value >> 24) & 0xFF;
+		break;
+	case SFMT_F32:	// values are scaled like 32-bit integers
+		fltVal = (float)value / 2147483648.0f;
+		memcpy(data, &fltVal, 0x04);
+		break;
+	case SFMT_F64:
+		dblVal = (double)value / 2147483648.0;
+		memcpy(data, &dblVal, 0x08);
+		break;
+	}
+	
+	return;
+}
+
+template<UINT8 FMT> INLINE void ConvertChunk(const UINT8* src, INT32* dst, size_t count)
+{
+	switch(FMT)
+	{
+	case SFMT_U8:
+		Unpack8to32(src, dst, count);
+		break;
+	case SFMT_S16:
+		Unpack16to32(src, dst, count);
+		break;
+	case SFMT_S24:
+		Unpack24to32(src, dst, count);
+		break;
+	case SFMT_F32:
+		ConvF32to32(src, dst, count);
+		break;
+	case SFMT_F64:
+		ConvF64to32(src, dst, count);
+		break;
+	}
+	
+	return;
+}
+
+INLINE INT32 ReadLE16s(const UINT8* data)
+{
+	return (INT16)(((INT8)data[0x01] << 8) | (data[0x00] << 0));
+}
+
+INLINE INT32 ReadLE24s(const UINT8* data)
+{
+	return ((INT8)data[0x02] << 16) | (data[0x01] <<  8) | (data[0x00] <<  0);
+}
+
+INLINE INT32 ReadLE32s(const UINT8* data)
+{
+	return (INT32)(((UINT32)data[0x03] << 24) | (data[0x02] << 16) | (data[0x01] <<  8) | (data[0x00] <<  0));
+}
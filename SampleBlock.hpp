@@ -0,0 +1,63 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#ifndef __SAMPLEBLOCK_HPP__
+#define __SAMPLEBLOCK_HPP__
+
+#include <stddef.h>	// for size_t
+#include <vector>
+#include "stdtype.h"
+
+// sample formats of interleaved little-endian PCM data
+#define SFMT_NONE	0x00	// not supported
+#define SFMT_U8		0x01	// 8-bit unsigned integer
+#define SFMT_S16	0x02	// 16-bit signed integer
+#define SFMT_S24	0x03	// 24-bit signed integer
+#define SFMT_S32	0x04	// 32-bit signed integer
+#define SFMT_F32	0x05	// 32-bit IEEE float, -1.0 .. +1.0
+#define SFMT_F64	0x06	// 64-bit IEEE float, -1.0 .. +1.0
+
+// sample block types
+#define SBLK_INT32	0x00	// integers, scaled like the source (e.g. -0x800000 .. +0x7FFFFF for 24-bit, 32-bit range for floats)
+#define SBLK_FLOAT	0x01	// floating point, -1.0 .. +1.0
+#define SBLK_INT24	0x02	// like SBLK_INT32, but 8/16-bit samples are scaled up to 24-bit values
+
+// Block of decoded samples with one array per channel.
+// Each channel array is aligned to a cache line. The memory is kept for reuse when setting up the next block.
+class SampleBlock
+{
+public:
+	SampleBlock();
+	void Setup(UINT8 type, UINT16 channels, size_t capacity);
+	
+	UINT8 GetType(void) const;
+	UINT16 GetChannels(void) const;
+	size_t GetCapacity(void) const;
+	size_t GetSampleCount(void) const;
+	void SetSampleCount(size_t smplCount);
+	
+	INT32* GetInt(UINT16 chn);
+	const INT32* GetInt(UINT16 chn) const;
+	float* GetFloat(UINT16 chn);
+	const float* GetFloat(UINT16 chn) const;
+	
+private:
+	std::vector<UINT8> _mem;
+	UINT8* _base;	// aligned pointer into _mem
+	size_t _chnStride;	// distance between channel arrays in bytes
+	UINT8 _type;
+	UINT16 _channels;
+	size_t _capacity;
+	size_t _smplCount;
+};
+
+// bytes per value of a sample format
+UINT8 GetSampleFormatBytes(UINT8 smplFmt);
+// bit depth of the values in SBLK_INT32 blocks (Float samples are converted to 32-bit integers and saturated.)
+UINT8 GetSampleFormatIntBits(UINT8 smplFmt);
+
+// Convert interleaved PCM data into the block, starting at sample blkOfs.
+void DecodeSamples(const UINT8* src, size_t smplCount, UINT8 smplFmt, SampleBlock& block, size_t blkOfs);
+// Convert an SBLK_INT32 block back into interleaved PCM data. The values must fit into the format's integer bit depth.
+void EncodeSamples(const SampleBlock& block, size_t blkOfs, size_t smplCount, UINT8 smplFmt, UINT8* dst);
+
+#endif	// __SAMPLEBLOCK_HPP__
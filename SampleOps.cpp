@@ -0,0 +1,1583 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <stddef.h>
+#include <stdlib.h>	// for abs()
+#include <string.h>	// for memcpy()
+#include <math.h>	// for lrint()
+#include "stdtype.h"
+
+#include "SampleOps.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>	// for __cpuid()
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET(x)	__attribute__((target(x)))
+#else
+#define SIMD_TARGET(x)	// MSVC allows all intrinsics without special flags
+#endif
+
+#define INLINE	static inline
+
+#define DITHER_CHUNK	0x400	// values per call of the noise generator
+
+
+// precalculated values for ApplyGain()
+struct GainParams
+{
+	double gain;
+	UINT8 shift;	// bit depth reduction
+	INT32 rounding;	// added before shifting
+	INT64 minVal;	// range of the destination bit depth
+	INT64 maxVal;
+	// The SIMD kernels clamp the scaled value to [clampLo, clampHi] before the integer conversion.
+	// This results in exactly minVal/maxVal after shifting and keeps the conversion within 32 bits.
+	double clampLo;
+	double clampHi;
+	// A scaled value is clipped (with the scalar calculation) when it is <= clipLo or >= clipHi.
+	double clipLo;
+	double clipHi;
+};
+
+struct SampleOpsFuncs
+{
+	void (*unpack8to32)(const UINT8* src, INT32* dst, size_t count);
+	void (*unpack16to32)(const UINT8* src, INT32* dst, size_t count);
+	void (*unpack24to32)(const UINT8* src, INT32* dst, size_t count);
+	void (*pack32to24)(const INT32* src, UINT8* dst, size_t count);
+	void (*convF32to32)(const UINT8* src, INT32* dst, size_t count);
+	void (*convF64to32)(const UINT8* src, INT32* dst, size_t count);
+	size_t (*findFrameAbove)(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+	size_t (*findFrameBelow)(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+	INT32 (*getAbsMax)(const INT32* data, size_t count);
+	size_t (*applyGain)(INT32* data, size_t count, const GainParams& gp, const double* noise);
+	void (*getMinMax)(const INT32* data, size_t count, INT32& minVal, INT32& maxVal);
+	size_t (*findValue)(const INT32* data, size_t count, INT32 value);
+	void (*genTpdf)(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale);
+	double (*dotProduct)(const float* a, const float* b, size_t count);
+};
+
+static UINT8 DetectSimdLevel(void);
+static size_t ApplyGainShaped(INT32* data, size_t count, const GainParams& gp, const double* noise, double& error);
+INLINE INT32 ReadLE16s(const UINT8* data);
+INLINE INT32 ReadLE24s(const UINT8* data);
+INLINE INT32 FloatToInt32(float value);
+INLINE INT32 DoubleToInt32(double value);
+INLINE UINT32 CountTrailingZeros(UINT32 val);
+INLINE UINT32 CountBits(UINT32 val);
+INLINE UINT32 Hash32(UINT32 val);
+INLINE double DotProductSum(double* sums, const float* a, const float* b, size_t count);
+static void Unpack8to32_Scalar(const UINT8* src, INT32* dst, size_t count);
+static void Unpack16to32_Scalar(const UINT8* src, INT32* dst, size_t count);
+static void Unpack24to32_Scalar(const UINT8* src, INT32* dst, size_t count);
+static void Pack32to24_Scalar(const INT32* src, UINT8* dst, size_t count);
+static void ConvF32to32_Scalar(const UINT8* src, INT32* dst, size_t count);
+static void ConvF64to32_Scalar(const UINT8* src, INT32* dst, size_t count);
+static size_t FindFrameAbove_Scalar(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+static size_t FindFrameBelow_Scalar(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+static INT32 GetAbsMax_Scalar(const INT32* data, size_t count);
+static size_t ApplyGain_Scalar(INT32* data, size_t count, const GainParams& gp, const double* noise);
+static void GetMinMax_Scalar(const INT32* data, size_t count, INT32& minVal, INT32& maxVal);
+static size_t FindValue_Scalar(const INT32* data, size_t count, INT32 value);
+static void GenTpdf_Scalar(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale);
+static double DotProduct_Scalar(const float* a, const float* b, size_t count);
+#ifdef SIMD_X86
+SIMD_TARGET("ssse3") INLINE __m128i MulLo32_SSSE3(__m128i a, __m128i b);
+SIMD_TARGET("ssse3") INLINE __m128i Hash32_SSSE3(__m128i val);
+SIMD_TARGET("avx2") INLINE __m256i Hash32_AVX2(__m256i val);
+SIMD_TARGET("avx512f,avx512bw") INLINE __m512i Hash32_AVX512(__m512i val);
+SIMD_TARGET("ssse3") static void Unpack8to32_SSSE3(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("ssse3") static void Unpack16to32_SSSE3(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("ssse3") static void Unpack24to32_SSSE3(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("ssse3") static void Pack32to24_SSSE3(const INT32* src, UINT8* dst, size_t count);
+SIMD_TARGET("ssse3") static void ConvF32to32_SSSE3(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("ssse3") static void ConvF64to32_SSSE3(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("ssse3") static size_t FindFrameAbove_SSSE3(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+SIMD_TARGET("ssse3") static size_t FindFrameBelow_SSSE3(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+SIMD_TARGET("ssse3") static INT32 GetAbsMax_SSSE3(const INT32* data, size_t count);
+SIMD_TARGET("ssse3") static size_t ApplyGain_SSSE3(INT32* data, size_t count, const GainParams& gp, const double* noise);
+SIMD_TARGET("ssse3") static void GetMinMax_SSSE3(const INT32* data, size_t count, INT32& minVal, INT32& maxVal);
+SIMD_TARGET("ssse3") static size_t FindValue_SSSE3(const INT32* data, size_t count, INT32 value);
+SIMD_TARGET("ssse3") static void GenTpdf_SSSE3(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale);
+SIMD_TARGET("ssse3") static double DotProduct_SSSE3(const float* a, const float* b, size_t count);
+SIMD_TARGET("avx2") static void Unpack8to32_AVX2(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx2") static void Unpack16to32_AVX2(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx2") static void Unpack24to32_AVX2(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx2") static void Pack32to24_AVX2(const INT32* src, UINT8* dst, size_t count);
+SIMD_TARGET("avx2") static void ConvF32to32_AVX2(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx2") static void ConvF64to32_AVX2(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx2") static size_t FindFrameAbove_AVX2(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+SIMD_TARGET("avx2") static size_t FindFrameBelow_AVX2(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+SIMD_TARGET("avx2") static INT32 GetAbsMax_AVX2(const INT32* data, size_t count);
+SIMD_TARGET("avx2") static size_t ApplyGain_AVX2(INT32* data, size_t count, const GainParams& gp, const double* noise);
+SIMD_TARGET("avx2") static void GetMinMax_AVX2(const INT32* data, size_t count, INT32& minVal, INT32& maxVal);
+SIMD_TARGET("avx2") static size_t FindValue_AVX2(const INT32* data, size_t count, INT32 value);
+SIMD_TARGET("avx2") static void GenTpdf_AVX2(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale);
+SIMD_TARGET("avx2") static double DotProduct_AVX2(const float* a, const float* b, size_t count);
+SIMD_TARGET("avx512f,avx512bw") static void Unpack8to32_AVX512(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx512f,avx512bw") static void Unpack16to32_AVX512(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx512f,avx512bw") static void Unpack24to32_AVX512(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx512f,avx512bw") static void Pack32to24_AVX512(const INT32* src, UINT8* dst, size_t count);
+SIMD_TARGET("avx512f,avx512bw") static void ConvF32to32_AVX512(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx512f,avx512bw") static void ConvF64to32_AVX512(const UINT8* src, INT32* dst, size_t count);
+SIMD_TARGET("avx512f,avx512bw") static size_t FindFrameAbove_AVX512(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+SIMD_TARGET("avx512f,avx512bw") static size_t FindFrameBelow_AVX512(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+SIMD_TARGET("avx512f,avx512bw") static INT32 GetAbsMax_AVX512(const INT32* data, size_t count);
+SIMD_TARGET("avx512f,avx512bw") static size_t ApplyGain_AVX512(INT32* data, size_t count, const GainParams& gp, const double* noise);
+SIMD_TARGET("avx512f,avx512bw") static void GetMinMax_AVX512(const INT32* data, size_t count, INT32& minVal, INT32& maxVal);
+SIMD_TARGET("avx512f,avx512bw") static size_t FindValue_AVX512(const INT32* data, size_t count, INT32 value);
+SIMD_TARGET("avx512f,avx512bw") static void GenTpdf_AVX512(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale);
+SIMD_TARGET("avx512f,avx512bw") static double DotProduct_AVX512(const float* a, const float* b, size_t count);
+#endif
+
+
+static const SampleOpsFuncs SOP_FUNCS[] =
+{
+	{Unpack8to32_Scalar, Unpack16to32_Scalar, Unpack24to32_Scalar, Pack32to24_Scalar, ConvF32to32_Scalar, ConvF64to32_Scalar, FindFrameAbove_Scalar, FindFrameBelow_Scalar, GetAbsMax_Scalar, ApplyGain_Scalar, GetMinMax_Scalar, FindValue_Scalar, GenTpdf_Scalar, DotProduct_Scalar},
+#ifdef SIMD_X86
+	{Unpack8to32_SSSE3, Unpack16to32_SSSE3, Unpack24to32_SSSE3, Pack32to24_SSSE3, ConvF32to32_SSSE3, ConvF64to32_SSSE3, FindFrameAbove_SSSE3, FindFrameBelow_SSSE3, GetAbsMax_SSSE3, ApplyGain_SSSE3, GetMinMax_SSSE3, FindValue_SSSE3, GenTpdf_SSSE3, DotProduct_SSSE3},
+	{Unpack8to32_AVX2, Unpack16to32_AVX2, Unpack24to32_AVX2, Pack32to24_AVX2, ConvF32to32_AVX2, ConvF64to32_AVX2, FindFrameAbove_AVX2, FindFrameBelow_AVX2, GetAbsMax_AVX2, ApplyGain_AVX2, GetMinMax_AVX2, FindValue_AVX2, GenTpdf_AVX2, DotProduct_AVX2},
+	{Unpack8to32_AVX512, Unpack16to32_AVX512, Unpack24to32_AVX512, Pack32to24_AVX512, ConvF32to32_AVX512, ConvF64to32_AVX512, FindFrameAbove_AVX512, FindFrameBelow_AVX512, GetAbsMax_AVX512, ApplyGain_AVX512, GetMinMax_AVX512, FindValue_AVX512, GenTpdf_AVX512, DotProduct_AVX512},
+#endif
+};
+static const SampleOpsFuncs* sopFuncs = &SOP_FUNCS[SIMD_SCALAR];
+static const UINT8 simdMaxLevel = DetectSimdLevel();
+static UINT8 simdLevel = SetSimdLevel(0xFF);	// use the best kernels by default
+
+UINT8 GetSimdLevel(void)
+{
+	return simdLevel;
+}
+
+UINT8 SetSimdLevel(UINT8 level)
+{
+	simdLevel = (level < simdMaxLevel) ? level : simdMaxLevel;
+	sopFuncs = &SOP_FUNCS[simdLevel];
+	return simdLevel;
+}
+
+const char* GetSimdLevelName(UINT8 level)
+{
+	switch(level)
+	{
+	case SIMD_SCALAR:
+		return "scalar";
+	case SIMD_SSSE3:
+		return "SSSE3";
+	case SIMD_AVX2:
+		return "AVX2";
+	case SIMD_AVX512:
+		return "AVX-512";
+	default:
+		return "unknown";
+	}
+}
+
+void Unpack8to32(const UINT8* src, INT32* dst, size_t count)
+{
+	sopFuncs->unpack8to32(src, dst, count);
+}
+
+void Unpack16to32(const UINT8* src, INT32* dst, size_t count)
+{
+	sopFuncs->unpack16to32(src, dst, count);
+}
+
+void Unpack24to32(const UINT8* src, INT32* dst, size_t count)
+{
+	sopFuncs->unpack24to32(src, dst, count);
+}
+
+void Pack32to24(const INT32* src, UINT8* dst, size_t count)
+{
+	sopFuncs->pack32to24(src, dst, count);
+}
+
+void ConvF32to32(const UINT8* src, INT32* dst, size_t count)
+{
+	sopFuncs->convF32to32(src, dst, count);
+}
+
+void ConvF64to32(const UINT8* src, INT32* dst, size_t count)
+{
+	sopFuncs->convF64to32(src, dst, count);
+}
+
+size_t FindFrameAbove(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	return sopFuncs->findFrameAbove(chnData, chnCnt, start, end, level);
+}
+
+size_t FindFrameBelow(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	return sopFuncs->findFrameBelow(chnData, chnCnt, start, end, level);
+}
+
+INT32 GetAbsMax(const INT32* data, size_t count)
+{
+	return sopFuncs->getAbsMax(data, count);
+}
+
+size_t ApplyGain(INT32* data, size_t count, double gain, UINT8 srcBits, UINT8 dstBits, DitherState* dither)
+{
+	GainParams gp;
+	INT64 scale;
+	double noise[DITHER_CHUNK];
+	double noiseScale;
+	size_t overflowCnt;
+	size_t curVal;
+	size_t chunkLen;
+	
+	if (srcBits == dstBits && gain == 1.0)
+		return 0;	// nothing to do and nothing can overflow
+	gp.gain = gain;
+	gp.shift = srcBits - dstBits;
+	gp.rounding = gp.shift ? (1 << (gp.shift - 1)) : 0;
+	gp.maxVal = ((INT64)1 << (dstBits - 1)) - 1;
+	gp.minVal = -gp.maxVal - 1;
+	scale = (INT64)1 << gp.shift;
+	gp.clampLo = (double)(gp.minVal * scale);
+	gp.clampHi = (double)(gp.maxVal * scale);
+	// (trunc(x) + rounding) >> shift > maxVal  <=>  x >= (maxVal + 1) * scale - rounding
+	// (trunc(x) + rounding) >> shift < minVal  <=>  x <= minVal * scale - rounding - 1
+	gp.clipHi = (double)((gp.maxVal + 1) * scale - gp.rounding);
+	gp.clipLo = (double)(gp.minVal * scale - gp.rounding - 1);
+	
+	if (dither == NULL || dither->mode == DITHER_NONE || ! gp.shift)
+		return sopFuncs->applyGain(data, count, gp, NULL);
+	if (gain == 0.0 || ! isfinite(gain))
+	{
+		// The noise is scaled with 1 / gain, so it can't be used here. (A gain of 0 results in silence anyway.)
+		dither->smplPos += count;
+		return sopFuncs->applyGain(data, count, gp, NULL);
+	}
+	
+	// The noise is added to the source value before the multiplication with the gain.
+	// (This keeps the compiler from fusing it into an FMA, so all kernels return the same results.)
+	noiseScale = (double)scale / 0x10000 / gain;	// TPDF values -> +/- 1 LSB of the destination
+	overflowCnt = 0;
+	for (curVal = 0; curVal < count; curVal += chunkLen)
+	{
+		chunkLen = count - curVal;
+		if (chunkLen > DITHER_CHUNK)
+			chunkLen = DITHER_CHUNK;
+		sopFuncs->genTpdf(noise, chunkLen, dither->seed, (UINT32)dither->smplPos, noiseScale);
+		if (dither->mode == DITHER_SHAPED)
+			overflowCnt += ApplyGainShaped(&data[curVal], chunkLen, gp, noise, dither->error);
+		else
+			overflowCnt += sopFuncs->applyGain(&data[curVal], chunkLen, gp, noise);
+		dither->smplPos += chunkLen;
+	}
+	
+	return overflowCnt;
+}
+
+// first-order noise shaping: The quantization error of each sample (including the dither) is subtracted from the next one.
+// This is a recursion over the samples and thus not vectorized.
+static size_t ApplyGainShaped(INT32* data, size_t count, const GainParams& gp, const double* noise, double& error)
+{
+	const double lsbScale = (double)((INT64)1 << gp.shift);
+	size_t overflowCnt = 0;
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++)
+	{
+		double target = data[curVal] * gp.gain - error;
+		INT64 smplVal = (INT64)((data[curVal] + noise[curVal]) * gp.gain - error);
+		smplVal = (smplVal + gp.rounding) >> gp.shift;
+		if (smplVal < gp.minVal)
+		{
+			smplVal = gp.minVal;
+			overflowCnt ++;
+		}
+		else if (smplVal > gp.maxVal)
+		{
+			smplVal = gp.maxVal;
+			overflowCnt ++;
+		}
+		data[curVal] = (INT32)smplVal;
+		
+		error = smplVal * lsbScale - target;
+		// don't let clipped samples build up the error
+		if (error > 2 * lsbScale)
+			error = 2 * lsbScale;
+		else if (error < -2 * lsbScale)
+			error = -2 * lsbScale;
+	}
+	
+	return overflowCnt;
+}
+
+void GetMinMax(const INT32* data, size_t count, INT32& minVal, INT32& maxVal)
+{
+	if (! count)
+	{
+		minVal = maxVal = 0;
+		return;
+	}
+	minVal = maxVal = data[0];
+	sopFuncs->getMinMax(data, count, minVal, maxVal);
+}
+
+size_t FindValue(const INT32* data, size_t count, INT32 value)
+{
+	return sopFuncs->findValue(data, count, value);
+}
+
+double DotProduct(const float* a, const float* b, size_t count)
+{
+	return sopFuncs->dotProduct(a, b, count);
+}
+
+
+static UINT8 DetectSimdLevel(void)
+{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+	int cpuInfo[4];
+	bool osAVX = false;
+	bool osAVX512 = false;
+	
+	__cpuid(cpuInfo, 0);
+	if (cpuInfo[0] < 7)
+		return SIMD_SCALAR;
+	__cpuid(cpuInfo, 1);
+	if (! (cpuInfo[2] & (1 << 9)))
+		return SIMD_SCALAR;	// no SSSE3
+	if (cpuInfo[2] & (1 << 27))	// OSXSAVE
+	{
+		UINT64 xcr0 = _xgetbv(0);
+		osAVX = ((xcr0 & 0x06) == 0x06);	// XMM + YMM state
+		osAVX512 = ((xcr0 & 0xE6) == 0xE6);	// + opmask + ZMM state
+	}
+	if (! osAVX)
+		return SIMD_SSSE3;
+	__cpuidex(cpuInfo, 7, 0);
+	if (! (cpuInfo[1] & (1 << 5)))
+		return SIMD_SSSE3;	// no AVX2
+	if (osAVX512 && (cpuInfo[1] & (1 << 16)) && (cpuInfo[1] & (1 << 30)))
+		return SIMD_AVX512;	// AVX512F + AVX512BW
+	return SIMD_AVX2;
+#elif defined(SIMD_X86)
+	// __builtin_cpu_supports() also checks if the OS saves the AVX registers.
+	__builtin_cpu_init();
+	if (! __builtin_cpu_supports("ssse3"))
+		return SIMD_SCALAR;
+	if (! __builtin_cpu_supports("avx2"))
+		return SIMD_SSSE3;
+	if (! (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")))
+		return SIMD_AVX2;
+	return SIMD_AVX512;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+INLINE INT32 ReadLE16s(const UINT8* data)
+{
+	return (INT16)(((INT8)data[0x01] << 8) | (data[0x00] << 0));
+}
+
+INLINE INT32 ReadLE24s(const UINT8* data)
+{
+	return ((INT8)data[0x02] << 16) | (data[0x01] <<  8) | (data[0x00] <<  0);
+}
+
+// scale to 32-bit integers, round to nearest (even) and saturate to -0x7FFFFFFF .. 0x7FFFFFFF, NaN results in the minimum
+// (These match what the SIMD conversions do with the default rounding mode.)
+INLINE INT32 FloatToInt32(float value)
+{
+	float scaled = value * 2147483648.0f;
+	if (scaled >= 2147483648.0f)
+		return 0x7FFFFFFF;
+	else if (scaled > -2147483648.0f)
+		return (INT32)lrintf(scaled);
+	else
+		return -0x7FFFFFFF;
+}
+
+INLINE INT32 DoubleToInt32(double value)
+{
+	double scaled = value * 2147483648.0;
+	if (scaled >= 2147483647.0)
+		return 0x7FFFFFFF;
+	else if (scaled > -2147483647.0)
+		return (INT32)lrint(scaled);
+	else
+		return -0x7FFFFFFF;
+}
+
+INLINE UINT32 CountTrailingZeros(UINT32 val)
+{
+#ifdef _MSC_VER
+	unsigned long bitPos;
+	_BitScanForward(&bitPos, val);
+	return (UINT32)bitPos;
+#else
+	return (UINT32)__builtin_ctz(val);
+#endif
+}
+
+INLINE UINT32 CountBits(UINT32 val)
+{
+	// for the small masks of the vector compares
+	val = val - ((val >> 1) & 0x55555555);
+	val = (val & 0x33333333) + ((val >> 2) & 0x33333333);
+	val = (val + (val >> 4)) & 0x0F0F0F0F;
+	return (val * 0x01010101) >> 24;
+}
+
+// Adds up the 16 partial sums of DotProduct() in a fixed order, then adds the values that are left.
+// The products of two floats are exact with doubles, so the result is the same with all kernels, even with FMA.
+INLINE double DotProductSum(double* sums, const float* a, const float* b, size_t count)
+{
+	size_t curVal;
+	UINT8 step;
+	UINT8 curSum;
+	
+	for (step = 8; step > 0; step /= 2)
+	{
+		for (curSum = 0; curSum < step; curSum ++)
+			sums[curSum] += sums[curSum + step];
+	}
+	for (curVal = 0; curVal < count; curVal ++)
+		sums[0] += (double)a[curVal] * b[curVal];
+	
+	return sums[0];
+}
+
+INLINE UINT32 Hash32(UINT32 val)
+{
+	// "lowbias32" integer hash by Chris Wellons
+	val ^= val >> 16;
+	val *= 0x7FEB352D;
+	val ^= val >> 15;
+	val *= 0x846CA68B;
+	val ^= val >> 16;
+	return val;
+}
+
+static void Unpack8to32_Scalar(const UINT8* src, INT32* dst, size_t count)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++)
+		dst[curVal] = (INT32)src[curVal] - 0x80;
+	
+	return;
+}
+
+static void Unpack16to32_Scalar(const UINT8* src, INT32* dst, size_t count)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++, src += 2)
+		dst[curVal] = ReadLE16s(src);
+	
+	return;
+}
+
+static void Unpack24to32_Scalar(const UINT8* src, INT32* dst, size_t count)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++, src += 3)
+		dst[curVal] = ReadLE24s(src);
+	
+	return;
+}
+
+static void Pack32to24_Scalar(const INT32* src, UINT8* dst, size_t count)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++, dst += 3)
+	{
+		dst[0x00] = (src[curVal] >>  0) & 0xFF;
+		dst[0x01] = (src[curVal] >>  8) & 0xFF;
+		dst[0x02] = (src[curVal] >> 16) & 0xFF;
+	}
+	
+	return;
+}
+
+static void ConvF32to32_Scalar(const UINT8* src, INT32* dst, size_t count)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++, src += 4)
+	{
+		float value;
+		memcpy(&value, src, 4);
+		dst[curVal] = FloatToInt32(value);
+	}
+	
+	return;
+}
+
+static void ConvF64to32_Scalar(const UINT8* src, INT32* dst, size_t count)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++, src += 8)
+	{
+		double value;
+		memcpy(&value, src, 8);
+		dst[curVal] = DoubleToInt32(value);
+	}
+	
+	return;
+}
+
+static size_t FindFrameAbove_Scalar(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = start; curSmpl < end; curSmpl ++)
+	{
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			if (abs(chnData[curChn][curSmpl]) >= level)
+				return curSmpl;
+		}
+	}
+	
+	return end;
+}
+
+static size_t FindFrameBelow_Scalar(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = start; curSmpl < end; curSmpl ++)
+	{
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			if (abs(chnData[curChn][curSmpl]) >= level)
+				break;
+		}
+		if (curChn >= chnCnt)
+			return curSmpl;
+	}
+	
+	return end;
+}
+
+static INT32 GetAbsMax_Scalar(const INT32* data, size_t count)
+{
+	INT32 maxVal = 0;
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++)
+	{
+		if (maxVal < abs(data[curVal]))
+			maxVal = abs(data[curVal]);
+	}
+	
+	return maxVal;
+}
+
+static size_t ApplyGain_Scalar(INT32* data, size_t count, const GainParams& gp, const double* noise)
+{
+	size_t overflowCnt = 0;
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++)
+	{
+		double scaled = (noise != NULL) ? (data[curVal] + noise[curVal]) * gp.gain : data[curVal] * gp.gain;
+		INT64 smplVal = (INT64)scaled;
+		smplVal = (smplVal + gp.rounding) >> gp.shift;	// round with "half up" method, results in even distribution
+		if (smplVal < gp.minVal)
+		{
+			smplVal = gp.minVal;
+			overflowCnt ++;
+		}
+		else if (smplVal > gp.maxVal)
+		{
+			smplVal = gp.maxVal;
+			overflowCnt ++;
+		}
+		data[curVal] = (INT32)smplVal;
+	}
+	
+	return overflowCnt;
+}
+
+static void GetMinMax_Scalar(const INT32* data, size_t count, INT32& minVal, INT32& maxVal)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++)
+	{
+		if (data[curVal] < minVal)
+			minVal = data[curVal];
+		if (data[curVal] > maxVal)
+			maxVal = data[curVal];
+	}
+	
+	return;
+}
+
+static size_t FindValue_Scalar(const INT32* data, size_t count, INT32 value)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++)
+	{
+		if (data[curVal] == value)
+			break;
+	}
+	
+	return curVal;
+}
+
+static void GenTpdf_Scalar(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal < count; curVal ++)
+	{
+		UINT32 rnd = Hash32(Hash32(pos + (UINT32)curVal) ^ seed);
+		// The difference of two uniformly distributed values has a triangular distribution.
+		INT32 noise = (INT32)(rnd & 0xFFFF) - (INT32)(rnd >> 16);
+		dst[curVal] = noise * scale;
+	}
+	
+	return;
+}
+
+static double DotProduct_Scalar(const float* a, const float* b, size_t count)
+{
+	// 16 partial sums, like the vector kernels
+	double sums[16];
+	size_t curVal;
+	UINT8 curSum;
+	
+	for (curSum = 0; curSum < 16; curSum ++)
+		sums[curSum] = 0.0;
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		for (curSum = 0; curSum < 16; curSum ++)
+			sums[curSum] += (double)a[curVal + curSum] * b[curVal + curSum];
+	}
+	
+	return DotProductSum(sums, &a[curVal], &b[curVal], count - curVal);
+}
+
+#ifdef SIMD_X86
+// The vector loops never access memory beyond the given count, the remaining values are done by the scalar code.
+
+SIMD_TARGET("ssse3") static void Unpack8to32_SSSE3(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m128i signFlip = _mm_set1_epi8((char)0x80);
+	const __m128i zero = _mm_setzero_si128();
+	size_t curVal;
+	
+	// SSSE3 has no pmovsx, so move the values into the upper bits and shift them back arithmetically
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m128i vals = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&src[curVal]), signFlip);
+		__m128i valLo = _mm_unpacklo_epi8(zero, vals);
+		__m128i valHi = _mm_unpackhi_epi8(zero, vals);
+		_mm_storeu_si128((__m128i*)&dst[curVal + 0x0], _mm_srai_epi32(_mm_unpacklo_epi16(zero, valLo), 24));
+		_mm_storeu_si128((__m128i*)&dst[curVal + 0x4], _mm_srai_epi32(_mm_unpackhi_epi16(zero, valLo), 24));
+		_mm_storeu_si128((__m128i*)&dst[curVal + 0x8], _mm_srai_epi32(_mm_unpacklo_epi16(zero, valHi), 24));
+		_mm_storeu_si128((__m128i*)&dst[curVal + 0xC], _mm_srai_epi32(_mm_unpackhi_epi16(zero, valHi), 24));
+	}
+	Unpack8to32_Scalar(&src[curVal], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("ssse3") static void Unpack16to32_SSSE3(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+	{
+		__m128i vals = _mm_loadu_si128((const __m128i*)&src[curVal * 2]);
+		_mm_storeu_si128((__m128i*)&dst[curVal + 0], _mm_srai_epi32(_mm_unpacklo_epi16(zero, vals), 16));
+		_mm_storeu_si128((__m128i*)&dst[curVal + 4], _mm_srai_epi32(_mm_unpackhi_epi16(zero, vals), 16));
+	}
+	Unpack16to32_Scalar(&src[curVal * 2], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("ssse3") static void Unpack24to32_SSSE3(const UINT8* src, INT32* dst, size_t count)
+{
+	// move the 3 bytes of each value into the upper 24 bits, the arithmetic shift does the sign extension
+	const __m128i shufMask = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16, src += 48, dst += 16)
+	{
+		__m128i in0 = _mm_loadu_si128((const __m128i*)&src[0x00]);
+		__m128i in1 = _mm_loadu_si128((const __m128i*)&src[0x10]);
+		__m128i in2 = _mm_loadu_si128((const __m128i*)&src[0x20]);
+		__m128i v0 = in0;	// bytes 0..11
+		__m128i v1 = _mm_alignr_epi8(in1, in0, 12);	// bytes 12..23
+		__m128i v2 = _mm_alignr_epi8(in2, in1, 8);	// bytes 24..35
+		__m128i v3 = _mm_srli_si128(in2, 4);	// bytes 36..47
+		_mm_storeu_si128((__m128i*)&dst[0x00], _mm_srai_epi32(_mm_shuffle_epi8(v0, shufMask), 8));
+		_mm_storeu_si128((__m128i*)&dst[0x04], _mm_srai_epi32(_mm_shuffle_epi8(v1, shufMask), 8));
+		_mm_storeu_si128((__m128i*)&dst[0x08], _mm_srai_epi32(_mm_shuffle_epi8(v2, shufMask), 8));
+		_mm_storeu_si128((__m128i*)&dst[0x0C], _mm_srai_epi32(_mm_shuffle_epi8(v3, shufMask), 8));
+	}
+	Unpack24to32_Scalar(src, dst, count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("ssse3") static void Pack32to24_SSSE3(const INT32* src, UINT8* dst, size_t count)
+{
+	// pack the lower 3 bytes of each value into bytes 0..11, bytes 12..15 are zero
+	const __m128i shufMask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16, src += 16, dst += 48)
+	{
+		__m128i v0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[0x00]), shufMask);
+		__m128i v1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[0x04]), shufMask);
+		__m128i v2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[0x08]), shufMask);
+		__m128i v3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[0x0C]), shufMask);
+		_mm_storeu_si128((__m128i*)&dst[0x00], _mm_or_si128(v0, _mm_slli_si128(v1, 12)));
+		_mm_storeu_si128((__m128i*)&dst[0x10], _mm_or_si128(_mm_srli_si128(v1, 4), _mm_slli_si128(v2, 8)));
+		_mm_storeu_si128((__m128i*)&dst[0x20], _mm_or_si128(_mm_srli_si128(v2, 8), _mm_slli_si128(v3, 4)));
+	}
+	Pack32to24_Scalar(src, dst, count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("ssse3") static void ConvF32to32_SSSE3(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m128 scale = _mm_set1_ps(2147483648.0f);
+	const __m128i indefVal = _mm_set1_epi32((INT32)0x80000000);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 4 <= count; curVal += 4)
+	{
+		__m128 vals = _mm_mul_ps(_mm_loadu_ps((const float*)&src[curVal * 4]), scale);
+		// the conversion returns 0x80000000 for all out-of-range values, invert it for the positive ones
+		__m128i ovrMask = _mm_castps_si128(_mm_cmpge_ps(vals, scale));
+		__m128i result = _mm_xor_si128(_mm_cvtps_epi32(vals), ovrMask);
+		// The remaining ones (too small, NaN and -1.0 itself) become -0x7FFFFFFF. (SSSE3 has no pmaxsd.)
+		result = _mm_sub_epi32(result, _mm_cmpeq_epi32(result, indefVal));
+		_mm_storeu_si128((__m128i*)&dst[curVal], result);
+	}
+	ConvF32to32_Scalar(&src[curVal * 4], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("ssse3") static void ConvF64to32_SSSE3(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m128d scale = _mm_set1_pd(2147483648.0);
+	const __m128d minVal = _mm_set1_pd(-2147483647.0);
+	const __m128d maxVal = _mm_set1_pd(2147483647.0);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 4 <= count; curVal += 4)
+	{
+		__m128d valLo = _mm_mul_pd(_mm_loadu_pd((const double*)&src[curVal * 8 + 0x00]), scale);
+		__m128d valHi = _mm_mul_pd(_mm_loadu_pd((const double*)&src[curVal * 8 + 0x10]), scale);
+		// clamp (maxpd returns the 2nd operand for NaN, so that results in the minimum)
+		valLo = _mm_min_pd(_mm_max_pd(valLo, minVal), maxVal);
+		valHi = _mm_min_pd(_mm_max_pd(valHi, minVal), maxVal);
+		_mm_storeu_si128((__m128i*)&dst[curVal], _mm_unpacklo_epi64(_mm_cvtpd_epi32(valLo), _mm_cvtpd_epi32(valHi)));
+	}
+	ConvF64to32_Scalar(&src[curVal * 8], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("ssse3") static size_t FindFrameAbove_SSSE3(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	const __m128i cmpVal = _mm_set1_epi32(level - 1);
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = start; curSmpl + 4 <= end; curSmpl += 4)
+	{
+		__m128i loud = _mm_setzero_si128();
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			loud = _mm_or_si128(loud, _mm_cmpgt_epi32(_mm_abs_epi32(_mm_loadu_si128((const __m128i*)&chnData[curChn][curSmpl])), cmpVal));
+		UINT32 mask = (UINT32)_mm_movemask_ps(_mm_castsi128_ps(loud));
+		if (mask)
+			return curSmpl + CountTrailingZeros(mask);
+	}
+	
+	return FindFrameAbove_Scalar(chnData, chnCnt, curSmpl, end, level);
+}
+
+SIMD_TARGET("ssse3") static size_t FindFrameBelow_SSSE3(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	const __m128i cmpVal = _mm_set1_epi32(level - 1);
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = start; curSmpl + 4 <= end; curSmpl += 4)
+	{
+		__m128i loud = _mm_setzero_si128();
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			loud = _mm_or_si128(loud, _mm_cmpgt_epi32(_mm_abs_epi32(_mm_loadu_si128((const __m128i*)&chnData[curChn][curSmpl])), cmpVal));
+		UINT32 mask = ~(UINT32)_mm_movemask_ps(_mm_castsi128_ps(loud)) & 0x0F;
+		if (mask)
+			return curSmpl + CountTrailingZeros(mask);
+	}
+	
+	return FindFrameBelow_Scalar(chnData, chnCnt, curSmpl, end, level);
+}
+
+SIMD_TARGET("ssse3") static INT32 GetAbsMax_SSSE3(const INT32* data, size_t count)
+{
+	__m128i maxVec = _mm_setzero_si128();
+	INT32 maxVals[4];
+	size_t curVal;
+	
+	// SSSE3 has no pmaxsd, so do compare + select
+	for (curVal = 0; curVal + 4 <= count; curVal += 4)
+	{
+		__m128i absVal = _mm_abs_epi32(_mm_loadu_si128((const __m128i*)&data[curVal]));
+		__m128i isGreater = _mm_cmpgt_epi32(absVal, maxVec);
+		maxVec = _mm_or_si128(_mm_and_si128(isGreater, absVal), _mm_andnot_si128(isGreater, maxVec));
+	}
+	_mm_storeu_si128((__m128i*)maxVals, maxVec);
+	maxVals[0] = GetAbsMax_Scalar(maxVals, 4);
+	maxVals[1] = GetAbsMax_Scalar(&data[curVal], count - curVal);
+	
+	return (maxVals[0] > maxVals[1]) ? maxVals[0] : maxVals[1];
+}
+
+SIMD_TARGET("ssse3") static size_t ApplyGain_SSSE3(INT32* data, size_t count, const GainParams& gp, const double* noise)
+{
+	const __m128d gain = _mm_set1_pd(gp.gain);
+	const __m128d clampLo = _mm_set1_pd(gp.clampLo);
+	const __m128d clampHi = _mm_set1_pd(gp.clampHi);
+	const __m128d clipLo = _mm_set1_pd(gp.clipLo);
+	const __m128d clipHi = _mm_set1_pd(gp.clipHi);
+	const __m128i rounding = _mm_set1_epi32(gp.rounding);
+	const __m128i shift = _mm_cvtsi32_si128(gp.shift);
+	size_t overflowCnt = 0;
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 4 <= count; curVal += 4)
+	{
+		__m128i smpls = _mm_loadu_si128((const __m128i*)&data[curVal]);
+		__m128d valLo = _mm_cvtepi32_pd(smpls);
+		__m128d valHi = _mm_cvtepi32_pd(_mm_srli_si128(smpls, 8));
+		if (noise != NULL)
+		{
+			valLo = _mm_add_pd(valLo, _mm_loadu_pd(&noise[curVal + 0]));
+			valHi = _mm_add_pd(valHi, _mm_loadu_pd(&noise[curVal + 2]));
+		}
+		valLo = _mm_mul_pd(valLo, gain);
+		valHi = _mm_mul_pd(valHi, gain);
+		UINT32 clipMask = (UINT32)_mm_movemask_pd(_mm_or_pd(_mm_cmple_pd(valLo, clipLo), _mm_cmpge_pd(valLo, clipHi)));
+		clipMask |= (UINT32)_mm_movemask_pd(_mm_or_pd(_mm_cmple_pd(valHi, clipLo), _mm_cmpge_pd(valHi, clipHi))) << 2;
+		overflowCnt += CountBits(clipMask);
+		valLo = _mm_min_pd(_mm_max_pd(valLo, clampLo), clampHi);
+		valHi = _mm_min_pd(_mm_max_pd(valHi, clampLo), clampHi);
+		smpls = _mm_unpacklo_epi64(_mm_cvttpd_epi32(valLo), _mm_cvttpd_epi32(valHi));
+		smpls = _mm_sra_epi32(_mm_add_epi32(smpls, rounding), shift);
+		_mm_storeu_si128((__m128i*)&data[curVal], smpls);
+	}
+	overflowCnt += ApplyGain_Scalar(&data[curVal], count - curVal, gp, (noise != NULL) ? &noise[curVal] : NULL);
+	
+	return overflowCnt;
+}
+
+SIMD_TARGET("ssse3") static void GetMinMax_SSSE3(const INT32* data, size_t count, INT32& minVal, INT32& maxVal)
+{
+	__m128i minVec = _mm_set1_epi32(minVal);
+	__m128i maxVec = _mm_set1_epi32(maxVal);
+	INT32 vals[4];
+	size_t curVal;
+	
+	// SSSE3 has no pminsd/pmaxsd, so do compare + select
+	for (curVal = 0; curVal + 4 <= count; curVal += 4)
+	{
+		__m128i smpls = _mm_loadu_si128((const __m128i*)&data[curVal]);
+		__m128i isLess = _mm_cmplt_epi32(smpls, minVec);
+		__m128i isGreater = _mm_cmpgt_epi32(smpls, maxVec);
+		minVec = _mm_or_si128(_mm_and_si128(isLess, smpls), _mm_andnot_si128(isLess, minVec));
+		maxVec = _mm_or_si128(_mm_and_si128(isGreater, smpls), _mm_andnot_si128(isGreater, maxVec));
+	}
+	_mm_storeu_si128((__m128i*)vals, minVec);
+	GetMinMax_Scalar(vals, 4, minVal, maxVal);
+	_mm_storeu_si128((__m128i*)vals, maxVec);
+	GetMinMax_Scalar(vals, 4, minVal, maxVal);
+	GetMinMax_Scalar(&data[curVal], count - curVal, minVal, maxVal);
+	
+	return;
+}
+
+SIMD_TARGET("ssse3") static size_t FindValue_SSSE3(const INT32* data, size_t count, INT32 value)
+{
+	const __m128i valVec = _mm_set1_epi32(value);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 4 <= count; curVal += 4)
+	{
+		__m128i isEqual = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)&data[curVal]), valVec);
+		UINT32 mask = (UINT32)_mm_movemask_ps(_mm_castsi128_ps(isEqual));
+		if (mask)
+			return curVal + CountTrailingZeros(mask);
+	}
+	
+	return curVal + FindValue_Scalar(&data[curVal], count - curVal, value);
+}
+
+SIMD_TARGET("ssse3") INLINE __m128i MulLo32_SSSE3(__m128i a, __m128i b)
+{
+	// replacement for the SSE4.1 instruction _mm_mullo_epi32
+	__m128i prodEven = _mm_mul_epu32(a, b);
+	__m128i prodOdd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(prodEven, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(prodOdd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+SIMD_TARGET("ssse3") INLINE __m128i Hash32_SSSE3(__m128i val)
+{
+	val = _mm_xor_si128(val, _mm_srli_epi32(val, 16));
+	val = MulLo32_SSSE3(val, _mm_set1_epi32(0x7FEB352D));
+	val = _mm_xor_si128(val, _mm_srli_epi32(val, 15));
+	val = MulLo32_SSSE3(val, _mm_set1_epi32((INT32)0x846CA68B));
+	val = _mm_xor_si128(val, _mm_srli_epi32(val, 16));
+	return val;
+}
+
+SIMD_TARGET("ssse3") static void GenTpdf_SSSE3(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale)
+{
+	const __m128i seedVec = _mm_set1_epi32((INT32)seed);
+	const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+	const __m128d scaleVec = _mm_set1_pd(scale);
+	__m128i posVec = _mm_add_epi32(_mm_set1_epi32((INT32)pos), _mm_setr_epi32(0, 1, 2, 3));
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 4 <= count; curVal += 4)
+	{
+		__m128i rnd = Hash32_SSSE3(_mm_xor_si128(Hash32_SSSE3(posVec), seedVec));
+		__m128i noise = _mm_sub_epi32(_mm_and_si128(rnd, lowMask), _mm_srli_epi32(rnd, 16));
+		_mm_storeu_pd(&dst[curVal + 0], _mm_mul_pd(_mm_cvtepi32_pd(noise), scaleVec));
+		_mm_storeu_pd(&dst[curVal + 2], _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(noise, 8)), scaleVec));
+		posVec = _mm_add_epi32(posVec, _mm_set1_epi32(4));
+	}
+	GenTpdf_Scalar(&dst[curVal], count - curVal, seed, pos + (UINT32)curVal, scale);
+	
+	return;
+}
+
+SIMD_TARGET("ssse3") static double DotProduct_SSSE3(const float* a, const float* b, size_t count)
+{
+	__m128d accum[8];
+	double sums[16];
+	size_t curVal;
+	UINT8 curAcc;
+	
+	for (curAcc = 0; curAcc < 8; curAcc ++)
+		accum[curAcc] = _mm_setzero_pd();
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		for (curAcc = 0; curAcc < 8; curAcc += 2)
+		{
+			__m128 valA = _mm_loadu_ps(&a[curVal + curAcc * 2]);
+			__m128 valB = _mm_loadu_ps(&b[curVal + curAcc * 2]);
+			accum[curAcc + 0] = _mm_add_pd(accum[curAcc + 0], _mm_mul_pd(_mm_cvtps_pd(valA), _mm_cvtps_pd(valB)));
+			accum[curAcc + 1] = _mm_add_pd(accum[curAcc + 1], _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(valA, valA)), _mm_cvtps_pd(_mm_movehl_ps(valB, valB))));
+		}
+	}
+	for (curAcc = 0; curAcc < 8; curAcc ++)
+		_mm_storeu_pd(&sums[curAcc * 2], accum[curAcc]);
+	
+	return DotProductSum(sums, &a[curVal], &b[curVal], count - curVal);
+}
+
+SIMD_TARGET("avx2") static void Unpack8to32_AVX2(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m128i signFlip = _mm_set1_epi8((char)0x80);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m128i vals = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&src[curVal]), signFlip);
+		_mm256_storeu_si256((__m256i*)&dst[curVal + 0], _mm256_cvtepi8_epi32(vals));
+		_mm256_storeu_si256((__m256i*)&dst[curVal + 8], _mm256_cvtepi8_epi32(_mm_srli_si128(vals, 8)));
+	}
+	Unpack8to32_Scalar(&src[curVal], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx2") static void Unpack16to32_AVX2(const UINT8* src, INT32* dst, size_t count)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+		_mm256_storeu_si256((__m256i*)&dst[curVal], _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&src[curVal * 2])));
+	Unpack16to32_Scalar(&src[curVal * 2], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx2") static void Unpack24to32_AVX2(const UINT8* src, INT32* dst, size_t count)
+{
+	// The byte shuffle works within 128-bit lanes, so first give each lane the 12 bytes it needs.
+	const __m256i shufMask = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m256i lanesLo = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+	const __m256i lanesHi = _mm256_setr_epi32(2, 3, 4, 0, 5, 6, 7, 0);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16, src += 48, dst += 16)
+	{
+		__m256i in0 = _mm256_loadu_si256((const __m256i*)&src[0x00]);	// bytes 0..31
+		__m128i in1 = _mm_loadu_si128((const __m128i*)&src[0x20]);	// bytes 32..47
+		__m256i in2 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_extracti128_si256(in0, 1)), in1, 1);	// bytes 16..47
+		__m256i v0 = _mm256_permutevar8x32_epi32(in0, lanesLo);	// bytes 0..23
+		__m256i v1 = _mm256_permutevar8x32_epi32(in2, lanesHi);	// bytes 24..47
+		_mm256_storeu_si256((__m256i*)&dst[0x00], _mm256_srai_epi32(_mm256_shuffle_epi8(v0, shufMask), 8));
+		_mm256_storeu_si256((__m256i*)&dst[0x08], _mm256_srai_epi32(_mm256_shuffle_epi8(v1, shufMask), 8));
+	}
+	Unpack24to32_Scalar(src, dst, count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx2") static void Pack32to24_AVX2(const INT32* src, UINT8* dst, size_t count)
+{
+	const __m256i shufMask = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i lanesPack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8, src += 8, dst += 24)
+	{
+		__m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)src), shufMask);
+		v = _mm256_permutevar8x32_epi32(v, lanesPack);	// bytes 0..23 are valid now
+		_mm_storeu_si128((__m128i*)&dst[0x00], _mm256_castsi256_si128(v));
+		_mm_storel_epi64((__m128i*)&dst[0x10], _mm256_extracti128_si256(v, 1));
+	}
+	Pack32to24_Scalar(src, dst, count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx2") static void ConvF32to32_AVX2(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(2147483648.0f);
+	const __m256i minVal = _mm256_set1_epi32(-0x7FFFFFFF);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+	{
+		__m256 vals = _mm256_mul_ps(_mm256_loadu_ps((const float*)&src[curVal * 4]), scale);
+		__m256i ovrMask = _mm256_castps_si256(_mm256_cmp_ps(vals, scale, _CMP_GE_OQ));
+		_mm256_storeu_si256((__m256i*)&dst[curVal], _mm256_max_epi32(_mm256_xor_si256(_mm256_cvtps_epi32(vals), ovrMask), minVal));
+	}
+	ConvF32to32_Scalar(&src[curVal * 4], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx2") static void ConvF64to32_AVX2(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m256d scale = _mm256_set1_pd(2147483648.0);
+	const __m256d minVal = _mm256_set1_pd(-2147483647.0);
+	const __m256d maxVal = _mm256_set1_pd(2147483647.0);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+	{
+		__m256d valLo = _mm256_mul_pd(_mm256_loadu_pd((const double*)&src[curVal * 8 + 0x00]), scale);
+		__m256d valHi = _mm256_mul_pd(_mm256_loadu_pd((const double*)&src[curVal * 8 + 0x20]), scale);
+		valLo = _mm256_min_pd(_mm256_max_pd(valLo, minVal), maxVal);
+		valHi = _mm256_min_pd(_mm256_max_pd(valHi, minVal), maxVal);
+		_mm256_storeu_si256((__m256i*)&dst[curVal],
+			_mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvtpd_epi32(valLo)), _mm256_cvtpd_epi32(valHi), 1));
+	}
+	ConvF64to32_Scalar(&src[curVal * 8], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx2") static size_t FindFrameAbove_AVX2(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	const __m256i cmpVal = _mm256_set1_epi32(level - 1);
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = start; curSmpl + 8 <= end; curSmpl += 8)
+	{
+		__m256i loud = _mm256_setzero_si256();
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			loud = _mm256_or_si256(loud, _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_loadu_si256((const __m256i*)&chnData[curChn][curSmpl])), cmpVal));
+		UINT32 mask = (UINT32)_mm256_movemask_ps(_mm256_castsi256_ps(loud));
+		if (mask)
+			return curSmpl + CountTrailingZeros(mask);
+	}
+	
+	return FindFrameAbove_Scalar(chnData, chnCnt, curSmpl, end, level);
+}
+
+SIMD_TARGET("avx2") static size_t FindFrameBelow_AVX2(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	const __m256i cmpVal = _mm256_set1_epi32(level - 1);
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = start; curSmpl + 8 <= end; curSmpl += 8)
+	{
+		__m256i loud = _mm256_setzero_si256();
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			loud = _mm256_or_si256(loud, _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_loadu_si256((const __m256i*)&chnData[curChn][curSmpl])), cmpVal));
+		UINT32 mask = ~(UINT32)_mm256_movemask_ps(_mm256_castsi256_ps(loud)) & 0xFF;
+		if (mask)
+			return curSmpl + CountTrailingZeros(mask);
+	}
+	
+	return FindFrameBelow_Scalar(chnData, chnCnt, curSmpl, end, level);
+}
+
+SIMD_TARGET("avx2") static INT32 GetAbsMax_AVX2(const INT32* data, size_t count)
+{
+	__m256i maxVec = _mm256_setzero_si256();
+	INT32 maxVals[8];
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+		maxVec = _mm256_max_epi32(maxVec, _mm256_abs_epi32(_mm256_loadu_si256((const __m256i*)&data[curVal])));
+	_mm256_storeu_si256((__m256i*)maxVals, maxVec);
+	maxVals[0] = GetAbsMax_Scalar(maxVals, 8);
+	maxVals[1] = GetAbsMax_Scalar(&data[curVal], count - curVal);
+	
+	return (maxVals[0] > maxVals[1]) ? maxVals[0] : maxVals[1];
+}
+
+SIMD_TARGET("avx2") static size_t ApplyGain_AVX2(INT32* data, size_t count, const GainParams& gp, const double* noise)
+{
+	const __m256d gain = _mm256_set1_pd(gp.gain);
+	const __m256d clampLo = _mm256_set1_pd(gp.clampLo);
+	const __m256d clampHi = _mm256_set1_pd(gp.clampHi);
+	const __m256d clipLo = _mm256_set1_pd(gp.clipLo);
+	const __m256d clipHi = _mm256_set1_pd(gp.clipHi);
+	const __m256i rounding = _mm256_set1_epi32(gp.rounding);
+	const __m128i shift = _mm_cvtsi32_si128(gp.shift);
+	size_t overflowCnt = 0;
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+	{
+		__m256i smpls = _mm256_loadu_si256((const __m256i*)&data[curVal]);
+		__m256d valLo = _mm256_cvtepi32_pd(_mm256_castsi256_si128(smpls));
+		__m256d valHi = _mm256_cvtepi32_pd(_mm256_extracti128_si256(smpls, 1));
+		if (noise != NULL)
+		{
+			valLo = _mm256_add_pd(valLo, _mm256_loadu_pd(&noise[curVal + 0]));
+			valHi = _mm256_add_pd(valHi, _mm256_loadu_pd(&noise[curVal + 4]));
+		}
+		valLo = _mm256_mul_pd(valLo, gain);
+		valHi = _mm256_mul_pd(valHi, gain);
+		UINT32 clipMask = (UINT32)_mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(valLo, clipLo, _CMP_LE_OQ), _mm256_cmp_pd(valLo, clipHi, _CMP_GE_OQ)));
+		clipMask |= (UINT32)_mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(valHi, clipLo, _CMP_LE_OQ), _mm256_cmp_pd(valHi, clipHi, _CMP_GE_OQ))) << 4;
+		overflowCnt += CountBits(clipMask);
+		valLo = _mm256_min_pd(_mm256_max_pd(valLo, clampLo), clampHi);
+		valHi = _mm256_min_pd(_mm256_max_pd(valHi, clampLo), clampHi);
+		smpls = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(valLo)), _mm256_cvttpd_epi32(valHi), 1);
+		smpls = _mm256_sra_epi32(_mm256_add_epi32(smpls, rounding), shift);
+		_mm256_storeu_si256((__m256i*)&data[curVal], smpls);
+	}
+	overflowCnt += ApplyGain_Scalar(&data[curVal], count - curVal, gp, (noise != NULL) ? &noise[curVal] : NULL);
+	
+	return overflowCnt;
+}
+
+SIMD_TARGET("avx2") static void GetMinMax_AVX2(const INT32* data, size_t count, INT32& minVal, INT32& maxVal)
+{
+	__m256i minVec = _mm256_set1_epi32(minVal);
+	__m256i maxVec = _mm256_set1_epi32(maxVal);
+	INT32 vals[8];
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+	{
+		__m256i smpls = _mm256_loadu_si256((const __m256i*)&data[curVal]);
+		minVec = _mm256_min_epi32(minVec, smpls);
+		maxVec = _mm256_max_epi32(maxVec, smpls);
+	}
+	_mm256_storeu_si256((__m256i*)vals, minVec);
+	GetMinMax_Scalar(vals, 8, minVal, maxVal);
+	_mm256_storeu_si256((__m256i*)vals, maxVec);
+	GetMinMax_Scalar(vals, 8, minVal, maxVal);
+	GetMinMax_Scalar(&data[curVal], count - curVal, minVal, maxVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx2") static size_t FindValue_AVX2(const INT32* data, size_t count, INT32 value)
+{
+	const __m256i valVec = _mm256_set1_epi32(value);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+	{
+		__m256i isEqual = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)&data[curVal]), valVec);
+		UINT32 mask = (UINT32)_mm256_movemask_ps(_mm256_castsi256_ps(isEqual));
+		if (mask)
+			return curVal + CountTrailingZeros(mask);
+	}
+	
+	return curVal + FindValue_Scalar(&data[curVal], count - curVal, value);
+}
+
+SIMD_TARGET("avx2") INLINE __m256i Hash32_AVX2(__m256i val)
+{
+	val = _mm256_xor_si256(val, _mm256_srli_epi32(val, 16));
+	val = _mm256_mullo_epi32(val, _mm256_set1_epi32(0x7FEB352D));
+	val = _mm256_xor_si256(val, _mm256_srli_epi32(val, 15));
+	val = _mm256_mullo_epi32(val, _mm256_set1_epi32((INT32)0x846CA68B));
+	val = _mm256_xor_si256(val, _mm256_srli_epi32(val, 16));
+	return val;
+}
+
+SIMD_TARGET("avx2") static void GenTpdf_AVX2(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale)
+{
+	const __m256i seedVec = _mm256_set1_epi32((INT32)seed);
+	const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+	const __m256d scaleVec = _mm256_set1_pd(scale);
+	__m256i posVec = _mm256_add_epi32(_mm256_set1_epi32((INT32)pos), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 8 <= count; curVal += 8)
+	{
+		__m256i rnd = Hash32_AVX2(_mm256_xor_si256(Hash32_AVX2(posVec), seedVec));
+		__m256i noise = _mm256_sub_epi32(_mm256_and_si256(rnd, lowMask), _mm256_srli_epi32(rnd, 16));
+		_mm256_storeu_pd(&dst[curVal + 0], _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(noise)), scaleVec));
+		_mm256_storeu_pd(&dst[curVal + 4], _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(noise, 1)), scaleVec));
+		posVec = _mm256_add_epi32(posVec, _mm256_set1_epi32(8));
+	}
+	GenTpdf_Scalar(&dst[curVal], count - curVal, seed, pos + (UINT32)curVal, scale);
+	
+	return;
+}
+
+SIMD_TARGET("avx2") static double DotProduct_AVX2(const float* a, const float* b, size_t count)
+{
+	__m256d accum[4];
+	double sums[16];
+	size_t curVal;
+	UINT8 curAcc;
+	
+	for (curAcc = 0; curAcc < 4; curAcc ++)
+		accum[curAcc] = _mm256_setzero_pd();
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		for (curAcc = 0; curAcc < 4; curAcc += 2)
+		{
+			__m256 valA = _mm256_loadu_ps(&a[curVal + curAcc * 4]);
+			__m256 valB = _mm256_loadu_ps(&b[curVal + curAcc * 4]);
+			accum[curAcc + 0] = _mm256_add_pd(accum[curAcc + 0], _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(valA)), _mm256_cvtps_pd(_mm256_castps256_ps128(valB))));
+			accum[curAcc + 1] = _mm256_add_pd(accum[curAcc + 1], _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(valA, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(valB, 1))));
+		}
+	}
+	for (curAcc = 0; curAcc < 4; curAcc ++)
+		_mm256_storeu_pd(&sums[curAcc * 4], accum[curAcc]);
+	
+	return DotProductSum(sums, &a[curVal], &b[curVal], count - curVal);
+}
+
+#if defined(__GNUC__) && ! defined(__clang__)
+// GCC 12 warns about the "undefined" registers that its own AVX-512 intrinsics use internally.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+SIMD_TARGET("avx512f,avx512bw") static void Unpack8to32_AVX512(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m128i signFlip = _mm_set1_epi8((char)0x80);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m128i vals = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&src[curVal]), signFlip);
+		_mm512_storeu_si512(&dst[curVal], _mm512_cvtepi8_epi32(vals));
+	}
+	Unpack8to32_Scalar(&src[curVal], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static void Unpack16to32_AVX512(const UINT8* src, INT32* dst, size_t count)
+{
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+		_mm512_storeu_si512(&dst[curVal], _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)&src[curVal * 2])));
+	Unpack16to32_Scalar(&src[curVal * 2], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static void Unpack24to32_AVX512(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m512i shufMask = _mm512_broadcast_i32x4(_mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11));
+	const __m512i lanesIdx = _mm512_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0, 6, 7, 8, 0, 9, 10, 11, 0);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16, src += 48, dst += 16)
+	{
+		__m512i v = _mm512_maskz_loadu_epi32(0x0FFF, src);	// exactly 48 bytes
+		v = _mm512_permutexvar_epi32(lanesIdx, v);
+		_mm512_storeu_si512(dst, _mm512_srai_epi32(_mm512_shuffle_epi8(v, shufMask), 8));
+	}
+	Unpack24to32_Scalar(src, dst, count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static void Pack32to24_AVX512(const INT32* src, UINT8* dst, size_t count)
+{
+	const __m512i shufMask = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+	const __m512i lanesIdx = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 3, 7, 11, 15);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16, src += 16, dst += 48)
+	{
+		__m512i v = _mm512_shuffle_epi8(_mm512_loadu_si512(src), shufMask);
+		v = _mm512_permutexvar_epi32(lanesIdx, v);
+		_mm512_mask_storeu_epi32(dst, 0x0FFF, v);	// exactly 48 bytes
+	}
+	Pack32to24_Scalar(src, dst, count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static void ConvF32to32_AVX512(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m512 scale = _mm512_set1_ps(2147483648.0f);
+	const __m512i minVal = _mm512_set1_epi32(-0x7FFFFFFF);
+	const __m512i maxVal = _mm512_set1_epi32(0x7FFFFFFF);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m512 vals = _mm512_mul_ps(_mm512_loadu_ps(&src[curVal * 4]), scale);
+		__mmask16 ovrMask = _mm512_cmp_ps_mask(vals, scale, _CMP_GE_OQ);
+		_mm512_storeu_si512(&dst[curVal], _mm512_max_epi32(_mm512_mask_mov_epi32(_mm512_cvtps_epi32(vals), ovrMask, maxVal), minVal));
+	}
+	ConvF32to32_Scalar(&src[curVal * 4], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static void ConvF64to32_AVX512(const UINT8* src, INT32* dst, size_t count)
+{
+	const __m512d scale = _mm512_set1_pd(2147483648.0);
+	const __m512d minVal = _mm512_set1_pd(-2147483647.0);
+	const __m512d maxVal = _mm512_set1_pd(2147483647.0);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m512d valLo = _mm512_mul_pd(_mm512_loadu_pd(&src[curVal * 8 + 0x00]), scale);
+		__m512d valHi = _mm512_mul_pd(_mm512_loadu_pd(&src[curVal * 8 + 0x40]), scale);
+		valLo = _mm512_min_pd(_mm512_max_pd(valLo, minVal), maxVal);
+		valHi = _mm512_min_pd(_mm512_max_pd(valHi, minVal), maxVal);
+		_mm512_storeu_si512(&dst[curVal],
+			_mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtpd_epi32(valLo)), _mm512_cvtpd_epi32(valHi), 1));
+	}
+	ConvF64to32_Scalar(&src[curVal * 8], &dst[curVal], count - curVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static size_t FindFrameAbove_AVX512(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	const __m512i cmpVal = _mm512_set1_epi32(level - 1);
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = start; curSmpl + 16 <= end; curSmpl += 16)
+	{
+		__mmask16 loud = 0;
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			loud |= _mm512_cmpgt_epi32_mask(_mm512_abs_epi32(_mm512_loadu_si512(&chnData[curChn][curSmpl])), cmpVal);
+		UINT32 mask = (UINT32)loud;
+		if (mask)
+			return curSmpl + CountTrailingZeros(mask);
+	}
+	
+	return FindFrameAbove_Scalar(chnData, chnCnt, curSmpl, end, level);
+}
+
+SIMD_TARGET("avx512f,avx512bw") static size_t FindFrameBelow_AVX512(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level)
+{
+	const __m512i cmpVal = _mm512_set1_epi32(level - 1);
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = start; curSmpl + 16 <= end; curSmpl += 16)
+	{
+		__mmask16 loud = 0;
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			loud |= _mm512_cmpgt_epi32_mask(_mm512_abs_epi32(_mm512_loadu_si512(&chnData[curChn][curSmpl])), cmpVal);
+		UINT32 mask = ~(UINT32)loud & 0xFFFF;
+		if (mask)
+			return curSmpl + CountTrailingZeros(mask);
+	}
+	
+	return FindFrameBelow_Scalar(chnData, chnCnt, curSmpl, end, level);
+}
+
+SIMD_TARGET("avx512f,avx512bw") static INT32 GetAbsMax_AVX512(const INT32* data, size_t count)
+{
+	__m512i maxVec = _mm512_setzero_si512();
+	INT32 maxVal;
+	INT32 tailMax;
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+		maxVec = _mm512_max_epi32(maxVec, _mm512_abs_epi32(_mm512_loadu_si512(&data[curVal])));
+	maxVal = _mm512_reduce_max_epi32(maxVec);
+	tailMax = GetAbsMax_Scalar(&data[curVal], count - curVal);
+	
+	return (maxVal > tailMax) ? maxVal : tailMax;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static size_t ApplyGain_AVX512(INT32* data, size_t count, const GainParams& gp, const double* noise)
+{
+	const __m512d gain = _mm512_set1_pd(gp.gain);
+	const __m512d clampLo = _mm512_set1_pd(gp.clampLo);
+	const __m512d clampHi = _mm512_set1_pd(gp.clampHi);
+	const __m512d clipLo = _mm512_set1_pd(gp.clipLo);
+	const __m512d clipHi = _mm512_set1_pd(gp.clipHi);
+	const __m512i rounding = _mm512_set1_epi32(gp.rounding);
+	const __m128i shift = _mm_cvtsi32_si128(gp.shift);
+	size_t overflowCnt = 0;
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m512i smpls = _mm512_loadu_si512(&data[curVal]);
+		__m512d valLo = _mm512_cvtepi32_pd(_mm512_castsi512_si256(smpls));
+		__m512d valHi = _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(smpls, 1));
+		if (noise != NULL)
+		{
+			valLo = _mm512_add_pd(valLo, _mm512_loadu_pd(&noise[curVal + 0]));
+			valHi = _mm512_add_pd(valHi, _mm512_loadu_pd(&noise[curVal + 8]));
+		}
+		valLo = _mm512_mul_pd(valLo, gain);
+		valHi = _mm512_mul_pd(valHi, gain);
+		UINT32 clipMask = (UINT32)(_mm512_cmp_pd_mask(valLo, clipLo, _CMP_LE_OQ) | _mm512_cmp_pd_mask(valLo, clipHi, _CMP_GE_OQ));
+		clipMask |= (UINT32)(_mm512_cmp_pd_mask(valHi, clipLo, _CMP_LE_OQ) | _mm512_cmp_pd_mask(valHi, clipHi, _CMP_GE_OQ)) << 8;
+		overflowCnt += CountBits(clipMask);
+		valLo = _mm512_min_pd(_mm512_max_pd(valLo, clampLo), clampHi);
+		valHi = _mm512_min_pd(_mm512_max_pd(valHi, clampLo), clampHi);
+		smpls = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvttpd_epi32(valLo)), _mm512_cvttpd_epi32(valHi), 1);
+		smpls = _mm512_sra_epi32(_mm512_add_epi32(smpls, rounding), shift);
+		_mm512_storeu_si512(&data[curVal], smpls);
+	}
+	overflowCnt += ApplyGain_Scalar(&data[curVal], count - curVal, gp, (noise != NULL) ? &noise[curVal] : NULL);
+	
+	return overflowCnt;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static void GetMinMax_AVX512(const INT32* data, size_t count, INT32& minVal, INT32& maxVal)
+{
+	__m512i minVec = _mm512_set1_epi32(minVal);
+	__m512i maxVec = _mm512_set1_epi32(maxVal);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m512i smpls = _mm512_loadu_si512(&data[curVal]);
+		minVec = _mm512_min_epi32(minVec, smpls);
+		maxVec = _mm512_max_epi32(maxVec, smpls);
+	}
+	minVal = _mm512_reduce_min_epi32(minVec);
+	maxVal = _mm512_reduce_max_epi32(maxVec);
+	GetMinMax_Scalar(&data[curVal], count - curVal, minVal, maxVal);
+	
+	return;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static size_t FindValue_AVX512(const INT32* data, size_t count, INT32 value)
+{
+	const __m512i valVec = _mm512_set1_epi32(value);
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		UINT32 mask = (UINT32)_mm512_cmpeq_epi32_mask(_mm512_loadu_si512(&data[curVal]), valVec);
+		if (mask)
+			return curVal + CountTrailingZeros(mask);
+	}
+	
+	return curVal + FindValue_Scalar(&data[curVal], count - curVal, value);
+}
+
+SIMD_TARGET("avx512f,avx512bw") INLINE __m512i Hash32_AVX512(__m512i val)
+{
+	val = _mm512_xor_si512(val, _mm512_srli_epi32(val, 16));
+	val = _mm512_mullo_epi32(val, _mm512_set1_epi32(0x7FEB352D));
+	val = _mm512_xor_si512(val, _mm512_srli_epi32(val, 15));
+	val = _mm512_mullo_epi32(val, _mm512_set1_epi32((INT32)0x846CA68B));
+	val = _mm512_xor_si512(val, _mm512_srli_epi32(val, 16));
+	return val;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static void GenTpdf_AVX512(double* dst, size_t count, UINT32 seed, UINT32 pos, double scale)
+{
+	const __m512i seedVec = _mm512_set1_epi32((INT32)seed);
+	const __m512i lowMask = _mm512_set1_epi32(0xFFFF);
+	const __m512d scaleVec = _mm512_set1_pd(scale);
+	__m512i posVec = _mm512_add_epi32(_mm512_set1_epi32((INT32)pos), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m512i rnd = Hash32_AVX512(_mm512_xor_si512(Hash32_AVX512(posVec), seedVec));
+		__m512i noise = _mm512_sub_epi32(_mm512_and_si512(rnd, lowMask), _mm512_srli_epi32(rnd, 16));
+		_mm512_storeu_pd(&dst[curVal + 0], _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(noise)), scaleVec));
+		_mm512_storeu_pd(&dst[curVal + 8], _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(noise, 1)), scaleVec));
+		posVec = _mm512_add_epi32(posVec, _mm512_set1_epi32(16));
+	}
+	GenTpdf_Scalar(&dst[curVal], count - curVal, seed, pos + (UINT32)curVal, scale);
+	
+	return;
+}
+
+SIMD_TARGET("avx512f,avx512bw") static double DotProduct_AVX512(const float* a, const float* b, size_t count)
+{
+	__m512d accumLo = _mm512_setzero_pd();
+	__m512d accumHi = _mm512_setzero_pd();
+	double sums[16];
+	size_t curVal;
+	
+	for (curVal = 0; curVal + 16 <= count; curVal += 16)
+	{
+		__m512 valA = _mm512_loadu_ps(&a[curVal]);
+		__m512 valB = _mm512_loadu_ps(&b[curVal]);
+		accumLo = _mm512_add_pd(accumLo, _mm512_mul_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(valA)), _mm512_cvtps_pd(_mm512_castps512_ps256(valB))));
+		accumHi = _mm512_add_pd(accumHi, _mm512_mul_pd(_mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(valA), 1))),
+			_mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(valB), 1)))));
+	}
+	_mm512_storeu_pd(&sums[0], accumLo);
+	_mm512_storeu_pd(&sums[8], accumHi);
+	
+	return DotProductSum(sums, &a[curVal], &b[curVal], count - curVal);
+}
+
+#if defined(__GNUC__) && ! defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif	// SIMD_X86
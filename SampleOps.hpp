@@ -0,0 +1,69 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#ifndef __SAMPLEOPS_HPP__
+#define __SAMPLEOPS_HPP__
+
+#include <stddef.h>	// for size_t
+#include "stdtype.h"
+
+// SIMD levels
+#define SIMD_SCALAR	0x00
+#define SIMD_SSSE3	0x01
+#define SIMD_AVX2	0x02
+#define SIMD_AVX512	0x03	// AVX-512 F + BW
+
+// The kernels are selected at startup based on the CPU features.
+UINT8 GetSimdLevel(void);
+// Use a lower SIMD level. (mainly for comparing kernels) Returns the level that is actually used.
+UINT8 SetSimdLevel(UINT8 level);
+const char* GetSimdLevelName(UINT8 level);
+
+// 8-bit unsigned PCM -> 32-bit integers (value - 0x80)
+void Unpack8to32(const UINT8* src, INT32* dst, size_t count);
+// 16-bit little-endian PCM -> sign-extended 32-bit integers
+void Unpack16to32(const UINT8* src, INT32* dst, size_t count);
+// 24-bit little-endian PCM -> sign-extended 32-bit integers
+void Unpack24to32(const UINT8* src, INT32* dst, size_t count);
+// 32-bit integers -> 24-bit little-endian PCM (the upper 8 bits are discarded)
+void Pack32to24(const INT32* src, UINT8* dst, size_t count);
+// little-endian IEEE float (-1.0 .. +1.0) -> 32-bit integers (rounded to nearest, saturated to -0x7FFFFFFF .. 0x7FFFFFFF)
+// -0x80000000 is never returned, so that abs() works on the results.
+void ConvF32to32(const UINT8* src, INT32* dst, size_t count);
+void ConvF64to32(const UINT8* src, INT32* dst, size_t count);
+
+// Search frames [start, end) of planar data.
+// Above: returns the first frame where any channel has abs(value) >= level.
+// Below: returns the first frame where all channels have abs(value) < level.
+// Both return end when there is no such frame.
+// The data must not contain -0x80000000 (abs() can't represent it), which the sample decoders ensure.
+size_t FindFrameAbove(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+size_t FindFrameBelow(const INT32* const* chnData, UINT16 chnCnt, size_t start, size_t end, INT32 level);
+// largest abs(value), 0 for count == 0
+INT32 GetAbsMax(const INT32* data, size_t count);
+// smallest and largest value, both 0 for count == 0
+void GetMinMax(const INT32* data, size_t count, INT32& minVal, INT32& maxVal);
+// returns the index of the first occurrence of value, count if there is none
+size_t FindValue(const INT32* data, size_t count, INT32 value);
+// sum of a[i] * b[i], calculated with doubles (The result doesn't depend on the SIMD level.)
+double DotProduct(const float* a, const float* b, size_t count);
+
+// dither modes
+#define DITHER_NONE		0x00
+#define DITHER_TPDF		0x01	// triangular noise, +/- 1 LSB of the destination bit depth
+#define DITHER_SHAPED	0x02	// TPDF with first-order error feedback, moves the noise to higher frequencies
+
+// dither state of a channel, carried over to the next block
+struct DitherState
+{
+	UINT8 mode;
+	UINT32 seed;	// The noise depends only on the seed and the sample position.
+	UINT64 smplPos;
+	double error;	// noise shaping: quantization error of the previous sample
+};
+
+// Multiplies with the gain and reduces the bit depth from srcBits to dstBits (rounding half up).
+// The result is clipped to the range of dstBits. Returns the number of clipped values.
+// When the bit depth is reduced, dither noise is added according to the dither state. (optional)
+size_t ApplyGain(INT32* data, size_t count, double gain, UINT8 srcBits, UINT8 dstBits, DitherState* dither = NULL);
+
+#endif	// __SAMPLEOPS_HPP__
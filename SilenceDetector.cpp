@@ -0,0 +1,268 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <stddef.h>
+#include <stdlib.h>	// for abs()
+#include <vector>
+#include "stdtype.h"
+
+#include "SilenceDetector.hpp"
+#include "SampleOps.hpp"
+
+#define OUTLIER_SMPLS	10	// songs shorter than this are outliers
+
+
+SilenceDetector::SilenceDetector() :
+	_channels(1),
+	_silenceVal(0),
+	_splitSmpls(0),
+	_isPart(false),
+	_smplPos(0),
+	_silenceCnt(0),
+	_songSilence(0),
+	_songID((UINT32)-1),
+	_songStart(0),
+	_songPeak(0)
+{
+}
+
+void SilenceDetector::Init(UINT16 channels, INT32 silenceVal, UINT32 splitSmpls)
+{
+	_channels = channels;
+	_silenceVal = silenceVal;
+	_splitSmpls = splitSmpls;
+	return;
+}
+
+void SilenceDetector::SetCallback(const SilenceCallback& callback)
+{
+	_callback = callback;
+	return;
+}
+
+void SilenceDetector::Start(UINT64 smplPos, UINT32 initSilence)
+{
+	_isPart = false;
+	_smplPos = smplPos;
+	_loud.clear();
+	_silenceCnt = 0;
+	_songSilence = initSilence;
+	_songID = (UINT32)-1;	// make first ID 0 even with pre-increment
+	_songStart = 0;
+	_songPeak = 0;
+	return;
+}
+
+void SilenceDetector::StartPart(UINT64 smplPos)
+{
+	_isPart = true;
+	_smplPos = smplPos;
+	_loud.clear();
+	_silenceCnt = 0;
+	return;
+}
+
+void SilenceDetector::ProcessBlock(const INT32* const* chnData, size_t smplCount)
+{
+	if (_isPart)
+	{
+		ScanBlock(chnData, smplCount);
+		return;
+	}
+	
+	// handle the block like a part that is appended right away
+	_loud.clear();
+	_silenceCnt = 0;
+	ScanBlock(chnData, smplCount);
+	AddIntervals(_loud, _silenceCnt);
+	
+	return;
+}
+
+void SilenceDetector::AddSilence(UINT64 smplCount)
+{
+	if (_isPart)
+		_silenceCnt += smplCount * _channels;
+	else
+		AddIntervals(std::vector<LoudInterval>(), smplCount * _channels);
+	_smplPos += smplCount;
+	
+	return;
+}
+
+void SilenceDetector::AddLoud(UINT64 smplCount, INT32 peak)
+{
+	// The frames continue the current loud interval, so the silence is always shorter than a split.
+	if (_isPart)
+	{
+		if (_loud.back().peak < peak)
+			_loud.back().peak = peak;
+		_silenceCnt = 0;
+	}
+	else
+	{
+		if (_songPeak < peak)
+			_songPeak = peak;
+		_songSilence = 0;
+	}
+	_smplPos += smplCount;
+	
+	return;
+}
+
+void SilenceDetector::Append(const SilenceDetector& part)
+{
+	AddIntervals(part._loud, part._silenceCnt);
+	_smplPos = part._smplPos;
+	return;
+}
+
+void SilenceDetector::Finish(void)
+{
+	if (_songStart)
+	{
+		SilenceEvent evt;
+		evt.type = SDET_SONG;
+		evt.songID = _songID;
+		evt.smplStart = _songStart;
+		evt.smplEnd = _smplPos - _songSilence / _channels + 1;
+		evt.peak = _songPeak;
+		if (_callback)
+			_callback(evt);
+		_songStart = 0;
+	}
+	
+	return;
+}
+
+UINT64 SilenceDetector::GetPosition(void) const
+{
+	return _smplPos;
+}
+
+const std::vector<LoudInterval>& SilenceDetector::GetLoudIntervals(void) const
+{
+	return _loud;
+}
+
+UINT64 SilenceDetector::GetTrailingSilence(void) const
+{
+	return _silenceCnt;
+}
+
+void SilenceDetector::ScanBlock(const INT32* const* chnData, size_t smplCount)
+{
+	size_t curSmpl;
+	size_t nextSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = 0; curSmpl < smplCount; )
+	{
+		// skip the silence in one go
+		nextSmpl = FindFrameAbove(chnData, _channels, curSmpl, smplCount, _silenceVal);
+		_silenceCnt += (UINT64)(nextSmpl - curSmpl) * _channels;
+		curSmpl = nextSmpl;
+		if (curSmpl >= smplCount)
+			break;
+		
+		// The first loud sample and each one after enough silence start a new loud interval.
+		// (The silence is counted in 32 bits, as the song state does.)
+		for (curChn = 0; curChn < _channels; curChn ++)
+		{
+			INT32 smplVal = abs(chnData[curChn][curSmpl]);
+			if (smplVal < _silenceVal)
+			{
+				_silenceCnt ++;
+				continue;
+			}
+			
+			if (_loud.empty() || (UINT32)_silenceCnt >= _splitSmpls * _channels)
+			{
+				LoudInterval li;
+				li.smplStart = _smplPos + curSmpl;
+				li.silenceSmpls = _silenceCnt;
+				li.peak = 0;
+				_loud.push_back(li);
+			}
+			if (_loud.back().peak < smplVal)
+				_loud.back().peak = smplVal;
+			_silenceCnt = 0;
+		}
+		curSmpl ++;
+		
+		// In the following frames with loud samples, the silence can't get long enough to end the song.
+		// (There are less than 2 frames of silence between loud samples.) So only the maximum is needed.
+		if (_splitSmpls < 2)
+			continue;
+		nextSmpl = FindFrameBelow(chnData, _channels, curSmpl, smplCount, _silenceVal);
+		if (nextSmpl == curSmpl)
+			continue;
+		LoudInterval& li = _loud.back();
+		for (curChn = 0; curChn < _channels; curChn ++)
+		{
+			INT32 chnMax = GetAbsMax(&chnData[curChn][curSmpl], nextSmpl - curSmpl);
+			if (li.peak < chnMax)
+				li.peak = chnMax;
+		}
+		curSmpl = nextSmpl;
+		_silenceCnt = 0;	// count the silent channels after the last loud sample
+		for (curChn = 0; curChn < _channels; curChn ++)
+		{
+			if (abs(chnData[curChn][curSmpl - 1]) < _silenceVal)
+				_silenceCnt ++;
+			else
+				_silenceCnt = 0;
+		}
+	}
+	_smplPos += smplCount;
+	
+	return;
+}
+
+void SilenceDetector::AddIntervals(const std::vector<LoudInterval>& loud, UINT64 trailSilence)
+{
+	size_t curLoud;
+	
+	for (curLoud = 0; curLoud < loud.size(); curLoud ++)
+	{
+		const LoudInterval& li = loud[curLoud];
+		// The silence before the first interval continues the current one.
+		// All other intervals start after enough silence.
+		if (curLoud == 0)
+			_songSilence += (UINT32)li.silenceSmpls;
+		else
+			_songSilence = (UINT32)li.silenceSmpls;
+		if (_songSilence >= _splitSmpls * _channels)
+		{
+			if (_songStart)
+			{
+				SilenceEvent evt;
+				evt.songID = _songID;
+				evt.smplStart = _songStart;
+				evt.smplEnd = li.smplStart - _songSilence / _channels;
+				evt.peak = _songPeak;
+				if (evt.smplEnd - evt.smplStart < OUTLIER_SMPLS)
+				{
+					evt.type = SDET_OUTLIER;
+					_songID --;
+				}
+				else
+				{
+					evt.type = SDET_SONG;
+				}
+				if (_callback)
+					_callback(evt);
+			}
+			_songID ++;
+			_songStart = li.smplStart;
+			_songPeak = 0;
+		}
+		if (_songPeak < li.peak)
+			_songPeak = li.peak;
+	}
+	if (loud.empty())
+		_songSilence += (UINT32)trailSilence;
+	else
+		_songSilence = (UINT32)trailSilence;
+	
+	return;
+}
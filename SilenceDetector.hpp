@@ -0,0 +1,86 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#ifndef __SILENCEDETECTOR_HPP__
+#define __SILENCEDETECTOR_HPP__
+
+#include <stddef.h>	// for size_t
+#include <vector>
+#include <functional>
+#include "stdtype.h"
+
+// event types
+#define SDET_SONG		0x00
+#define SDET_OUTLIER	0x01	// loud section shorter than 10 samples, doesn't use up a song ID
+
+struct SilenceEvent
+{
+	UINT8 type;
+	UINT32 songID;
+	UINT64 smplStart;
+	UINT64 smplEnd;
+	INT32 peak;	// largest abs(value) of the song
+};
+typedef std::function<void(const SilenceEvent& evt)> SilenceCallback;
+
+// loud samples with less than a split's worth of silence between them
+struct LoudInterval
+{
+	UINT64 smplStart;	// first loud frame
+	UINT64 silenceSmpls;	// silent samples (frames * channels) before it, for the first interval of a part only those inside the part
+	INT32 peak;
+};
+
+// Coarse song detection: A sample with abs(value) >= silenceVal after at least splitSmpls frames of silence starts a song,
+// the silence ends it. The frames can be passed in blocks of any size.
+// A part of the recording can be scanned separately (e.g. by another thread) and joined in order using Append().
+// This gives exactly the same songs as processing all frames with a single detector.
+class SilenceDetector
+{
+public:
+	SilenceDetector();
+	void Init(UINT16 channels, INT32 silenceVal, UINT32 splitSmpls);
+	void SetCallback(const SilenceCallback& callback);
+	
+	// Start detecting songs at frame smplPos, as if there were initSilence samples (frames * channels) of silence before.
+	void Start(UINT64 smplPos, UINT32 initSilence);
+	// Start scanning a part that begins at frame smplPos. Parts only collect loud intervals and don't send events.
+	void StartPart(UINT64 smplPos);
+	// process planar data, the frames follow the previous block
+	void ProcessBlock(const INT32* const* chnData, size_t smplCount);
+	// skip frames that are known to be silent
+	void AddSilence(UINT64 smplCount);
+	// Skip frames that are known to contain loud samples with less than a split's worth of silence between them and
+	// to the loud samples before and after them. (e.g. from an amplitude index) Only the peak is needed for them.
+	void AddLoud(UINT64 smplCount, INT32 peak);
+	// Continue with a part that was scanned separately. It must start at the current position.
+	void Append(const SilenceDetector& part);
+	// end of the recording: sends the event for the last song
+	void Finish(void);
+	
+	UINT64 GetPosition(void) const;	// frame after the last processed one
+	const std::vector<LoudInterval>& GetLoudIntervals(void) const;	// parts only
+	UINT64 GetTrailingSilence(void) const;	// silent samples after the last loud one (parts only)
+
+private:
+	void ScanBlock(const INT32* const* chnData, size_t smplCount);
+	void AddIntervals(const std::vector<LoudInterval>& loud, UINT64 trailSilence);
+	
+	UINT16 _channels;
+	INT32 _silenceVal;
+	UINT32 _splitSmpls;
+	SilenceCallback _callback;
+	bool _isPart;
+	UINT64 _smplPos;
+	
+	// scanning
+	std::vector<LoudInterval> _loud;	// parts: all intervals, otherwise the ones of the current block
+	UINT64 _silenceCnt;
+	
+	// song state
+	UINT32 _songSilence;	// silent samples since the last loud one
+	UINT32 _songID;
+	UINT64 _songStart;	// 0 = no song yet
+	INT32 _songPeak;
+};
+
+#endif	// __SILENCEDETECTOR_HPP__
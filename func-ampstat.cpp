@@ -8,6 +8,8 @@
 
 #include "stdtype.h"
 #include "MultiWaveFile.hpp"
+#include "SampleOps.hpp"
+#include "EnvelopeIndex.hpp"
 #include "func.hpp"
 
 #define INLINE	static inline
@@ -16,17 +18,16 @@
 #define M_LN2	0.693147180559945309417
 #endif
 
-INLINE INT16 ReadLE16s(const UINT8* data);
-INLINE INT32 ReadLE24s(const UINT8* data);
 INLINE INT32 MaxVal_SampleBits(UINT8 bits);
 INLINE double Linear2DB(double scale);
+static UINT8 GetIndexMinMax(MultiWaveFile& mwf, EnvelopeIndex& envIdx, UINT64 smplStart, UINT64 smplEnd,
+	std::vector<INT32>& minVals, std::vector<INT32>& maxVals);
 
-int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UINT32 interval)
+int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UINT32 interval, EnvelopeIndex* envIdx)
 {
 	double smplDivide;
-	std::vector<UINT8> smplBuf;
+	SampleBlock smplBlk;
 	size_t smplBufSCnt;	// sample buffer: sample count
-	UINT32 smplSize;
 	UINT32 smplRate;
 	size_t readSmpls;
 	UINT64 smplEnd;
@@ -39,8 +40,7 @@ int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UIN
 	std::vector<UINT64> smplMinPos;
 	bool showIntTime;
 	
-	smplDivide = (double)MaxVal_SampleBits(mwf.GetBitDepth());
-	smplSize = mwf.GetSampleSize();
+	smplDivide = (double)MaxVal_SampleBits(GetSampleFormatIntBits(mwf.GetSampleFormat()));
 	smplRate = mwf.GetSampleRate();
 	chnCnt = mwf.GetChannels();
 	smplMaxVal.resize(chnCnt);
@@ -49,7 +49,6 @@ int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UIN
 	smplMinPos.resize(chnCnt);
 	// Note: The buffer size also determines the measurement interval.
 	smplBufSCnt = interval ? interval : (smplRate * 1);	// fallback: buffer of 1 second
-	smplBuf.resize(smplBufSCnt * smplSize);
 	
 	showIntTime = ((smplStart % smplRate) == 0) && ((smplBufSCnt % smplRate) == 0);
 	
@@ -65,55 +64,39 @@ int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UIN
 	{
 		if (smplPos >= smplEnd)
 			break;
-		readSmpls = std::min(smplBuf.size(), (size_t)(smplPos - smplEnd));
-		readSmpls = mwf.ReadSamples(readSmpls, smplBuf.data());
-		if (! readSmpls)
-			break;
-		
-		const UINT8* src = smplBuf.data();
-		size_t curSmpl;
-		std::fill(smplMaxVal.begin(), smplMaxVal.end(), 0);	std::fill(smplMaxPos.begin(), smplMaxPos.end(), 0);
-		std::fill(smplMinVal.begin(), smplMinVal.end(), 0);	std::fill(smplMinPos.begin(), smplMinPos.end(), 0);
-		switch(mwf.GetBitDepth())
+		readSmpls = (size_t)std::min((UINT64)smplBufSCnt, smplEnd - smplPos);
+		if (envIdx != NULL)
 		{
-		case 16:
-			for (curSmpl = 0; curSmpl < readSmpls; curSmpl ++, src += smplSize)
+			// the positions aren't needed for the output, so the extremes can be taken from the index
+			readSmpls = (size_t)std::min((UINT64)readSmpls, mwf.GetTotalSamples() - smplPos);
+			if (GetIndexMinMax(mwf, *envIdx, smplPos, smplPos + readSmpls, smplMinVal, smplMaxVal))
+				break;
+			for (curChn = 0; curChn < chnCnt; curChn ++)
 			{
-				for (curChn = 0; curChn < chnCnt; curChn ++)
-				{
-					INT32 smplVal = ReadLE16s(&src[curChn * 2]);
-					if (smplVal > smplMaxVal[curChn])
-					{
-						smplMaxVal[curChn] = smplVal;
-						smplMaxPos[curChn] = smplPos + (UINT64)curSmpl;
-					}
-					if (smplVal < smplMinVal[curChn])
-					{
-						smplMinVal[curChn] = smplVal;
-						smplMinPos[curChn] = smplPos + (UINT64)curSmpl;
-					}
-				}
+				smplMaxVal[curChn] = (smplMaxVal[curChn] > 0) ? smplMaxVal[curChn] : 0;
+				smplMinVal[curChn] = (smplMinVal[curChn] < 0) ? smplMinVal[curChn] : 0;
 			}
-			break;
-		case 24:
-			for (curSmpl = 0; curSmpl < readSmpls; curSmpl ++, src += smplSize)
+		}
+		else
+		{
+			readSmpls = mwf.ReadBlock(readSmpls, smplBlk);
+			if (! readSmpls)
+				break;
+			
+			for (curChn = 0; curChn < chnCnt; curChn ++)
 			{
-				for (curChn = 0; curChn < chnCnt; curChn ++)
-				{
-					INT32 smplVal = ReadLE24s(&src[curChn * 3]);
-					if (smplVal > smplMaxVal[curChn])
-					{
-						smplMaxVal[curChn] = smplVal;
-						smplMaxPos[curChn] = smplPos + (UINT64)curSmpl;
-					}
-					if (smplVal < smplMinVal[curChn])
-					{
-						smplMinVal[curChn] = smplVal;
-						smplMinPos[curChn] = smplPos + (UINT64)curSmpl;
-					}
-				}
+				const INT32* chnData = smplBlk.GetInt(curChn);
+				INT32 minVal;
+				INT32 maxVal;
+				
+				// The extremes are measured relative to silence, so they are 0 at least.
+				// Only their first occurrence is searched for, using a second pass over the block.
+				GetMinMax(chnData, readSmpls, minVal, maxVal);
+				smplMaxVal[curChn] = (maxVal > 0) ? maxVal : 0;
+				smplMaxPos[curChn] = (maxVal > 0) ? (smplPos + FindValue(chnData, readSmpls, maxVal)) : 0;
+				smplMinVal[curChn] = (minVal < 0) ? minVal : 0;
+				smplMinPos[curChn] = (minVal < 0) ? (smplPos + FindValue(chnData, readSmpls, minVal)) : 0;
 			}
-			break;
 		}
 #if 0
 		printf("Second %u:\n", (UINT32)(smplPos / smplRate));
@@ -133,9 +116,10 @@ int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UIN
 			printf("%.2f", (double)smplPos / smplRate);
 		for (curChn = 0; curChn < chnCnt; curChn ++)
 		{
-			INT32 smplDiff = smplMaxVal[curChn] - smplMinVal[curChn];
-			double dbMin = Linear2DB(abs(smplMinVal[curChn]) / smplDivide);
-			double dbMax = Linear2DB(abs(smplMaxVal[curChn]) / smplDivide);
+			// minimum <= 0 <= maximum, the difference can exceed the INT32 range with 32-bit input
+			double smplDiff = (double)smplMaxVal[curChn] - smplMinVal[curChn];
+			double dbMin = Linear2DB(-(double)smplMinVal[curChn] / smplDivide);
+			double dbMax = Linear2DB(smplMaxVal[curChn] / smplDivide);
 			double dbDiff = Linear2DB(smplDiff / smplDivide / 2);
 			printf("\t%.8f\t%.8f\t%.8f", dbMin, dbMax, dbDiff);
 		}
@@ -146,14 +130,114 @@ int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UIN
 	return 0;
 }
 
-INLINE INT16 ReadLE16s(const UINT8* data)
+// Get the extremes of frames [smplStart, smplEnd) from the index, using the largest blocks that fit.
+// Only the frames outside of complete level 0 blocks are read from the recording.
+static UINT8 GetIndexMinMax(MultiWaveFile& mwf, EnvelopeIndex& envIdx, UINT64 smplStart, UINT64 smplEnd,
+	std::vector<INT32>& minVals, std::vector<INT32>& maxVals)
 {
-	return ((INT8)data[0x01] << 8) | (data[0x00] << 0);
-}
-
-INLINE INT32 ReadLE24s(const UINT8* data)
-{
-	return ((INT8)data[0x02] << 16) | (data[0x01] <<  8) | (data[0x00] <<  0);
+	const UINT32 lvl0Smpls = EnvelopeIndex::GetBlockSize(0);
+	const UINT16 chnCnt = mwf.GetChannels();
+	UINT64 blkEnd[ENVIDX_LEVELS];	// end of the usable blocks of each level (block index)
+	UINT64 idxStart;
+	UINT64 idxEnd;
+	UINT64 smplPos;
+	std::vector<EnvelopeEntry> entries;
+	SampleBlock smplBlk;
+	UINT64 rawRange[2][2];
+	UINT8 curRng;
+	UINT8 curLvl;
+	UINT16 curChn;
+	size_t curEnt;
+	
+	for (curChn = 0; curChn < chnCnt; curChn ++)
+	{
+		minVals[curChn] = 0x7FFFFFFF;
+		maxVals[curChn] = (INT32)0x80000000;
+	}
+	
+	// The last block of the recording may be incomplete.
+	for (curLvl = 0; curLvl < ENVIDX_LEVELS; curLvl ++)
+	{
+		if (smplEnd >= mwf.GetTotalSamples())
+			blkEnd[curLvl] = envIdx.GetBlockCount(curLvl);
+		else
+			blkEnd[curLvl] = smplEnd / EnvelopeIndex::GetBlockSize(curLvl);
+	}
+	idxStart = (smplStart + lvl0Smpls - 1) / lvl0Smpls * lvl0Smpls;
+	idxEnd = blkEnd[0] * lvl0Smpls;
+	if (idxStart >= idxEnd)
+	{
+		idxStart = idxEnd = smplEnd;	// no complete block
+		rawRange[1][0] = rawRange[1][1] = 0;
+	}
+	else
+	{
+		rawRange[1][0] = idxEnd;
+		rawRange[1][1] = (idxEnd < smplEnd) ? smplEnd : idxEnd;
+	}
+	rawRange[0][0] = smplStart;
+	rawRange[0][1] = idxStart;
+	
+	for (smplPos = idxStart; smplPos < idxEnd; )
+	{
+		UINT64 blkStart;
+		UINT64 blkCnt;
+		
+		// use the largest blocks that start here, but switch to the next level as soon as possible
+		for (curLvl = ENVIDX_LEVELS - 1; curLvl > 0; curLvl --)
+		{
+			if ((smplPos % EnvelopeIndex::GetBlockSize(curLvl)) == 0 && smplPos / EnvelopeIndex::GetBlockSize(curLvl) < blkEnd[curLvl])
+				break;
+		}
+		blkStart = smplPos / EnvelopeIndex::GetBlockSize(curLvl);
+		blkCnt = blkEnd[curLvl] - blkStart;
+		if (curLvl + 1 < ENVIDX_LEVELS)
+		{
+			UINT32 upSmpls = EnvelopeIndex::GetBlockSize(curLvl + 1);
+			UINT64 upBlk = smplPos / upSmpls + 1;
+			if (upBlk < blkEnd[curLvl + 1] && upBlk * upSmpls - smplPos < blkCnt * EnvelopeIndex::GetBlockSize(curLvl))
+				blkCnt = (upBlk * upSmpls - smplPos) / EnvelopeIndex::GetBlockSize(curLvl);
+		}
+		
+		if (envIdx.ReadBlocks(curLvl, blkStart, (size_t)blkCnt, entries))
+		{
+			fprintf(stderr, "Error reading index data!\n");
+			return 0xFF;
+		}
+		for (curEnt = 0; curEnt < entries.size(); curEnt ++)
+		{
+			curChn = (UINT16)(curEnt % chnCnt);
+			if (minVals[curChn] > entries[curEnt].minVal)
+				minVals[curChn] = entries[curEnt].minVal;
+			if (maxVals[curChn] < entries[curEnt].maxVal)
+				maxVals[curChn] = entries[curEnt].maxVal;
+		}
+		smplPos += blkCnt * EnvelopeIndex::GetBlockSize(curLvl);
+	}
+	
+	for (curRng = 0; curRng < 2; curRng ++)
+	{
+		size_t readSmpls;
+		
+		if (rawRange[curRng][0] >= rawRange[curRng][1])
+			continue;
+		mwf.SetSampleReadOffset(rawRange[curRng][0]);
+		readSmpls = mwf.ReadBlock((size_t)(rawRange[curRng][1] - rawRange[curRng][0]), smplBlk);
+		if (! readSmpls)
+			return 0xFF;
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			INT32 minVal;
+			INT32 maxVal;
+			GetMinMax(smplBlk.GetInt(curChn), readSmpls, minVal, maxVal);
+			if (minVals[curChn] > minVal)
+				minVals[curChn] = minVal;
+			if (maxVals[curChn] < maxVal)
+				maxVals[curChn] = maxVal;
+		}
+	}
+	
+	return 0x00;
 }
 
 INLINE INT32 MaxVal_SampleBits(UINT8 bits)
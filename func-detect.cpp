@@ -5,9 +5,15 @@
 #include <math.h>
 #include <vector>
 #include <string>
+#include <algorithm>	// for std::min()
+#include <thread>
+#include <atomic>
 
 #include "stdtype.h"
 #include "MultiWaveFile.hpp"
+#include "SampleOps.hpp"
+#include "SilenceDetector.hpp"
+#include "EnvelopeIndex.hpp"
 #include "func.hpp"
 
 #define INLINE	static inline
@@ -16,6 +22,14 @@
 #define M_LN2	0.693147180559945309417
 #endif
 
+// The recording is scanned in chunks of this size (in seconds), which are read in blocks of SCAN_BLOCK_SECS.
+#define SCAN_CHUNK_SECS	60
+#define SCAN_BLOCK_SECS	2
+
+// classes of index blocks
+#define ENVBLK_SILENT	0x00
+#define ENVBLK_LOUD		0x01
+
 struct SplitListItem
 {
 	UINT64 smplStart;
@@ -25,31 +39,64 @@ struct SplitListItem
 };
 
 
-INLINE INT32 ReadLE24s(const UINT8* data);
+// a combination of split settings for DoSplitSweep()
+struct SweepItem
+{
+	double ampSplit;
+	double tSplit;
+	INT32 silenceVal;
+	UINT32 splitSmpls;
+	size_t scanID;	// shared scan of the recording
+	
+	UINT32 songs;
+	UINT32 outliers;
+	UINT64 minLen;
+	UINT64 maxLen;
+};
+
+// state of the index-based scan
+struct IndexScan
+{
+	MultiWaveFile* mwf;
+	EnvelopeIndex* envIdx;
+	SilenceDetector* detector;
+	INT32 silenceVal;
+	UINT8 valShift;	// index values -> SBLK_INT24 values
+	UINT8 clLevel;	// level of the blocks that are joined into clusters
+	bool clJoin;	// false = each loud block is a cluster of its own
+	UINT64 clMaxGap;	// maximum silence (in frames) between the blocks of a cluster
+	
+	// Cluster: loud blocks with so little silence between them that no split can happen inside.
+	// Only its first and last loud sample are relevant, so only the samples around them are read.
+	bool clOpen;
+	UINT64 clFirst;	// start of the first block
+	UINT64 clLast;	// start of the last block
+	UINT64 clEnd;	// end of the last block
+	INT32 clPeak;
+	SampleBlock smplBlk;
+};
+
+
 INLINE INT32 MaxVal_SampleBits(UINT8 bits);
 INLINE double Linear2DB(double scale);
 INLINE double DB2Linear(double db);
-INLINE INT32 OptAmplitude2Sample(double optVal, UINT32 maxSmplVal);
+INLINE INT32 OptAmplitude2Sample(double optVal, UINT32 maxSmplVal, UINT8 valShift);
 INLINE UINT64 RoundDownToUnit(UINT64 val, UINT64 unit);
-static INT32 GetMaxSample24(const UINT8* buffer, UINT16 chnCnt);
+static INT32 GetMaxSample(const SampleBlock& block, size_t smplIdx);
 static std::string GetTimeStrHMS(UINT32 smplRate, UINT64 smplPos);
 static std::string GetTimeStrMS(UINT32 smplRate, UINT64 smplPos);
 
 
 static void FinetuneTrimPoint(MultiWaveFile& mwf, SplitListItem& sli, INT32 silenceVal)
 {
-	std::vector<UINT8> smplBuf;
-	UINT32 smplSize = mwf.GetSampleSize();
+	SampleBlock smplBlk;
 	UINT32 smplRate = mwf.GetSampleRate();
 	UINT32 smplCnt;
 	size_t readSmpls;
 	UINT16 chnCnt = mwf.GetChannels();
 	UINT64 smplReadOfs;
-	const UINT8* src;
 	UINT32 curSmpl;
 	
-	smplBuf.resize(smplRate * 4 * smplSize);
-	
 	{
 		INT32 maxVal;
 		INT8 initSign;
@@ -62,7 +109,7 @@ static void FinetuneTrimPoint(MultiWaveFile& mwf, SplitListItem& sli, INT32 sile
 		smplCnt = smplRate * 1;
 		smplReadOfs = (sli.smplStart >= smplCnt) ? (sli.smplStart - smplCnt) : 0;
 		mwf.SetSampleReadOffset(smplReadOfs);
-		readSmpls = mwf.ReadSamples((smplCnt + 1) * smplSize, smplBuf.data());
+		readSmpls = mwf.ReadBlock(smplCnt + 1, smplBlk, SBLK_INT24);
 		if (! readSmpls)
 		{
 			printf("Error reading samples from offset %llu, count %u!\n", smplReadOfs, smplCnt + 1);
@@ -70,13 +117,12 @@ static void FinetuneTrimPoint(MultiWaveFile& mwf, SplitListItem& sli, INT32 sile
 		}
 		
 		curSmpl = (UINT32)readSmpls - 1;
-		src = &smplBuf[curSmpl * smplSize];
-		maxVal = GetMaxSample24(src, chnCnt);
+		maxVal = GetMaxSample(smplBlk, curSmpl);
 		initSign = (maxVal < 0) ? -1 : 0;
 		while(curSmpl > 0)
 		{
-			curSmpl --;	src -= smplSize;
-			maxVal = GetMaxSample24(src, chnCnt);
+			curSmpl --;
+			maxVal = GetMaxSample(smplBlk, curSmpl);
 			curSign = (maxVal < 0) ? -1 : 0;
 			if (curSign != initSign && abs(maxVal) >= (silenceVal / 4))
 			{
@@ -85,9 +131,9 @@ static void FinetuneTrimPoint(MultiWaveFile& mwf, SplitListItem& sli, INT32 sile
 			}
 		}
 		
-		for (; curSmpl < readSmpls - 1; curSmpl ++, src += smplSize)
+		for (; curSmpl < readSmpls - 1; curSmpl ++)
 		{
-			maxVal = GetMaxSample24(src, chnCnt);
+			maxVal = GetMaxSample(smplBlk, curSmpl);
 			curSign = (maxVal < 0) ? -1 : 0;
 			if (curSign != initSign)
 			{
@@ -114,10 +160,10 @@ static void FinetuneTrimPoint(MultiWaveFile& mwf, SplitListItem& sli, INT32 sile
 		smplReadOfs -= smplRate / 10;
 		//smplReadOfs = sli.smplEnd - smplRate / 10;
 		mwf.SetSampleReadOffset(smplReadOfs);
-		readSmpls = mwf.ReadSamples(smplBuf.size(), smplBuf.data());
+		readSmpls = mwf.ReadBlock(smplRate * 4, smplBlk, SBLK_INT24);
 		if (! readSmpls)
 		{
-			printf("Error reading samples from offset %llu, count %zu!\n", smplReadOfs, smplBuf.size() / smplSize);
+			printf("Error reading samples from offset %llu, count %u!\n", smplReadOfs, smplRate * 4);
 			return;
 		}
 		
@@ -129,12 +175,12 @@ static void FinetuneTrimPoint(MultiWaveFile& mwf, SplitListItem& sli, INT32 sile
 			if (blkBaseSmpl + blkSmpls > readSmpls)
 				blkSmpls = (UINT32)(readSmpls - blkBaseSmpl);
 			
-			src = &smplBuf[blkBaseSmpl * smplSize];
 			INT64 blkSmplAcc = 0;
-			for (curSmpl = 0; curSmpl < blkSmpls; curSmpl ++, src += smplSize)
+			for (curChn = 0; curChn < chnCnt; curChn ++)
 			{
-				for (curChn = 0; curChn < chnCnt; curChn ++)
-					blkSmplAcc += abs(ReadLE24s(&src[curChn * 3]));
+				const INT32* chnData = &smplBlk.GetInt(curChn)[blkBaseSmpl];
+				for (curSmpl = 0; curSmpl < blkSmpls; curSmpl ++)
+					blkSmplAcc += abs(chnData[curSmpl]);
 			}
 			blkSmplVal = (INT32)(blkSmplAcc / (blkSmpls * chnCnt));
 			if (blkSmplVal > lastBlkSmplVal)
@@ -153,128 +199,648 @@ static void FinetuneTrimPoint(MultiWaveFile& mwf, SplitListItem& sli, INT32 sile
 	return;
 }
 
-int DoSplitDetection(MultiWaveFile& mwf, const std::vector<std::string>& fileNameList, const DetectOpts& opts)
+static void ScanChunk(MultiWaveFile& mwf, UINT64 chunkStart, UINT64 chunkLen, size_t blkSmpls, SilenceDetector& part)
 {
-	const INT32 smplValRange = MaxVal_SampleBits(mwf.GetBitDepth());
-	const INT32 splitSValSilence = OptAmplitude2Sample(opts.ampSplit, smplValRange);
-	const INT32 splitSValFine = OptAmplitude2Sample(opts.ampFinetune, smplValRange);
-	const UINT32 splitSmplCount = (UINT32)(opts.tSplit * mwf.GetSampleRate() + 0.5);
-	std::vector<UINT8> smplBuf;
-	UINT32 smplSize = mwf.GetSampleSize();
-	UINT32 smplRate = mwf.GetSampleRate();
-	UINT16 chnCnt = mwf.GetChannels();
+	const UINT16 chnCnt = mwf.GetChannels();
+	const UINT32 smplRate = mwf.GetSampleRate();
+	const bool keepBounds = (mwf.GetCacheMode() == MWF_CACHE_BOUNDS);
+	SampleBlock smplBlk;
+	std::vector<const INT32*> chnData(chnCnt);
 	size_t readSmpls;
-	UINT64 smplPos;
-	UINT32 silenceSmplCnt;
-	UINT32 songID;
-	UINT64 songSmplStart;
-	UINT64 songSmplEnd;
-	INT32 maxSmplVal;
+	UINT64 chunkEnd = chunkStart + chunkLen;
+	size_t keptIntervals;
 	
-	std::vector<SplitListItem> splitList;
+	if (keepBounds)
+	{
+		// Windows of boundaries close to the chunk edges reach into the neighbouring chunks, which are read by other threads.
+		// So always keep the beginning and end of the chunk.
+		mwf.KeepCacheRange(chunkStart, chunkStart + smplRate * 4);
+		mwf.KeepCacheRange((chunkEnd >= smplRate) ? (chunkEnd - smplRate) : 0, chunkEnd);
+	}
 	
-	// algorithm:
-	//	1. sample >= 512 starts a song
-	//	2. song stops after 5+ seconds of (all samples < 512)
-	//	3. go to 1
-	smplBuf.resize(smplRate * 10 * smplSize);	// buffer of 10 seconds
-	
-	// actual song search
-	fprintf(stderr, "Determining split points ...\n");
-	mwf.SetSampleReadOffset(0);
-	splitList.clear();
-	songSmplStart = songSmplEnd = 0;
-	silenceSmplCnt = smplRate * 4 * chnCnt;
-	maxSmplVal = 0;
-	songID = (UINT32)-1;	// make first ID 0 even with pre-increment
-	readSmpls = 0;
-	for (smplPos = mwf.GetSampleReadOffset(); smplPos < mwf.GetTotalSamples(); smplPos += readSmpls)
+	mwf.SetSampleReadOffset(chunkStart);
+	part.StartPart(chunkStart);
+	keptIntervals = 0;
+	while(part.GetPosition() < chunkEnd)
 	{
-		readSmpls = mwf.ReadSamples(smplBuf.size(), smplBuf.data());
+		UINT64 remSmpls = chunkEnd - part.GetPosition();
+		readSmpls = mwf.ReadBlock((remSmpls < blkSmpls) ? (size_t)remSmpls : blkSmpls, smplBlk, SBLK_INT24);
 		if (! readSmpls)
 			break;
 		
-		const UINT8* src = smplBuf.data();
-		UINT32 curSmpl;
 		UINT16 curChn;
-		for (curSmpl = 0; curSmpl < readSmpls; curSmpl ++, src += smplSize)
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			chnData[curChn] = smplBlk.GetInt(curChn);
+		part.ProcessBlock(chnData.data(), readSmpls);
+		
+		if (keepBounds)
 		{
-			for (curChn = 0; curChn < chnCnt; curChn ++)
+			// Each interval may start a song. All but the first one follow a song end.
+			const std::vector<LoudInterval>& loud = part.GetLoudIntervals();
+			for (; keptIntervals < loud.size(); keptIntervals ++)
 			{
-				INT32 smplVal = abs(ReadLE24s(&src[curChn * 3]));
-				if (smplVal < splitSValSilence)
+				const LoudInterval& li = loud[keptIntervals];
+				if (keptIntervals > 0)
 				{
-					silenceSmplCnt ++;
-					continue;
+					UINT64 songEnd = li.smplStart - (UINT32)li.silenceSmpls / chnCnt;
+					mwf.KeepCacheRange((songEnd >= smplRate / 5) ? (songEnd - smplRate / 5) : 0, songEnd + smplRate * 4);
 				}
-				
-				if (silenceSmplCnt >= splitSmplCount * chnCnt)
-				{
-					if (songSmplStart)
-					{
-						songSmplEnd = smplPos + curSmpl - silenceSmplCnt / chnCnt;
-						if (songSmplEnd - songSmplStart < 10)
-						{
-							songID --;
-							printf("Outlier at %s (%u samples)\n", GetTimeStrHMS(smplRate, songSmplStart).c_str(),
-								(UINT32)(songSmplEnd - songSmplStart));
-						}
-						else
-						{
-							SplitListItem sli;
-							sli.smplStart = songSmplStart;
-							sli.smplEnd = songSmplEnd;
-							sli.gain = maxSmplVal / (double)smplValRange;
-							sli.fileName = (songID < fileNameList.size()) ? fileNameList[songID] : "";
-							printf("Song %u: %s .. %s len %s  %s\n", songID, GetTimeStrHMS(smplRate, sli.smplStart).c_str(),
-								GetTimeStrHMS(smplRate, sli.smplEnd).c_str(),
-								GetTimeStrMS(smplRate, sli.smplEnd - sli.smplStart).c_str(), sli.fileName.c_str());
-							splitList.push_back(sli);
-						}
-					}
-					songID ++;
-					songSmplStart = smplPos + curSmpl;
-					maxSmplVal = 0;
-				}
-				if (maxSmplVal < smplVal)
-					maxSmplVal = smplVal;
-				silenceSmplCnt = 0;
+				mwf.KeepCacheRange((li.smplStart >= smplRate) ? (li.smplStart - smplRate) : 0, li.smplStart + 1);
 			}
 		}
 	}
-	if (songSmplStart)
+	
+	if (keepBounds && ! part.GetLoudIntervals().empty())
+	{
+		// The silence at the end may turn into a song end.
+		UINT64 silenceStart = part.GetPosition() - part.GetTrailingSilence() / chnCnt;
+		mwf.KeepCacheRange((silenceStart >= smplRate / 5) ? (silenceStart - smplRate / 5) : 0, silenceStart + smplRate * 4);
+	}
+	
+	return;
+}
+
+// scan a chunk with multiple part detectors at once, so that each block is read only once
+static void SweepChunk(MultiWaveFile& mwf, UINT64 chunkStart, UINT64 chunkLen, size_t blkSmpls, std::vector<SilenceDetector>& parts)
+{
+	const UINT16 chnCnt = mwf.GetChannels();
+	SampleBlock smplBlk;
+	std::vector<const INT32*> chnData(chnCnt);
+	size_t readSmpls;
+	UINT64 smplPos;
+	size_t curPart;
+	UINT16 curChn;
+	
+	mwf.SetSampleReadOffset(chunkStart);
+	for (curPart = 0; curPart < parts.size(); curPart ++)
+		parts[curPart].StartPart(chunkStart);
+	for (smplPos = 0; smplPos < chunkLen; smplPos += readSmpls)
 	{
-		songSmplEnd = smplPos - silenceSmplCnt / chnCnt + 1;
+		UINT64 remSmpls = chunkLen - smplPos;
+		readSmpls = mwf.ReadBlock((remSmpls < blkSmpls) ? (size_t)remSmpls : blkSmpls, smplBlk, SBLK_INT24);
+		if (! readSmpls)
+			break;
+		
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			chnData[curChn] = smplBlk.GetInt(curChn);
+		for (curPart = 0; curPart < parts.size(); curPart ++)
+			parts[curPart].ProcessBlock(chnData.data(), readSmpls);
+	}
+	
+	return;
+}
+
+static UINT8 ClassifyEnvelope(const EnvelopeEntry* ee, UINT16 chnCnt, INT32 silenceVal, UINT8 valShift, INT32& peak)
+{
+	UINT8 result = ENVBLK_SILENT;
+	UINT16 curChn;
+	
+	peak = 0;
+	for (curChn = 0; curChn < chnCnt; curChn ++)
+	{
+		INT32 minVal = ee[curChn].minVal * (1 << valShift);
+		INT32 maxVal = ee[curChn].maxVal * (1 << valShift);
+		INT32 absMax = (maxVal > -minVal) ? maxVal : -minVal;
+		if (absMax >= silenceVal)
+		{
+			result = ENVBLK_LOUD;
+			if (peak < absMax)
+				peak = absMax;
+		}
+	}
+	
+	return result;
+}
+
+// process frames [smplStart, smplEnd) using the samples, the frames before are silent
+static UINT8 IndexScan_Raw(IndexScan& is, UINT64 smplStart, UINT64 smplEnd)
+{
+	const UINT16 chnCnt = is.mwf->GetChannels();
+	const size_t blkSmpls = is.mwf->GetSampleRate() * SCAN_BLOCK_SECS;
+	std::vector<const INT32*> chnData(chnCnt);
+	size_t readSmpls;
+	UINT16 curChn;
+	
+	is.detector->AddSilence(smplStart - is.detector->GetPosition());
+	is.mwf->SetSampleReadOffset(smplStart);
+	while(is.detector->GetPosition() < smplEnd)
+	{
+		UINT64 remSmpls = smplEnd - is.detector->GetPosition();
+		readSmpls = is.mwf->ReadBlock((remSmpls < blkSmpls) ? (size_t)remSmpls : blkSmpls, is.smplBlk, SBLK_INT24);
+		if (! readSmpls)
+		{
+			printf("Error reading samples from offset %llu!\n", is.detector->GetPosition());
+			return 0xFF;
+		}
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			chnData[curChn] = is.smplBlk.GetInt(curChn);
+		is.detector->ProcessBlock(chnData.data(), readSmpls);
+	}
+	
+	return 0x00;
+}
+
+// find the first/last loud level 0 block inside the cluster block at smplPos
+static UINT8 IndexScan_Refine(IndexScan& is, UINT64 smplPos, bool last, UINT64& result)
+{
+	const UINT16 chnCnt = is.mwf->GetChannels();
+	const UINT32 lvl0Smpls = EnvelopeIndex::GetBlockSize(0);
+	std::vector<EnvelopeEntry> entries;
+	UINT64 blkStart;
+	size_t blkCnt;
+	size_t curBlk;
+	INT32 peak;
+	
+	result = smplPos;
+	if (is.clLevel == 0)
+		return 0x00;
+	blkStart = smplPos / lvl0Smpls;
+	blkCnt = EnvelopeIndex::GetBlockSize(is.clLevel) / lvl0Smpls;
+	if (blkCnt > is.envIdx->GetBlockCount(0) - blkStart)
+		blkCnt = (size_t)(is.envIdx->GetBlockCount(0) - blkStart);
+	if (is.envIdx->ReadBlocks(0, blkStart, blkCnt, entries))
+	{
+		fprintf(stderr, "Error reading index data!\n");
+		return 0xFF;
+	}
+	
+	for (curBlk = 0; curBlk < blkCnt; curBlk ++)
+	{
+		size_t blkID = last ? (blkCnt - 1 - curBlk) : curBlk;
+		if (ClassifyEnvelope(&entries[blkID * chnCnt], chnCnt, is.silenceVal, is.valShift, peak) != ENVBLK_SILENT)
+		{
+			result = (blkStart + blkID) * lvl0Smpls;
+			break;
+		}
+	}
+	
+	return 0x00;
+}
+
+static UINT8 IndexScan_FlushCluster(IndexScan& is)
+{
+	const UINT32 lvl0Smpls = EnvelopeIndex::GetBlockSize(0);
+	const UINT64 totalSmpls = is.mwf->GetTotalSamples();
+	UINT64 firstPos;
+	UINT64 lastPos;
+	UINT8 retVal;
+	
+	if (! is.clOpen)
+		return 0x00;
+	is.clOpen = false;
+	
+	retVal = IndexScan_Refine(is, is.clFirst, false, firstPos);
+	if (! retVal)
+		retVal = IndexScan_Refine(is, is.clLast, true, lastPos);
+	if (retVal)
+		return retVal;
+	retVal = IndexScan_Raw(is, firstPos, std::min(firstPos + lvl0Smpls, totalSmpls));
+	if (retVal || lastPos <= firstPos)
+		return retVal;
+	is.detector->AddLoud(lastPos - is.detector->GetPosition(), is.clPeak);
+	return IndexScan_Raw(is, lastPos, std::min(lastPos + lvl0Smpls, totalSmpls));
+}
+
+static UINT8 IndexScan_AddBlock(IndexScan& is, const EnvelopeEntry* ee, UINT64 smplPos, UINT64 smplEnd)
+{
+	INT32 peak;
+	UINT8 retVal;
+	
+	switch(ClassifyEnvelope(ee, is.mwf->GetChannels(), is.silenceVal, is.valShift, peak))
+	{
+	case ENVBLK_SILENT:
+		break;	// The silence is added lazily.
+	case ENVBLK_LOUD:
+		if (is.clOpen && is.clJoin && smplPos - is.clEnd <= is.clMaxGap)
+		{
+			is.clLast = smplPos;
+			is.clEnd = smplEnd;
+			if (is.clPeak < peak)
+				is.clPeak = peak;
+			break;
+		}
+		retVal = IndexScan_FlushCluster(is);
+		if (retVal)
+			return retVal;
+		is.clOpen = true;
+		is.clFirst = is.clLast = smplPos;
+		is.clEnd = smplEnd;
+		is.clPeak = peak;
+		break;
+	}
+	
+	return 0x00;
+}
+
+// Coarse detection using the amplitude envelope index. This gives the same songs as scanning all samples.
+// Silent blocks are skipped, of loud blocks only the edges of clusters are read.
+static UINT8 ScanWithIndex(MultiWaveFile& mwf, EnvelopeIndex& envIdx, SilenceDetector& detector, INT32 silenceVal, UINT32 splitSmpls, UINT8 valShift)
+{
+	const UINT8 topLvl = ENVIDX_LEVELS - 1;
+	const UINT16 chnCnt = mwf.GetChannels();
+	const UINT64 totalSmpls = mwf.GetTotalSamples();
+	const UINT32 splitFrames = (splitSmpls * chnCnt) / chnCnt;	// the detector compares with a 32-bit sample count
+	IndexScan is;
+	std::vector<EnvelopeEntry> topEntries;
+	std::vector<EnvelopeEntry> entries;
+	UINT64 topCnt;
+	UINT64 curTop;
+	size_t curBlk;
+	UINT8 retVal;
+	INT32 peak;
+	
+	is.mwf = &mwf;
+	is.envIdx = &envIdx;
+	is.detector = &detector;
+	is.silenceVal = silenceVal;
+	is.valShift = valShift;
+	is.clOpen = false;
+	// The silence between loud samples of 2 blocks is shorter than both blocks plus the gap between them.
+	// Use the coarsest level where 2 blocks are shorter than a split. If there is none, all loud blocks are read.
+	is.clLevel = (topLvl > 1) ? 1 : 0;
+	while(is.clLevel > 0 && 2 * EnvelopeIndex::GetBlockSize(is.clLevel) > splitFrames)
+		is.clLevel --;
+	is.clJoin = (2 * EnvelopeIndex::GetBlockSize(is.clLevel) <= splitFrames);
+	is.clMaxGap = is.clJoin ? (splitFrames - 2 * EnvelopeIndex::GetBlockSize(is.clLevel)) : 0;
+	
+	topCnt = envIdx.GetBlockCount(topLvl);
+	if (envIdx.ReadBlocks(topLvl, 0, (size_t)topCnt, topEntries))
+	{
+		fprintf(stderr, "Error reading index data!\n");
+		return 0xFF;
+	}
+	for (curTop = 0; curTop < topCnt; curTop ++)
+	{
+		const UINT32 topSmpls = EnvelopeIndex::GetBlockSize(topLvl);
+		const UINT32 blkSmpls = EnvelopeIndex::GetBlockSize(is.clLevel);
+		UINT64 blkStart;
+		size_t blkCnt;
+		
+		if (ClassifyEnvelope(&topEntries[curTop * chnCnt], chnCnt, silenceVal, valShift, peak) == ENVBLK_SILENT)
+			continue;
+		blkStart = curTop * topSmpls / blkSmpls;
+		blkCnt = topSmpls / blkSmpls;
+		if (blkCnt > envIdx.GetBlockCount(is.clLevel) - blkStart)
+			blkCnt = (size_t)(envIdx.GetBlockCount(is.clLevel) - blkStart);
+		if (envIdx.ReadBlocks(is.clLevel, blkStart, blkCnt, entries))
+		{
+			fprintf(stderr, "Error reading index data!\n");
+			return 0xFF;
+		}
+		for (curBlk = 0; curBlk < blkCnt; curBlk ++)
+		{
+			UINT64 smplPos = (blkStart + curBlk) * blkSmpls;
+			UINT64 smplEnd = std::min(smplPos + blkSmpls, totalSmpls);
+			retVal = IndexScan_AddBlock(is, &entries[curBlk * chnCnt], smplPos, smplEnd);
+			if (retVal)
+				return retVal;
+		}
+	}
+	retVal = IndexScan_FlushCluster(is);
+	if (retVal)
+		return retVal;
+	detector.AddSilence(totalSmpls - detector.GetPosition());
+	
+	return 0x00;
+}
+
+// Continue a scan that stopped early (e.g. due to an error reading the index) by reading all remaining samples.
+// The detector has processed everything before its position, so the result is the same as for a full scan.
+static void ScanRemaining(MultiWaveFile& mwf, SilenceDetector& detector, INT32 silenceVal, UINT32 splitSmpls)
+{
+	SilenceDetector part;
+	UINT64 smplPos = detector.GetPosition();
+	
+	part.Init(mwf.GetChannels(), silenceVal, splitSmpls);
+	ScanChunk(mwf, smplPos, mwf.GetTotalSamples() - smplPos, mwf.GetSampleRate() * SCAN_BLOCK_SECS, part);
+	detector.Append(part);
+	
+	return;
+}
+
+int DoSplitDetection(MultiWaveFile& mwf, const std::vector<std::string>& fileNameList, const DetectOpts& opts, EnvelopeIndex* envIdx)
+{
+	// 8/16-bit samples are scaled up to 24 bits (SBLK_INT24), so that they are analyzed with the same resolution
+	// and give the same results as an up-converted file.
+	const UINT8 smplBits = GetSampleFormatIntBits(mwf.GetSampleFormat());
+	const UINT8 valBits = (smplBits < 24) ? 24 : smplBits;
+	const INT32 smplValRange = MaxVal_SampleBits(valBits);
+	const INT32 splitSValSilence = OptAmplitude2Sample(opts.ampSplit, smplValRange, valBits - smplBits);
+	const INT32 splitSValFine = OptAmplitude2Sample(opts.ampFinetune, smplValRange, valBits - smplBits);
+	const UINT32 splitSmplCount = (UINT32)(opts.tSplit * mwf.GetSampleRate() + 0.5);
+	UINT32 smplRate = mwf.GetSampleRate();
+	UINT16 chnCnt = mwf.GetChannels();
+	bool keepBounds = (mwf.GetCacheMode() == MWF_CACHE_BOUNDS);
+	SilenceDetector detector;
+	size_t blkSmpls;
+	UINT64 chunkSmpls;
+	size_t chunkCnt;
+	size_t curChunk;
+	size_t thrCount;
+	size_t curThr;
+	
+	std::vector<SplitListItem> splitList;
+	
+	detector.Init(chnCnt, splitSValSilence, splitSmplCount);
+	detector.SetCallback([&](const SilenceEvent& evt)
+	{
+		if (evt.type == SDET_OUTLIER)
+		{
+			printf("Outlier at %s (%u samples)\n", GetTimeStrHMS(smplRate, evt.smplStart).c_str(),
+				(UINT32)(evt.smplEnd - evt.smplStart));
+			return;
+		}
 		
 		SplitListItem sli;
-		sli.smplStart = songSmplStart;
-		sli.smplEnd = songSmplEnd;
-		sli.gain = maxSmplVal / (double)smplValRange;
-		sli.fileName = (songID < fileNameList.size()) ? fileNameList[songID] : "";
-		printf("Song %u: %s .. %s len %s  %s\n", songID, GetTimeStrHMS(smplRate, sli.smplStart).c_str(),
+		sli.smplStart = evt.smplStart;
+		sli.smplEnd = evt.smplEnd;
+		sli.gain = evt.peak / (double)smplValRange;
+		sli.fileName = (evt.songID < fileNameList.size()) ? fileNameList[evt.songID] : "";
+		printf("Song %u: %s .. %s len %s  %s\n", evt.songID, GetTimeStrHMS(smplRate, sli.smplStart).c_str(),
 			GetTimeStrHMS(smplRate, sli.smplEnd).c_str(),
 			GetTimeStrMS(smplRate, sli.smplEnd - sli.smplStart).c_str(), sli.fileName.c_str());
 		splitList.push_back(sli);
+		return;
+	});
+	detector.Start(0, smplRate * 4 * chnCnt);
+	
+	// algorithm:
+	//	1. sample >= 512 starts a song
+	//	2. song stops after 5+ seconds of (all samples < 512)
+	//	3. go to 1
+	// With an amplitude index, only the samples around song boundaries are read.
+	// Else the recording is scanned in chunks by multiple threads, which are then joined in order.
+	blkSmpls = smplRate * SCAN_BLOCK_SECS;
+	chunkSmpls = (UINT64)smplRate * SCAN_CHUNK_SECS;
+	chunkCnt = (size_t)((mwf.GetTotalSamples() + chunkSmpls - 1) / chunkSmpls);
+	thrCount = opts.threads ? opts.threads : std::thread::hardware_concurrency();
+	if (thrCount > chunkCnt)
+		thrCount = chunkCnt;
+	if (thrCount < 1 || envIdx != NULL)
+		thrCount = 1;
+	// The other threads use their own file instances. They are kept until the end, because with MWF_CACHE_BOUNDS,
+	// they hold the song boundaries in the page cache for the finetuning.
+	std::vector<MultiWaveFile> readers(thrCount - 1);
+	if (envIdx != NULL)
+	{
+		fprintf(stderr, "Determining split points (using the amplitude index) ...\n");
+		if (ScanWithIndex(mwf, *envIdx, detector, splitSValSilence, splitSmplCount, valBits - smplBits))
+		{
+			fprintf(stderr, "Warning: Amplitude index scan failed, reading the remaining samples instead.\n");
+			ScanRemaining(mwf, detector, splitSValSilence, splitSmplCount);	// on read errors, end the last song there
+		}
+		detector.Finish();
+	}
+	else
+	{
+		fprintf(stderr, "Determining split points ...\n");
+		std::vector<SilenceDetector> chunks(chunkCnt);
+		{
+			std::atomic<size_t> nextChunk(0);
+			auto scanWorker = [&](MultiWaveFile* reader)
+			{
+				size_t chunkID;
+				while((chunkID = nextChunk ++) < chunkCnt)
+				{
+					UINT64 chunkStart = chunkID * chunkSmpls;
+					UINT64 chunkLen = mwf.GetTotalSamples() - chunkStart;
+					if (chunkLen > chunkSmpls)
+						chunkLen = chunkSmpls;
+					chunks[chunkID].Init(chnCnt, splitSValSilence, splitSmplCount);
+					ScanChunk(*reader, chunkStart, chunkLen, blkSmpls, chunks[chunkID]);
+				}
+			};
+			std::vector<std::thread> threads;
+			for (curThr = 0; curThr < readers.size(); curThr ++)
+			{
+				readers[curThr].LoadWaveFiles(mwf);
+				// each thread reads only few files at a time
+				readers[curThr].SetMaxOpenFiles((mwf.GetMaxOpenFiles() / thrCount > 2) ? (mwf.GetMaxOpenFiles() / thrCount) : 2);
+				threads.push_back(std::thread(scanWorker, &readers[curThr]));
+			}
+			scanWorker(&mwf);
+			for (curThr = 0; curThr < threads.size(); curThr ++)
+				threads[curThr].join();
+		}
+		
+		for (curChunk = 0; curChunk < chunkCnt; curChunk ++)
+		{
+			detector.Append(chunks[curChunk]);
+			if (detector.GetPosition() < std::min(mwf.GetTotalSamples(), (curChunk + 1) * chunkSmpls))
+				break;	// read error
+		}
+		detector.Finish();
 	}
 	
 	printf("\n");
 	fprintf(stderr, "Finetuning split points and generating trim list ...\n");
+	// The songs are finetuned by multiple threads, each with its own file instance. (The ones of the scan are reused.)
+	// The trim list is written afterwards, so that it is in the original order.
+	size_t ftThrCount = opts.threads ? opts.threads : std::thread::hardware_concurrency();
+	if (ftThrCount > splitList.size())
+		ftThrCount = splitList.size();
+	if (ftThrCount < 1)
+		ftThrCount = 1;
+	std::vector<MultiWaveFile> ftReaders((ftThrCount > thrCount) ? (ftThrCount - thrCount) : 0);
+	{
+		std::atomic<size_t> nextSong(0);
+		auto finetuneWorker = [&](MultiWaveFile* reader)
+		{
+			size_t songID;
+			while((songID = nextSong ++) < splitList.size())
+				FinetuneTrimPoint(*reader, splitList[songID], splitSValFine);
+		};
+		std::vector<std::thread> threads;
+		for (curThr = 0; curThr + 1 < ftThrCount; curThr ++)
+		{
+			MultiWaveFile* reader;
+			if (curThr < readers.size())
+			{
+				reader = &readers[curThr];
+			}
+			else
+			{
+				reader = &ftReaders[curThr - readers.size()];
+				reader->LoadWaveFiles(mwf);
+				reader->SetMaxOpenFiles((mwf.GetMaxOpenFiles() / ftThrCount > 2) ? (mwf.GetMaxOpenFiles() / ftThrCount) : 2);
+			}
+			threads.push_back(std::thread(finetuneWorker, reader));
+		}
+		finetuneWorker(&mwf);
+		for (curThr = 0; curThr < threads.size(); curThr ++)
+			threads[curThr].join();
+	}
+	
 	size_t curFile;
 	for (curFile = 0; curFile < splitList.size(); curFile ++)
 	{
 		SplitListItem& sli = splitList[curFile];
-		FinetuneTrimPoint(mwf, sli, splitSValFine);
 		double gainDB = Linear2DB(sli.gain) * -1;	// invert sign to turn "maximum amplitude" to "gain"
 		gainDB = floor(gainDB * 1000.0) / 1000.0;	// round in such a way that avoids clipping later
 		printf("%.3f %llu %llu %s\n", gainDB, sli.smplStart, sli.smplEnd, sli.fileName.c_str());
 	}
+	if (keepBounds)
+		mwf.ReleaseCacheRanges();	// The other readers release their ranges when they are destroyed.
 	
 	return 0;
 }
 
-INLINE INT32 ReadLE24s(const UINT8* data)
+int DoSplitSweep(MultiWaveFile& mwf, const SweepOpts& opts, EnvelopeIndex* envIdx)
 {
-	return ((INT8)data[0x02] << 16) | (data[0x01] <<  8) | (data[0x00] <<  0);
+	const UINT8 smplBits = GetSampleFormatIntBits(mwf.GetSampleFormat());
+	const UINT8 valBits = (smplBits < 24) ? 24 : smplBits;
+	const INT32 smplValRange = MaxVal_SampleBits(valBits);
+	UINT32 smplRate = mwf.GetSampleRate();
+	UINT16 chnCnt = mwf.GetChannels();
+	std::vector<SweepItem> items;
+	std::vector<SweepItem*> scanItems;	// the setting that is scanned for each amplitude
+	size_t blkSmpls;
+	UINT64 chunkSmpls;
+	size_t chunkCnt;
+	size_t curChunk;
+	size_t thrCount;
+	size_t curThr;
+	size_t curItm;
+	size_t curAmp;
+	size_t curTime;
+	
+	for (curAmp = 0; curAmp < opts.ampSplit.size(); curAmp ++)
+	{
+		for (curTime = 0; curTime < opts.tSplit.size(); curTime ++)
+		{
+			SweepItem si;
+			si.ampSplit = opts.ampSplit[curAmp];
+			si.tSplit = opts.tSplit[curTime];
+			si.silenceVal = OptAmplitude2Sample(si.ampSplit, smplValRange, valBits - smplBits);
+			si.splitSmpls = (UINT32)(si.tSplit * smplRate + 0.5);
+			si.songs = 0;
+			si.outliers = 0;
+			si.minLen = (UINT64)-1;
+			si.maxLen = 0;
+			items.push_back(si);
+		}
+	}
+	
+	// A split can only happen after a silence that is long enough for the shortest split time, too.
+	// So settings with the same amplitude share the scan with the shortest split time, the others just join its loud intervals.
+	// (The detector compares 32-bit sample counts, which is taken into account here as well.)
+	for (curItm = 0; curItm < items.size(); curItm ++)
+	{
+		SweepItem& si = items[curItm];
+		for (si.scanID = 0; si.scanID < scanItems.size(); si.scanID ++)
+		{
+			if (scanItems[si.scanID]->silenceVal == si.silenceVal)
+				break;
+		}
+		if (si.scanID == scanItems.size())
+			scanItems.push_back(&si);
+		else if (si.splitSmpls * chnCnt < scanItems[si.scanID]->splitSmpls * chnCnt)
+			scanItems[si.scanID] = &si;
+	}
+	
+	std::vector< std::vector<SilenceDetector> > chunks;
+	if (envIdx != NULL)
+	{
+		// The index makes each scan cheap, so the settings are simply processed one after another.
+		fprintf(stderr, "Evaluating %u settings (using the amplitude index) ...\n", (unsigned)items.size());
+	}
+	else
+	{
+		fprintf(stderr, "Evaluating %u settings (%u amplitudes) ...\n", (unsigned)items.size(), (unsigned)scanItems.size());
+		blkSmpls = smplRate * SCAN_BLOCK_SECS;
+		chunkSmpls = (UINT64)smplRate * SCAN_CHUNK_SECS;
+		chunkCnt = (size_t)((mwf.GetTotalSamples() + chunkSmpls - 1) / chunkSmpls);
+		thrCount = opts.threads ? opts.threads : std::thread::hardware_concurrency();
+		if (thrCount > chunkCnt)
+			thrCount = chunkCnt;
+		if (thrCount < 1)
+			thrCount = 1;
+		
+		chunks.resize(chunkCnt);
+		std::vector<MultiWaveFile> readers(thrCount - 1);
+		std::atomic<size_t> nextChunk(0);
+		auto scanWorker = [&](MultiWaveFile* reader)
+		{
+			size_t chunkID;
+			size_t scanID;
+			while((chunkID = nextChunk ++) < chunkCnt)
+			{
+				UINT64 chunkStart = chunkID * chunkSmpls;
+				UINT64 chunkLen = mwf.GetTotalSamples() - chunkStart;
+				if (chunkLen > chunkSmpls)
+					chunkLen = chunkSmpls;
+				chunks[chunkID].resize(scanItems.size());
+				for (scanID = 0; scanID < scanItems.size(); scanID ++)
+					chunks[chunkID][scanID].Init(chnCnt, scanItems[scanID]->silenceVal, scanItems[scanID]->splitSmpls);
+				SweepChunk(*reader, chunkStart, chunkLen, blkSmpls, chunks[chunkID]);
+			}
+		};
+		std::vector<std::thread> threads;
+		for (curThr = 0; curThr < readers.size(); curThr ++)
+		{
+			readers[curThr].LoadWaveFiles(mwf);
+			readers[curThr].SetMaxOpenFiles((mwf.GetMaxOpenFiles() / thrCount > 2) ? (mwf.GetMaxOpenFiles() / thrCount) : 2);
+			threads.push_back(std::thread(scanWorker, &readers[curThr]));
+		}
+		scanWorker(&mwf);
+		for (curThr = 0; curThr < threads.size(); curThr ++)
+			threads[curThr].join();
+	}
+	
+	for (curItm = 0; curItm < items.size(); curItm ++)
+	{
+		SweepItem& si = items[curItm];
+		SilenceDetector detector;
+		
+		detector.Init(chnCnt, si.silenceVal, si.splitSmpls);
+		detector.SetCallback([&si](const SilenceEvent& evt)
+		{
+			UINT64 songLen = evt.smplEnd - evt.smplStart;
+			if (evt.type == SDET_OUTLIER)
+			{
+				si.outliers ++;
+				return;
+			}
+			si.songs ++;
+			if (si.minLen > songLen)
+				si.minLen = songLen;
+			if (si.maxLen < songLen)
+				si.maxLen = songLen;
+			return;
+		});
+		detector.Start(0, smplRate * 4 * chnCnt);
+		if (envIdx != NULL)
+		{
+			if (ScanWithIndex(mwf, *envIdx, detector, si.silenceVal, si.splitSmpls, valBits - smplBits))
+			{
+				fprintf(stderr, "Warning: Amplitude index scan failed, reading the remaining samples instead.\n");
+				ScanRemaining(mwf, detector, si.silenceVal, si.splitSmpls);
+			}
+		}
+		else
+		{
+			for (curChunk = 0; curChunk < chunkCnt; curChunk ++)
+			{
+				detector.Append(chunks[curChunk][si.scanID]);
+				if (detector.GetPosition() < std::min(mwf.GetTotalSamples(), (curChunk + 1) * chunkSmpls))
+					break;	// read error
+			}
+		}
+		detector.Finish();
+	}
+	
+	printf("amp-split\ttime\tsongs\toutliers\tshortest\tlongest\n");
+	for (curItm = 0; curItm < items.size(); curItm ++)
+	{
+		const SweepItem& si = items[curItm];
+		printf("%g\t%g\t%u\t%u", si.ampSplit, si.tSplit, si.songs, si.outliers);
+		if (si.songs > 0)
+			printf("\t%s\t%s\n", GetTimeStrMS(smplRate, si.minLen).c_str(), GetTimeStrMS(smplRate, si.maxLen).c_str());
+		else
+			printf("\t-\t-\n");
+	}
+	
+	return 0;
 }
 
 INLINE INT32 MaxVal_SampleBits(UINT8 bits)
@@ -293,10 +859,10 @@ INLINE double DB2Linear(double db)
 	return pow(2.0, db / 6.0);
 }
 
-INLINE INT32 OptAmplitude2Sample(double optVal, UINT32 maxSmplVal)
+INLINE INT32 OptAmplitude2Sample(double optVal, UINT32 maxSmplVal, UINT8 valShift)
 {
 	if (optVal > 0)
-		return (INT32)optVal;
+		return (INT32)optVal << valShift;	// sample values are given in the file's bit depth
 	else
 		return (INT32)(DB2Linear(optVal) * maxSmplVal);
 }
@@ -306,12 +872,12 @@ INLINE UINT64 RoundDownToUnit(UINT64 val, UINT64 unit)
 	return (val / unit) * unit;
 }
 
-static INT32 GetMaxSample24(const UINT8* buffer, UINT16 chnCnt)
+static INT32 GetMaxSample(const SampleBlock& block, size_t smplIdx)
 {
-	INT32 maxVal = ReadLE24s(&buffer[0]);
-	for (UINT16 curChn = 1; curChn < chnCnt; curChn ++)
+	INT32 maxVal = block.GetInt(0)[smplIdx];
+	for (UINT16 curChn = 1; curChn < block.GetChannels(); curChn ++)
 	{
-		INT32 smplVal = ReadLE24s(&buffer[curChn * 3]);
+		INT32 smplVal = block.GetInt(curChn)[smplIdx];
 		if (abs(smplVal) > abs(maxVal))
 			maxVal = smplVal;
 	}
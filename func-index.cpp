@@ -0,0 +1,184 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "stdtype.h"
+#include "MultiWaveFile.hpp"
+#include "SampleOps.hpp"
+#include "EnvelopeIndex.hpp"
+#include "func.hpp"
+
+#define INLINE	static inline
+
+// The recording is processed in chunks of this many top-level blocks, so that each chunk writes complete blocks of all levels.
+#define INDEX_CHUNK_BLKS	16
+
+
+INLINE UINT64 GetAbsSum(const INT32* data, size_t count);
+static void MergeEntries(const std::vector<EnvelopeEntry>& src, UINT16 chnCnt, std::vector<EnvelopeEntry>& dst);
+
+
+static UINT8 IndexChunk(MultiWaveFile& mwf, EnvelopeIndex& envIdx, UINT64 chunkStart, UINT64 chunkLen)
+{
+	const UINT16 chnCnt = mwf.GetChannels();
+	const UINT32 lvl0Smpls = EnvelopeIndex::GetBlockSize(0);
+	const size_t readSmpls = EnvelopeIndex::GetBlockSize(ENVIDX_LEVELS - 1);
+	SampleBlock smplBlk;
+	std::vector<EnvelopeEntry> entries[ENVIDX_LEVELS];
+	UINT64 smplPos;
+	size_t blkSmpls;
+	size_t curSmpl;
+	UINT16 curChn;
+	UINT8 curLvl;
+	UINT8 retVal;
+	
+	mwf.SetSampleReadOffset(chunkStart);
+	for (smplPos = 0; smplPos < chunkLen; smplPos += blkSmpls)
+	{
+		blkSmpls = (chunkLen - smplPos < readSmpls) ? (size_t)(chunkLen - smplPos) : readSmpls;
+		if (mwf.ReadBlock(blkSmpls, smplBlk, SBLK_INT32) != blkSmpls)
+		{
+			fprintf(stderr, "Error reading samples from offset %llu, count %u!\n", chunkStart + smplPos, (unsigned)blkSmpls);
+			return 0xFF;
+		}
+		
+		for (curSmpl = 0; curSmpl < blkSmpls; curSmpl += lvl0Smpls)
+		{
+			size_t entSmpls = (blkSmpls - curSmpl < lvl0Smpls) ? (blkSmpls - curSmpl) : lvl0Smpls;
+			for (curChn = 0; curChn < chnCnt; curChn ++)
+			{
+				const INT32* chnData = &smplBlk.GetInt(curChn)[curSmpl];
+				EnvelopeEntry ee;
+				GetMinMax(chnData, entSmpls, ee.minVal, ee.maxVal);
+				ee.sumAbs = GetAbsSum(chnData, entSmpls);
+				entries[0].push_back(ee);
+			}
+		}
+	}
+	
+	for (curLvl = 0; curLvl < ENVIDX_LEVELS; curLvl ++)
+	{
+		if (curLvl > 0)
+			MergeEntries(entries[curLvl - 1], chnCnt, entries[curLvl]);
+		retVal = envIdx.WriteBlocks(curLvl, chunkStart / EnvelopeIndex::GetBlockSize(curLvl),
+			entries[curLvl].size() / chnCnt, entries[curLvl].data());
+		if (retVal)
+		{
+			fprintf(stderr, "Error writing index data!\n");
+			return retVal;
+		}
+	}
+	
+	return 0x00;
+}
+
+int DoCreateIndex(MultiWaveFile& mwf, const std::string& fileName, UINT32 threads)
+{
+	EnvelopeIndex envIdx;
+	UINT64 chunkSmpls;
+	size_t chunkCnt;
+	size_t thrCount;
+	size_t curThr;
+	UINT8 retVal;
+	
+	retVal = envIdx.Create(fileName, mwf);
+	if (retVal)
+	{
+		fprintf(stderr, "Error creating %s!\n", fileName.c_str());
+		return 1;
+	}
+	
+	fprintf(stderr, "Creating amplitude envelope index ...\n");
+	chunkSmpls = (UINT64)EnvelopeIndex::GetBlockSize(ENVIDX_LEVELS - 1) * INDEX_CHUNK_BLKS;
+	chunkCnt = (size_t)((mwf.GetTotalSamples() + chunkSmpls - 1) / chunkSmpls);
+	thrCount = threads ? threads : std::thread::hardware_concurrency();
+	if (thrCount > chunkCnt)
+		thrCount = chunkCnt;
+	if (thrCount < 1)
+		thrCount = 1;
+	
+	std::vector<MultiWaveFile> readers(thrCount - 1);
+	std::atomic<size_t> nextChunk(0);
+	std::atomic<bool> failed(false);
+	auto indexWorker = [&](MultiWaveFile* reader)
+	{
+		size_t chunkID;
+		while(! failed && (chunkID = nextChunk ++) < chunkCnt)
+		{
+			UINT64 chunkStart = chunkID * chunkSmpls;
+			UINT64 chunkLen = mwf.GetTotalSamples() - chunkStart;
+			if (chunkLen > chunkSmpls)
+				chunkLen = chunkSmpls;
+			if (IndexChunk(*reader, envIdx, chunkStart, chunkLen))
+				failed = true;
+		}
+	};
+	std::vector<std::thread> threadList;
+	for (curThr = 0; curThr < readers.size(); curThr ++)
+	{
+		readers[curThr].LoadWaveFiles(mwf);
+		readers[curThr].SetMaxOpenFiles((mwf.GetMaxOpenFiles() / thrCount > 2) ? (mwf.GetMaxOpenFiles() / thrCount) : 2);
+		threadList.push_back(std::thread(indexWorker, &readers[curThr]));
+	}
+	indexWorker(&mwf);
+	for (curThr = 0; curThr < threadList.size(); curThr ++)
+		threadList[curThr].join();
+	
+	// An index without signature is never used, so an unfinished file does no harm. Remove it anyway.
+	if (failed || envIdx.Finish())
+	{
+		envIdx.Close();
+		remove(fileName.c_str());
+		fprintf(stderr, "Index creation failed!\n");
+		return 1;
+	}
+	fprintf(stderr, "Done. Index written to %s\n", fileName.c_str());
+	
+	return 0;
+}
+
+INLINE UINT64 GetAbsSum(const INT32* data, size_t count)
+{
+	UINT64 sum = 0;
+	size_t curSmpl;
+	
+	for (curSmpl = 0; curSmpl < count; curSmpl ++)
+		sum += (UINT64)((data[curSmpl] < 0) ? -(INT64)data[curSmpl] : (INT64)data[curSmpl]);
+	
+	return sum;
+}
+
+// combine the entries of each group of (1 << ENVIDX_LEVEL_SHIFT) blocks
+static void MergeEntries(const std::vector<EnvelopeEntry>& src, UINT16 chnCnt, std::vector<EnvelopeEntry>& dst)
+{
+	const size_t grpBlks = (size_t)1 << ENVIDX_LEVEL_SHIFT;
+	size_t srcBlks = src.size() / chnCnt;
+	size_t curBlk;
+	UINT16 curChn;
+	
+	dst.clear();
+	for (curBlk = 0; curBlk < srcBlks; curBlk ++)
+	{
+		if ((curBlk % grpBlks) == 0)
+			dst.insert(dst.end(), &src[curBlk * chnCnt], &src[curBlk * chnCnt] + chnCnt);
+		else
+		{
+			EnvelopeEntry* dstEnt = &dst[dst.size() - chnCnt];
+			const EnvelopeEntry* srcEnt = &src[curBlk * chnCnt];
+			for (curChn = 0; curChn < chnCnt; curChn ++)
+			{
+				if (dstEnt[curChn].minVal > srcEnt[curChn].minVal)
+					dstEnt[curChn].minVal = srcEnt[curChn].minVal;
+				if (dstEnt[curChn].maxVal < srcEnt[curChn].maxVal)
+					dstEnt[curChn].maxVal = srcEnt[curChn].maxVal;
+				dstEnt[curChn].sumAbs += srcEnt[curChn].sumAbs;
+			}
+		}
+	}
+	
+	return;
+}
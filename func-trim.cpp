@@ -9,20 +9,25 @@
 
 #include "stdtype.h"
 #include "MultiWaveFile.hpp"
+#include "SampleOps.hpp"
+#include "Resampler.hpp"
 #include "func.hpp"
 
 #define INLINE	static inline
 
 
-static std::vector<UINT8> GenerateWavHeader(const MultiWaveFile& baseFmt, UINT8 forceBits = 0);
-INLINE INT16 ReadLE16s(const UINT8* data);
-INLINE INT32 ReadLE24s(const UINT8* data);
-INLINE void WriteLE16s(UINT8* data, INT16 value);
-INLINE void WriteLE24s(UINT8* data, INT32 value);
+static std::vector<UINT8> GenerateWavHeader(UINT16 compression, UINT16 channels, UINT32 smplRate, UINT8 bits);
+static std::vector<ChannelMix> GetChannelMix(const TrimInfo& trim, const TrimOpts& opts, UINT16 srcChns);
+static size_t MixIntBlock(SampleBlock& srcBlk, SampleBlock& dstBlk, size_t smplCount, const std::vector<ChannelMix>& chnMix,
+	UINT8 srcBits, UINT8 dstBits, std::vector<DitherState>& chnDither, std::vector<double>& mixBuf);
+static void MixFloatBlock(const SampleBlock& srcBlk, SampleBlock& dstBlk, size_t smplCount, const std::vector<ChannelMix>& chnMix);
+template<typename T> static void MixFloat(const UINT8* src, size_t smplCount, UINT16 srcChns, const std::vector<ChannelMix>& chnMix, UINT8* dst);
+template<typename T> static void InterleaveFloat(const SampleBlock& block, size_t smplCount, UINT8* dst);
+static UINT32 GetDitherSeed(const std::string& fileName);
 INLINE double DB2Linear(double db);
 
 
-static std::vector<UINT8> GenerateWavHeader(const MultiWaveFile& baseFmt, UINT8 forceBits)
+static std::vector<UINT8> GenerateWavHeader(UINT16 compression, UINT16 channels, UINT32 smplRate, UINT8 bits)
 {
 	std::vector<UINT8> waveHdr;
 	WAVEFORMAT wFmt;
@@ -32,10 +37,10 @@ static std::vector<UINT8> GenerateWavHeader(const MultiWaveFile& baseFmt, UINT8
 	// main header + format chunk header + format data + data chunk header
 	waveHdr.resize(0x0C + 0x08 + sizeof(WAVEFORMAT) + 0x08);
 	
-	wFmt.wFormatTag = baseFmt.GetCompression();
-	wFmt.nChannels = baseFmt.GetChannels();
-	wFmt.wBitsPerSample = (forceBits == 0) ? baseFmt.GetBitDepth() : forceBits;
-	wFmt.nSamplesPerSec = baseFmt.GetSampleRate();
+	wFmt.wFormatTag = compression;
+	wFmt.nChannels = channels;
+	wFmt.wBitsPerSample = bits;
+	wFmt.nSamplesPerSec = smplRate;
 	wFmt.nBlockAlign = wFmt.nChannels * wFmt.wBitsPerSample / 8;
 	wFmt.nAvgBytesPerSec = wFmt.nSamplesPerSec * wFmt.nBlockAlign;
 	
@@ -58,49 +63,96 @@ static std::vector<UINT8> GenerateWavHeader(const MultiWaveFile& baseFmt, UINT8
 UINT8 DoWaveTrim(MultiWaveFile& mwf, const TrimInfo& trim, const TrimOpts& opts)
 {
 	std::vector<UINT8> waveHdr;
+	std::vector<SampleSpan> smplSpans;
+	SampleBlock smplBlk;
 	std::vector<UINT8> smplBuf;
-	std::vector<double> chnGain;
-	UINT32 smplSizeS = mwf.GetSampleSize();
-	UINT32 smplSizeD = mwf.GetSampleSize();
+	std::vector<ChannelMix> chnMix;	// channel matrix with linear gains
+	std::vector<DitherState> chnDither;
+	SampleBlock mixBlk;	// output channels
+	std::vector<double> mixBuf;
+	Resampler resmpl;
+	SampleBlock rsmplBlk;	// resampler output
+	SampleBlock convBlk;	// resampler output, converted to integers
+	UINT32 smplSizeD;
 	size_t smplBufSmpls;
-	UINT16 chnBits = mwf.GetBitDepth();
+	UINT8 srcFmt = mwf.GetSampleFormat();
+	UINT8 dstFmt = srcFmt;
+	UINT8 srcBits = GetSampleFormatIntBits(srcFmt);
+	UINT8 dstBits = srcBits;
+	bool isFloat = (srcFmt == SFMT_F32 || srcFmt == SFMT_F64);
 	UINT16 chnCnt = mwf.GetChannels();
+	UINT16 dstChnCnt;
+	UINT32 dstRate = (opts.outRate == 0) ? mwf.GetSampleRate() : opts.outRate;
+	bool resample = (dstRate != mwf.GetSampleRate());
+	bool remap;	// output channels differ from the input channels
 	UINT16 curChn;
 	UINT64 smplCnt;
 	FILE* hFile;
 	size_t writeSmpls;
 	size_t overflowCnt;
+	bool passThru;
 	
-	if (chnBits == 24 && opts.force16bit)
+	if (srcFmt == SFMT_S24 && opts.force16bit)
 	{
-		chnBits += 16 * 100;
-		smplSizeD = smplSizeD * 2 / 3;
+		dstFmt = SFMT_S16;
+		dstBits = 16;
 	}
 	
-	chnGain.resize(chnCnt);
-	if (!opts.applyGain)
+	chnMix = GetChannelMix(trim, opts, chnCnt);
+	if (chnMix.empty())
+		return 0x80;
+	dstChnCnt = (UINT16)chnMix.size();
+	smplSizeD = dstChnCnt * GetSampleFormatBytes(dstFmt);
+	remap = (dstChnCnt != chnCnt);
+	passThru = (dstFmt == srcFmt && ! resample);
+	for (curChn = 0; curChn < dstChnCnt; curChn ++)
 	{
-		std::fill(chnGain.begin(), chnGain.end(), 1.0);
+		if (chnMix[curChn].size() != 1 || chnMix[curChn][0].srcChn != curChn)
+			remap = true;
+		else if (chnMix[curChn][0].gain != 1.0)
+			passThru = false;
 	}
-	else
+	// without conversion, the samples can be written directly from the sample spans
+	if (remap)
+		passThru = false;
+	
+	chnDither.resize(dstChnCnt);
+	for (curChn = 0; curChn < dstChnCnt; curChn ++)
 	{
-		for (curChn = 0; curChn < chnCnt; curChn ++)
-		{
-			double gain = trim.gain;
-			if (curChn < trim.chnGain.size())
-				gain += trim.chnGain[curChn];
-			chnGain[curChn] = DB2Linear(gain);
-		}
+		DitherState& ds = chnDither[curChn];
+		ds.mode = (UINT8)opts.ditherMode;
+		ds.seed = GetDitherSeed(trim.fileName) + curChn * 0x9E3779B9;
+		ds.smplPos = 0;
+		ds.error = 0.0;
 	}
 	
 	smplBufSmpls = mwf.GetSampleRate() * 10;	// buffer for 10 seconds of data
-	smplBuf.resize(smplBufSmpls * smplSizeS);
+	if (resample)
+	{
+		// The channels are mixed (with the gain) before resampling, then converted to the output format.
+		if (resmpl.Init(mwf.GetSampleRate(), dstRate, dstChnCnt))
+		{
+			fprintf(stderr, "Unsupported resampling ratio: %u -> %u Hz\n", mwf.GetSampleRate(), dstRate);
+			return 0x80;
+		}
+		mixBlk.Setup(SBLK_FLOAT, dstChnCnt, smplBufSmpls);
+		rsmplBlk.Setup(SBLK_FLOAT, dstChnCnt, resmpl.GetMaxOutput(smplBufSmpls));
+		if (! isFloat)
+			convBlk.Setup(SBLK_INT32, dstChnCnt, rsmplBlk.GetCapacity());
+		smplBuf.resize(rsmplBlk.GetCapacity() * smplSizeD);
+	}
+	else if (! passThru)
+	{
+		if (remap && ! isFloat)
+			mixBlk.Setup(SBLK_INT32, dstChnCnt, smplBufSmpls);
+		smplBuf.resize(smplBufSmpls * smplSizeD);
+	}
 	
 	hFile = fopen(trim.fileName.c_str(), "wb");
 	if (hFile == NULL)
 		return 0xFF;	// open failed
 	
-	waveHdr = GenerateWavHeader(mwf, chnBits / 100);
+	waveHdr = GenerateWavHeader(mwf.GetCompression(), dstChnCnt, dstRate, GetSampleFormatBytes(dstFmt) * 8);
 	writeSmpls = fwrite(&waveHdr[0], 0x01, waveHdr.size(), hFile);
 	if (writeSmpls < waveHdr.size())
 	{
@@ -114,70 +166,76 @@ UINT8 DoWaveTrim(MultiWaveFile& mwf, const TrimInfo& trim, const TrimOpts& opts)
 	overflowCnt = 0;
 	while(smplCnt > 0)
 	{
-		size_t curSmpChn;
 		size_t readSmpls = (smplBufSmpls < smplCnt) ? smplBufSmpls : (size_t)smplCnt;
-		readSmpls = mwf.ReadSamples(readSmpls * smplSizeS, smplBuf.data());
-		if (! readSmpls)
-			break;
-		switch(chnBits)
+		if (passThru)
 		{
-		case 16:
-			for (curSmpChn = 0; curSmpChn < readSmpls * chnCnt; curSmpChn ++)
+			size_t curSpan;
+			readSmpls = mwf.ReadSampleSpans(readSmpls, smplSpans);
+			if (! readSmpls)
+				break;
+			for (curSpan = 0; curSpan < smplSpans.size(); curSpan ++)
+				writeSmpls += fwrite(smplSpans[curSpan].data, smplSizeD, smplSpans[curSpan].smplCount, hFile);
+			smplCnt -= readSmpls;
+			continue;
+		}
+		if (resample)
+		{
+			size_t reqSmpls = readSmpls;
+			size_t outSmpls;
+			bool lastBlk;
+			readSmpls = mwf.ReadBlock(readSmpls, smplBlk, SBLK_FLOAT);
+			lastBlk = (readSmpls < reqSmpls || readSmpls == smplCnt);	// flush the filter at the end of the data
+			MixFloatBlock(smplBlk, mixBlk, readSmpls, chnMix);
+			outSmpls = resmpl.Process(mixBlk, readSmpls, rsmplBlk, lastBlk);
+			if (srcFmt == SFMT_F32)
 			{
-				INT32 smplVal = ReadLE16s(&smplBuf[curSmpChn * 2]);
-				smplVal = (INT32)(smplVal * chnGain[curSmpChn % chnCnt]);
-				if (smplVal < -0x8000)
-				{
-					smplVal = -0x8000;
-					overflowCnt ++;
-				}
-				else if (smplVal > +0x7FFF)
-				{
-					smplVal = +0x7FFF;
-					overflowCnt ++;
-				}
-				WriteLE16s(&smplBuf[curSmpChn * 2], (INT16)smplVal);
+				InterleaveFloat<float>(rsmplBlk, outSmpls, &smplBuf[0]);
 			}
-			break;
-		case 24:
-			for (curSmpChn = 0; curSmpChn < readSmpls * chnCnt; curSmpChn ++)
+			else if (srcFmt == SFMT_F64)
 			{
-				INT32 smplVal = ReadLE24s(&smplBuf[curSmpChn * 3]);
-				if (chnGain[curSmpChn % chnCnt] != 1.0)
-					smplVal = (INT32)(smplVal * chnGain[curSmpChn % chnCnt]);
-				if (smplVal < -0x800000)
-				{
-					smplVal = -0x800000;
-					overflowCnt ++;
-				}
-				else if (smplVal > +0x7FFFFF)
-				{
-					smplVal = +0x7FFFFF;
-					overflowCnt ++;
-				}
-				WriteLE24s(&smplBuf[curSmpChn * 3], smplVal);
+				InterleaveFloat<double>(rsmplBlk, outSmpls, &smplBuf[0]);
 			}
-			break;
-		case 1624:	// 24 -> 16 bit conversion
-			for (curSmpChn = 0; curSmpChn < readSmpls * chnCnt; curSmpChn ++)
+			else
 			{
-				INT32 smplVal = ReadLE24s(&smplBuf[curSmpChn * 3]);
-				smplVal = (INT32)(smplVal * chnGain[curSmpChn % chnCnt]);
-				smplVal = (smplVal + 0x80) >> 8;	// round with "half up" method, results in even distribution
-				if (smplVal < -0x8000)
+				// The float values are scaled to 32-bit integers (with saturation) and then requantized.
+				for (curChn = 0; curChn < dstChnCnt; curChn ++)
 				{
-					smplVal = -0x8000;
-					overflowCnt ++;
+					ConvF32to32((const UINT8*)rsmplBlk.GetFloat(curChn), convBlk.GetInt(curChn), outSmpls);
+					overflowCnt += ApplyGain(convBlk.GetInt(curChn), outSmpls, 1.0, 32, dstBits, &chnDither[curChn]);
 				}
-				else if (smplVal > +0x7FFF)
-				{
-					smplVal = +0x7FFF;
-					overflowCnt ++;
-				}
-				WriteLE16s(&smplBuf[curSmpChn * 2], (INT16)smplVal);
+				EncodeSamples(convBlk, 0, outSmpls, dstFmt, &smplBuf[0]);
 			}
-			break;
+			writeSmpls += fwrite(&smplBuf[0], smplSizeD, outSmpls, hFile);
+			smplCnt = lastBlk ? 0 : (smplCnt - readSmpls);
+			continue;
+		}
+		if (isFloat)
+		{
+			size_t curSpan;
+			size_t bufPos = 0;
+			readSmpls = mwf.ReadSampleSpans(readSmpls, smplSpans);
+			if (! readSmpls)
+				break;
+			for (curSpan = 0; curSpan < smplSpans.size(); curSpan ++)
+			{
+				const SampleSpan& span = smplSpans[curSpan];
+				if (srcFmt == SFMT_F32)
+					MixFloat<float>(span.data, span.smplCount, chnCnt, chnMix, &smplBuf[bufPos]);
+				else
+					MixFloat<double>(span.data, span.smplCount, chnCnt, chnMix, &smplBuf[bufPos]);
+				bufPos += span.smplCount * smplSizeD;
+			}
+			writeSmpls += fwrite(&smplBuf[0], smplSizeD, readSmpls, hFile);
+			smplCnt -= readSmpls;
+			continue;
 		}
+		
+		readSmpls = mwf.ReadBlock(readSmpls, smplBlk);
+		if (! readSmpls)
+			break;
+		// Without remapping, the block is processed in place.
+		overflowCnt += MixIntBlock(smplBlk, remap ? mixBlk : smplBlk, readSmpls, chnMix, srcBits, dstBits, chnDither, mixBuf);
+		EncodeSamples(remap ? mixBlk : smplBlk, 0, readSmpls, dstFmt, &smplBuf[0]);
 		writeSmpls += fwrite(&smplBuf[0], smplSizeD, readSmpls, hFile);
 		smplCnt -= readSmpls;
 	}
@@ -198,29 +256,183 @@ UINT8 DoWaveTrim(MultiWaveFile& mwf, const TrimInfo& trim, const TrimOpts& opts)
 	return 0x00;
 }
 
+// Returns the output channels with the input channels and linear gains that are mixed into them.
+// The trim list gain and balance are included when enabled. Returns an empty list for invalid channels.
+static std::vector<ChannelMix> GetChannelMix(const TrimInfo& trim, const TrimOpts& opts, UINT16 srcChns)
+{
+	const std::vector<ChannelMix>& matrix = ! trim.chnMatrix.empty() ? trim.chnMatrix : opts.chnMatrix;
+	std::vector<ChannelMix> result;
+	size_t curOut;
+	size_t curTerm;
+	
+	if (matrix.empty())
+	{
+		// all input channels, unchanged
+		result.resize(srcChns);
+		for (curOut = 0; curOut < srcChns; curOut ++)
+		{
+			ChannelMixTerm term = {(UINT16)curOut, 0.0};
+			result[curOut].push_back(term);
+		}
+	}
+	else
+	{
+		result = matrix;
+	}
+	
+	for (curOut = 0; curOut < result.size(); curOut ++)
+	{
+		for (curTerm = 0; curTerm < result[curOut].size(); curTerm ++)
+		{
+			ChannelMixTerm& term = result[curOut][curTerm];
+			double gain = term.gain;
+			if (term.srcChn >= srcChns)
+			{
+				fprintf(stderr, "Invalid channel %u! (The recording has %u channels.)\n", term.srcChn + 1, srcChns);
+				return std::vector<ChannelMix>();
+			}
+			if (opts.applyGain)
+			{
+				gain += trim.gain;
+				if (term.srcChn < trim.chnGain.size())
+					gain += trim.chnGain[term.srcChn];
+			}
+			term.gain = DB2Linear(gain);
+		}
+	}
+	
+	return result;
+}
 
-INLINE INT16 ReadLE16s(const UINT8* data)
+// Mixes the channels of an integer block, applies the gain and reduces the bit depth. Returns the number of clipped samples.
+// srcBlk and dstBlk may be the same block when every output channel uses only the input channel with the same index.
+static size_t MixIntBlock(SampleBlock& srcBlk, SampleBlock& dstBlk, size_t smplCount, const std::vector<ChannelMix>& chnMix,
+	UINT8 srcBits, UINT8 dstBits, std::vector<DitherState>& chnDither, std::vector<double>& mixBuf)
 {
-	return ((INT8)data[0x01] << 8) | (data[0x00] << 0);
+	const double mixScale = 1.0 / (double)(1ULL << (srcBits - 1));	// source values -> -1.0 .. +1.0
+	size_t overflowCnt = 0;
+	size_t curChn;
+	
+	for (curChn = 0; curChn < chnMix.size(); curChn ++)
+	{
+		const ChannelMix& mix = chnMix[curChn];
+		INT32* dstData = dstBlk.GetInt((UINT16)curChn);
+		size_t curTerm;
+		size_t curSmpl;
+		
+		if (mix.size() == 1)
+		{
+			// single input channel: same calculation as without remapping
+			if (&srcBlk != &dstBlk)
+				memcpy(dstData, srcBlk.GetInt(mix[0].srcChn), smplCount * sizeof(INT32));
+			overflowCnt += ApplyGain(dstData, smplCount, mix[0].gain, srcBits, dstBits, &chnDither[curChn]);
+			continue;
+		}
+		
+		// The sum is calculated with doubles, scaled to 32-bit integers (with saturation) and then requantized.
+		mixBuf.assign(smplCount, 0.0);
+		for (curTerm = 0; curTerm < mix.size(); curTerm ++)
+		{
+			const INT32* srcData = srcBlk.GetInt(mix[curTerm].srcChn);
+			double gain = mix[curTerm].gain * mixScale;
+			for (curSmpl = 0; curSmpl < smplCount; curSmpl ++)
+				mixBuf[curSmpl] += srcData[curSmpl] * gain;
+		}
+		ConvF64to32((const UINT8*)mixBuf.data(), dstData, smplCount);
+		overflowCnt += ApplyGain(dstData, smplCount, 1.0, 32, dstBits, &chnDither[curChn]);
+	}
+	
+	return overflowCnt;
 }
 
-INLINE INT32 ReadLE24s(const UINT8* data)
+static void MixFloatBlock(const SampleBlock& srcBlk, SampleBlock& dstBlk, size_t smplCount, const std::vector<ChannelMix>& chnMix)
 {
-	return ((INT8)data[0x02] << 16) | (data[0x01] <<  8) | (data[0x00] <<  0);
+	size_t curChn;
+	
+	for (curChn = 0; curChn < chnMix.size(); curChn ++)
+	{
+		const ChannelMix& mix = chnMix[curChn];
+		float* dstData = dstBlk.GetFloat((UINT16)curChn);
+		size_t curTerm;
+		size_t curSmpl;
+		
+		for (curTerm = 0; curTerm < mix.size(); curTerm ++)
+		{
+			const float* srcData = srcBlk.GetFloat(mix[curTerm].srcChn);
+			float gain = (float)mix[curTerm].gain;
+			if (curTerm == 0)
+			{
+				for (curSmpl = 0; curSmpl < smplCount; curSmpl ++)
+					dstData[curSmpl] = srcData[curSmpl] * gain;
+			}
+			else
+			{
+				for (curSmpl = 0; curSmpl < smplCount; curSmpl ++)
+					dstData[curSmpl] += srcData[curSmpl] * gain;
+			}
+		}
+	}
+	
+	return;
 }
 
-INLINE void WriteLE16s(UINT8* data, INT16 value)
+// Float samples can't overflow, so the channels are mixed directly from/to the interleaved data.
+// This keeps 64-bit floats at full precision.
+template<typename T> static void MixFloat(const UINT8* src, size_t smplCount, UINT16 srcChns, const std::vector<ChannelMix>& chnMix, UINT8* dst)
 {
-	data[0x00] = (value >> 0) & 0xFF;
-	data[0x01] = (value >> 8) & 0xFF;
+	const UINT16 dstChns = (UINT16)chnMix.size();
+	const T* srcData = (const T*)src;
+	T* dstData = (T*)dst;
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curSmpl = 0; curSmpl < smplCount; curSmpl ++, srcData += srcChns, dstData += dstChns)
+	{
+		for (curChn = 0; curChn < dstChns; curChn ++)
+		{
+			const ChannelMix& mix = chnMix[curChn];
+			double value = 0.0;
+			size_t curTerm;
+			for (curTerm = 0; curTerm < mix.size(); curTerm ++)
+				value += srcData[mix[curTerm].srcChn] * mix[curTerm].gain;
+			dstData[curChn] = (T)value;
+		}
+	}
+	
 	return;
 }
 
-INLINE void WriteLE24s(UINT8* data, INT32 value)
+// The dither noise depends only on the output file name, so that the files are reproducible.
+static UINT32 GetDitherSeed(const std::string& fileName)
 {
-	data[0x00] = (value >>  0) & 0xFF;
-	data[0x01] = (value >>  8) & 0xFF;
-	data[0x02] = (value >> 16) & 0xFF;
+	size_t sepPos = fileName.find_last_of("/\\");
+	size_t curPos = (sepPos == std::string::npos) ? 0 : (sepPos + 1);
+	UINT32 hash = 0x811C9DC5;	// FNV-1a
+	
+	for (; curPos < fileName.length(); curPos ++)
+	{
+		hash ^= (UINT8)fileName[curPos];
+		hash *= 0x01000193;
+	}
+	
+	return hash;
+}
+
+// Writes a planar float block as interleaved float/double samples.
+template<typename T> static void InterleaveFloat(const SampleBlock& block, size_t smplCount, UINT8* dst)
+{
+	const UINT16 chnCnt = block.GetChannels();
+	T* smplData = (T*)dst;
+	size_t curSmpl;
+	UINT16 curChn;
+	
+	for (curChn = 0; curChn < chnCnt; curChn ++)
+	{
+		const float* chnData = block.GetFloat(curChn);
+		for (curSmpl = 0; curSmpl < smplCount; curSmpl ++)
+			smplData[curSmpl * chnCnt + curChn] = (T)chnData[curSmpl];
+	}
+	
 	return;
 }
 
@@ -8,9 +8,13 @@
 #include "stdtype.h"
 
 class MultiWaveFile;
+class EnvelopeIndex;
 
-// Amplitude Statistics
-int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UINT32 interval);
+// Amplitude Envelope Index
+int DoCreateIndex(MultiWaveFile& mwf, const std::string& fileName, UINT32 threads);
+
+// Amplitude Statistics (envIdx: optional, NULL = read all samples)
+int DoAmplitudeStats(MultiWaveFile& mwf, UINT64 smplStart, UINT64 smplDurat, UINT32 interval, EnvelopeIndex* envIdx);
 
 // Split Detection
 struct DetectOpts
@@ -18,14 +22,33 @@ struct DetectOpts
 	double ampSplit;	// split amplitude, <0: db, >0: sample value, examples: -81.64, 0x2A0
 	double ampFinetune;	// amplitude for split point finetuning, examples: -85.15, 0x1C0
 	double tSplit;		// split time in seconds
+	UINT32 threads;		// number of threads for scanning the recording, 0 = number of CPU cores
+};
+int DoSplitDetection(MultiWaveFile& mwf, const std::vector<std::string>& fileNameList, const DetectOpts& opts, EnvelopeIndex* envIdx);
+
+// Split Settings Sweep (coarse detection with each combination of the amplitudes and times)
+struct SweepOpts
+{
+	std::vector<double> ampSplit;	// split amplitudes, see DetectOpts
+	std::vector<double> tSplit;		// split times in seconds
+	UINT32 threads;
 };
-int DoSplitDetection(MultiWaveFile& mwf, const std::vector<std::string>& fileNameList, const DetectOpts& opts);
+int DoSplitSweep(MultiWaveFile& mwf, const SweepOpts& opts, EnvelopeIndex* envIdx);
 
 // Splitting/Trimming
+struct ChannelMixTerm
+{
+	UINT16 srcChn;	// input channel (0-based)
+	double gain;	// in db
+};
+typedef std::vector<ChannelMixTerm> ChannelMix;	// input channels that are summed up for one output channel
 struct TrimOpts
 {
 	bool force16bit;	// output 16-bit WAV even for 24-bit input
 	bool applyGain;		// enable applying gain
+	int ditherMode;		// DITHER_* constant from SampleOps.hpp, for the 24 -> 16 bit conversion
+	UINT32 outRate;		// output sample rate, 0 = same as the input
+	std::vector<ChannelMix> chnMatrix;	// output channels, used when the trim list doesn't specify them (empty = all input channels)
 };
 struct TrimInfo
 {
@@ -33,7 +56,8 @@ struct TrimInfo
 	UINT64 smplStart;
 	UINT64 smplEnd;
 	double gain;	// global track gain (in db)
-	std::vector<double> chnGain;	// additional per-channel gain (in db)
+	std::vector<double> chnGain;	// additional per-channel gain (in db), for the input channels
+	std::vector<ChannelMix> chnMatrix;	// output channels (empty = TrimOpts::chnMatrix)
 };
 UINT8 DoWaveTrim(MultiWaveFile& mwf, const TrimInfo& trim, const TrimOpts& opts);
 
@@ -0,0 +1,700 @@
+// Copyright 2021, Valley Bell
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Compares the SIMD kernels of SampleOps with the scalar ones, using all SIMD levels that the CPU supports.
+// The resampler, which is built on them, is checked as well.
+// Build and run with "make test".
+#include <stdio.h>
+#include <stdlib.h>	// for abs()
+#include <string.h>	// for memcpy()/memcmp()
+#include <vector>
+#include <functional>
+
+#include "stdtype.h"
+#include "SampleOps.hpp"
+#include "SampleBlock.hpp"
+#include "Resampler.hpp"
+
+#define INLINE	static inline
+
+// Every kernel is tested with all lengths up to this value (covering the vector loops and all tails) ...
+#define TEST_MAX_SHORT	80
+// ... and some longer ones.
+static const size_t TEST_LONG_LENS[] = {127, 128, 129, 255, 1000, 4099};
+// The input is shifted by up to this many bytes/values, so that the kernels see unaligned data.
+#define TEST_MAX_OFS	3
+// number of extra values after the output, for detecting writes beyond the end
+#define TEST_GUARD	16
+
+// The test function writes the output of the kernels into result.
+// It returns false when a self-check fails. (e.g. a round trip that doesn't give the input again)
+typedef std::function<bool(size_t len, size_t ofs, std::vector<UINT8>& result)> TestFunc;
+
+static UINT32 randState = 0x12345678;
+static UINT32 testCount = 0;
+static UINT32 failCount = 0;
+
+
+INLINE UINT32 RandNext(void)
+{
+	// xorshift32
+	randState ^= randState << 13;
+	randState ^= randState >> 17;
+	randState ^= randState << 5;
+	return randState;
+}
+
+static void FillRandom(UINT8* data, size_t size)
+{
+	size_t curByte;
+	
+	for (curByte = 0; curByte < size; curByte ++)
+		data[curByte] = (UINT8)(RandNext() >> 24);
+	
+	return;
+}
+
+// Runs the test with each length/offset at all SIMD levels and compares the results with the scalar ones.
+// The test function has to generate the same input for the same length/offset, so it should derive it from those.
+static void CompareLevels(const char* name, const TestFunc& func)
+{
+	const UINT8 maxLevel = SetSimdLevel(0xFF);
+	std::vector<size_t> lenList;
+	std::vector<UINT8> refResult;
+	std::vector<UINT8> simdResult;
+	size_t curLen;
+	size_t curOfs;
+	UINT8 curLvl;
+	UINT32 errCnt;
+	
+	for (curLen = 0; curLen <= TEST_MAX_SHORT; curLen ++)
+		lenList.push_back(curLen);
+	lenList.insert(lenList.end(), TEST_LONG_LENS, TEST_LONG_LENS + sizeof(TEST_LONG_LENS) / sizeof(TEST_LONG_LENS[0]));
+	
+	errCnt = 0;
+	for (curLen = 0; curLen < lenList.size(); curLen ++)
+	{
+		for (curOfs = 0; curOfs <= TEST_MAX_OFS; curOfs ++)
+		{
+			for (curLvl = SIMD_SCALAR; curLvl <= maxLevel; curLvl ++)
+			{
+				std::vector<UINT8>& result = (curLvl == SIMD_SCALAR) ? refResult : simdResult;
+				const char* errMsg = NULL;
+				
+				SetSimdLevel(curLvl);
+				result.clear();
+				if (! func(lenList[curLen], curOfs, result))
+					errMsg = "self-check failed";
+				else if (curLvl != SIMD_SCALAR && simdResult != refResult)
+					errMsg = "differs from scalar";
+				if (errMsg != NULL)
+				{
+					if (errCnt < 10)
+						printf("  %s: %s %s (length %u, offset %u)\n", name, GetSimdLevelName(curLvl), errMsg,
+							(unsigned)lenList[curLen], (unsigned)curOfs);
+					errCnt ++;
+				}
+			}
+		}
+	}
+	SetSimdLevel(maxLevel);
+	
+	testCount ++;
+	if (errCnt)
+		failCount ++;
+	printf("%-16s %s\n", name, errCnt ? "FAILED" : "ok");
+	return;
+}
+
+// generates random input bytes that depend only on length and offset
+static void GenInput(size_t len, size_t ofs, size_t size, std::vector<UINT8>& data)
+{
+	randState = 0x9E3779B9 ^ (UINT32)(len * 0x10 + ofs);
+	data.resize(size);
+	FillRandom(data.data(), data.size());
+	return;
+}
+
+// runs a conversion kernel with srcSize bytes per input value and returns the output including the guard area
+static void TestConvert(size_t len, size_t ofs, size_t srcSize, void (*convFunc)(const UINT8*, INT32*, size_t), std::vector<UINT8>& result)
+{
+	std::vector<UINT8> input;
+	std::vector<INT32> output(len + TEST_GUARD, 0x5A5A5A5A);
+	
+	GenInput(len, ofs, ofs + len * srcSize, input);
+	convFunc(input.data() + ofs, output.data(), len);
+	result.insert(result.end(), (const UINT8*)output.data(), (const UINT8*)(output.data() + output.size()));
+	return;
+}
+
+// generates floats in the range of about -1.25 .. +1.25, plus values that test the rounding and saturation
+template<typename T> static void GenFloatInput(size_t len, size_t ofs, std::vector<UINT8>& input)
+{
+	static const double SPECIAL_VALS[] = {0.0, -0.0, 1.0, -1.0, 1.5, -1.5, 1e10, -1e10,
+		0.5 / 0x80000000U, -0.5 / 0x80000000U, 1.5 / 0x80000000U, -1.5 / 0x80000000U, (0x7FFFFFFF - 0.5) / 0x80000000U};
+	const size_t specialCnt = sizeof(SPECIAL_VALS) / sizeof(SPECIAL_VALS[0]);
+	size_t curVal;
+	
+	GenInput(len, ofs, ofs + len * sizeof(T), input);
+	for (curVal = 0; curVal < len; curVal ++)
+	{
+		T value;
+		if ((RandNext() & 0x07) == 0)
+			value = (T)SPECIAL_VALS[RandNext() % specialCnt];
+		else
+			value = (T)(((INT32)RandNext() / (double)0x80000000U) * 1.25);
+		memcpy(&input[ofs + curVal * sizeof(T)], &value, sizeof(T));
+	}
+	
+	return;
+}
+
+static void TestConversions(void)
+{
+	CompareLevels("Unpack8to32", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		TestConvert(len, ofs, 1, Unpack8to32, result);
+		return true;
+	});
+	CompareLevels("Unpack16to32", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		TestConvert(len, ofs, 2, Unpack16to32, result);
+		return true;
+	});
+	CompareLevels("Unpack24to32", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		TestConvert(len, ofs, 3, Unpack24to32, result);
+		return true;
+	});
+	CompareLevels("Pack32to24", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<UINT8> input;
+		std::vector<UINT8> output(len * 3 + TEST_GUARD, 0x5A);
+		
+		GenInput(len, ofs, (ofs + len) * sizeof(INT32), input);
+		Pack32to24((const INT32*)input.data() + ofs, output.data(), len);
+		result.insert(result.end(), output.begin(), output.end());
+		return true;
+	});
+	CompareLevels("ConvF32to32", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<UINT8> input;
+		std::vector<INT32> output(len + TEST_GUARD, 0x5A5A5A5A);
+		
+		GenFloatInput<float>(len, ofs, input);
+		ConvF32to32(input.data() + ofs, output.data(), len);
+		result.insert(result.end(), (const UINT8*)output.data(), (const UINT8*)(output.data() + output.size()));
+		return true;
+	});
+	CompareLevels("ConvF64to32", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<UINT8> input;
+		std::vector<INT32> output(len + TEST_GUARD, 0x5A5A5A5A);
+		
+		GenFloatInput<double>(len, ofs, input);
+		ConvF64to32(input.data() + ofs, output.data(), len);
+		result.insert(result.end(), (const UINT8*)output.data(), (const UINT8*)(output.data() + output.size()));
+		return true;
+	});
+	
+	// round trip: the unpacked values have to be packed into the original bytes again
+	CompareLevels("Unpack24/Pack24", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<UINT8> input;
+		std::vector<INT32> unpacked(len);
+		std::vector<UINT8> output(len * 3);
+		
+		GenInput(len, ofs, ofs + len * 3, input);
+		Unpack24to32(input.data() + ofs, unpacked.data(), len);
+		Pack32to24(unpacked.data(), output.data(), len);
+		result.insert(result.end(), output.begin(), output.end());
+		return ! memcmp(output.data(), input.data() + ofs, len * 3);
+	});
+	
+	return;
+}
+
+// Generates planar data with frames that are either quiet (all channels < 0x8000) or loud (one channel >= 0x8000).
+// loudProb = probability of a loud frame (0x00 .. 0x100)
+static void GenFrameInput(size_t frames, UINT16 chnCnt, UINT32 loudProb, std::vector< std::vector<INT32> >& data)
+{
+	size_t curFrm;
+	UINT16 curChn;
+	
+	data.resize(chnCnt);
+	for (curChn = 0; curChn < chnCnt; curChn ++)
+		data[curChn].resize(frames);
+	for (curFrm = 0; curFrm < frames; curFrm ++)
+	{
+		bool loud = ((RandNext() & 0xFF) < loudProb);
+		UINT16 loudChn = (UINT16)(RandNext() % chnCnt);
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			INT32 value = (INT32)RandNext() >> (17 + RandNext() % 15);
+			if (loud && curChn == loudChn)
+			{
+				if ((RandNext() & 0x0F) == 0)
+					value = -0x7FFFFFFF;	// the smallest value that the decoders return
+				else
+					value = (INT32)(0x8000 + (RandNext() >> (1 + RandNext() % 16))) * ((RandNext() & 1) ? 1 : -1);
+			}
+			data[curChn][curFrm] = value;
+		}
+	}
+	
+	return;
+}
+
+static void TestSearch(void)
+{
+	static const UINT16 CHN_COUNTS[] = {1, 2, 3, 4, 6, 8};
+	static const INT32 LEVELS[] = {1, 0x100, 0x8000, 0x10000, 0x7FFFFFFF};
+	const size_t chnTests = sizeof(CHN_COUNTS) / sizeof(CHN_COUNTS[0]);
+	const size_t lvlTests = sizeof(LEVELS) / sizeof(LEVELS[0]);
+	
+	// The search starts at the offset, so the kernels begin at an unaligned frame.
+	CompareLevels("FindFrameAbove", [&](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector< std::vector<INT32> > data;
+		std::vector<const INT32*> chnData;
+		bool valid = true;
+		size_t curChnT;
+		size_t curLvl;
+		
+		randState = 0x51ED270B ^ (UINT32)(len * 0x10 + ofs);
+		for (curChnT = 0; curChnT < chnTests; curChnT ++)
+		{
+			UINT16 chnCnt = CHN_COUNTS[curChnT];
+			UINT16 curChn;
+			// about 2 loud frames, so that most searches go through many quiet ones
+			GenFrameInput(ofs + len, chnCnt, 0x200 / (UINT32)(len + 2), data);
+			chnData.resize(chnCnt);
+			for (curChn = 0; curChn < chnCnt; curChn ++)
+				chnData[curChn] = data[curChn].data();
+			for (curLvl = 0; curLvl < lvlTests; curLvl ++)
+			{
+				size_t found = FindFrameAbove(chnData.data(), chnCnt, ofs, ofs + len, LEVELS[curLvl]);
+				size_t refPos;
+				for (refPos = ofs; refPos < ofs + len; refPos ++)
+				{
+					for (curChn = 0; curChn < chnCnt; curChn ++)
+					{
+						if (abs(chnData[curChn][refPos]) >= LEVELS[curLvl])
+							break;
+					}
+					if (curChn < chnCnt)
+						break;
+				}
+				valid &= (found == refPos);
+				result.insert(result.end(), (const UINT8*)&found, (const UINT8*)(&found + 1));
+			}
+		}
+		return valid;
+	});
+	CompareLevels("FindFrameBelow", [&](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector< std::vector<INT32> > data;
+		std::vector<const INT32*> chnData;
+		bool valid = true;
+		size_t curChnT;
+		size_t curLvl;
+		
+		randState = 0x2545F491 ^ (UINT32)(len * 0x10 + ofs);
+		for (curChnT = 0; curChnT < chnTests; curChnT ++)
+		{
+			UINT16 chnCnt = CHN_COUNTS[curChnT];
+			UINT16 curChn;
+			// about 2 quiet frames
+			GenFrameInput(ofs + len, chnCnt, 0x100 - 0x200 / (UINT32)(len + 2), data);
+			chnData.resize(chnCnt);
+			for (curChn = 0; curChn < chnCnt; curChn ++)
+				chnData[curChn] = data[curChn].data();
+			for (curLvl = 0; curLvl < lvlTests; curLvl ++)
+			{
+				size_t found = FindFrameBelow(chnData.data(), chnCnt, ofs, ofs + len, LEVELS[curLvl]);
+				size_t refPos;
+				for (refPos = ofs; refPos < ofs + len; refPos ++)
+				{
+					for (curChn = 0; curChn < chnCnt; curChn ++)
+					{
+						if (abs(chnData[curChn][refPos]) >= LEVELS[curLvl])
+							break;
+					}
+					if (curChn >= chnCnt)
+						break;
+				}
+				valid &= (found == refPos);
+				result.insert(result.end(), (const UINT8*)&found, (const UINT8*)(&found + 1));
+			}
+		}
+		return valid;
+	});
+	
+	// A decoded negative full scale sample (-0x80000000 or -1.0) has to be found at every level and give the largest peak.
+	CompareLevels("NegFullScale", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		static const UINT8 FORMATS[] = {SFMT_S32, SFMT_F32, SFMT_F64};
+		const INT32 s32Val = (INT32)0x80000000;
+		const float f32Val = -1.0f;
+		const double f64Val = -1.0;
+		SampleBlock block;
+		bool valid = true;
+		size_t curFmt;
+		UINT16 chnCnt;
+		
+		if (len == 0)
+			return true;
+		for (curFmt = 0; curFmt < sizeof(FORMATS) / sizeof(FORMATS[0]); curFmt ++)
+		{
+			const UINT8 smplBytes = GetSampleFormatBytes(FORMATS[curFmt]);
+			for (chnCnt = 1; chnCnt <= 2; chnCnt ++)
+			{
+				const size_t peakPos = (len - 1) * ofs / TEST_MAX_OFS;
+				std::vector<UINT8> input(len * chnCnt * smplBytes, 0x00);
+				UINT8* peakSmpl = &input[(peakPos * chnCnt + chnCnt - 1) * smplBytes];
+				const INT32* chnData[2];
+				size_t found;
+				INT32 absMax;
+				
+				if (FORMATS[curFmt] == SFMT_S32)
+					memcpy(peakSmpl, &s32Val, smplBytes);
+				else if (FORMATS[curFmt] == SFMT_F32)
+					memcpy(peakSmpl, &f32Val, smplBytes);
+				else
+					memcpy(peakSmpl, &f64Val, smplBytes);
+				block.Setup(SBLK_INT32, chnCnt, len);
+				DecodeSamples(input.data(), len, FORMATS[curFmt], block, 0);
+				chnData[0] = block.GetInt(0);
+				chnData[1] = block.GetInt(chnCnt - 1);
+				found = FindFrameAbove(chnData, chnCnt, 0, len, 0x7FFFFFFF);
+				absMax = GetAbsMax(chnData[chnCnt - 1], len);
+				valid &= (found == peakPos && absMax == 0x7FFFFFFF);
+				result.insert(result.end(), (const UINT8*)&found, (const UINT8*)(&found + 1));
+				result.insert(result.end(), (const UINT8*)&absMax, (const UINT8*)(&absMax + 1));
+			}
+		}
+		return valid;
+	});
+	
+	return;
+}
+
+// Generates values in the range of the bit depth, including the smallest and largest ones.
+static void GenSampleInput(size_t len, UINT8 bits, std::vector<INT32>& data)
+{
+	const INT32 maxVal = (INT32)(((UINT32)1 << (bits - 1)) - 1);
+	size_t curVal;
+	
+	data.resize(len);
+	for (curVal = 0; curVal < len; curVal ++)
+	{
+		UINT32 rnd = RandNext();
+		if ((rnd & 0x0F) == 0)
+			data[curVal] = (rnd & 0x10) ? maxVal : (-maxVal - 1);
+		else
+			data[curVal] = (INT32)RandNext() >> (32 - bits);
+	}
+	
+	return;
+}
+
+static void TestReduction(void)
+{
+	static const UINT8 BITS[] = {8, 16, 24, 32};
+	const size_t bitTests = sizeof(BITS) / sizeof(BITS[0]);
+	
+	CompareLevels("GetMinMax", [&](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<INT32> data;
+		bool valid = true;
+		size_t curBits;
+		size_t curVal;
+		
+		for (curBits = 0; curBits < bitTests; curBits ++)
+		{
+			INT32 minVal;
+			INT32 maxVal;
+			INT32 refMin;
+			INT32 refMax;
+			
+			randState = 0xBB67AE85 ^ (UINT32)(len * 0x10 + ofs) ^ (UINT32)(curBits << 24);
+			GenSampleInput(ofs + len, BITS[curBits], data);
+			GetMinMax(data.data() + ofs, len, minVal, maxVal);
+			refMin = refMax = len ? data[ofs] : 0;
+			for (curVal = ofs; curVal < ofs + len; curVal ++)
+			{
+				if (refMin > data[curVal])
+					refMin = data[curVal];
+				if (refMax < data[curVal])
+					refMax = data[curVal];
+			}
+			valid &= (minVal == refMin && maxVal == refMax);
+			result.insert(result.end(), (const UINT8*)&minVal, (const UINT8*)(&minVal + 1));
+			result.insert(result.end(), (const UINT8*)&maxVal, (const UINT8*)(&maxVal + 1));
+		}
+		return valid;
+	});
+	CompareLevels("GetAbsMax", [&](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<INT32> data;
+		bool valid = true;
+		size_t curBits;
+		size_t curVal;
+		
+		for (curBits = 0; curBits < bitTests; curBits ++)
+		{
+			INT32 absMax;
+			INT32 refMax;
+			
+			randState = 0x3C6EF372 ^ (UINT32)(len * 0x10 + ofs) ^ (UINT32)(curBits << 24);
+			GenSampleInput(ofs + len, BITS[curBits], data);
+			for (curVal = ofs; curVal < ofs + len; curVal ++)
+			{
+				if (data[curVal] == (INT32)0x80000000)
+					data[curVal] = -0x7FFFFFFF;	// like the decoders do
+			}
+			absMax = GetAbsMax(data.data() + ofs, len);
+			refMax = 0;
+			for (curVal = ofs; curVal < ofs + len; curVal ++)
+			{
+				if (refMax < abs(data[curVal]))
+					refMax = abs(data[curVal]);
+			}
+			valid &= (absMax == refMax);
+			result.insert(result.end(), (const UINT8*)&absMax, (const UINT8*)(&absMax + 1));
+		}
+		return valid;
+	});
+	CompareLevels("FindValue", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<INT32> data;
+		bool valid = true;
+		UINT8 curTest;
+		size_t curVal;
+		
+		randState = 0xA54FF53A ^ (UINT32)(len * 0x10 + ofs);
+		GenSampleInput(ofs + len, 8, data);	// small range, so that values appear multiple times
+		for (curTest = 0; curTest < 4; curTest ++)
+		{
+			INT32 value;
+			size_t found;
+			
+			if (curTest == 0)
+				value = (INT32)0x80000000;	// not present
+			else if (curTest == 1 && len > 0)
+				value = data[ofs + len - 1];	// the last value
+			else
+				value = (INT32)(RandNext() & 0xFF) - 0x80;
+			found = FindValue(data.data() + ofs, len, value);
+			for (curVal = 0; curVal < len; curVal ++)
+			{
+				if (data[ofs + curVal] == value)
+					break;
+			}
+			valid &= (found == curVal);
+			result.insert(result.end(), (const UINT8*)&found, (const UINT8*)(&found + 1));
+		}
+		return valid;
+	});
+	
+	return;
+}
+
+static void TestGain(void)
+{
+	static const double GAINS[] = {1.0, 0.5, 0.999, 1.0001, 1.7, 2.0, 3.9999, 0.001};
+	static const UINT8 BIT_PAIRS[][2] = {{24, 24}, {24, 16}, {24, 8}, {32, 24}, {32, 16}, {16, 16}, {8, 8}};
+	const size_t gainTests = sizeof(GAINS) / sizeof(GAINS[0]);
+	const size_t bitTests = sizeof(BIT_PAIRS) / sizeof(BIT_PAIRS[0]);
+	
+	CompareLevels("ApplyGain", [&](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<INT32> data;
+		size_t curGain;
+		size_t curBits;
+		
+		for (curBits = 0; curBits < bitTests; curBits ++)
+		{
+			for (curGain = 0; curGain < gainTests; curGain ++)
+			{
+				size_t clipCnt;
+				
+				randState = 0x6A09E667 ^ (UINT32)(len * 0x10 + ofs) ^ (UINT32)(curBits << 24);
+				GenSampleInput(ofs + len + TEST_GUARD, BIT_PAIRS[curBits][0], data);
+				clipCnt = ApplyGain(&data[ofs], len, GAINS[curGain], BIT_PAIRS[curBits][0], BIT_PAIRS[curBits][1]);
+				result.insert(result.end(), (const UINT8*)data.data(), (const UINT8*)(data.data() + data.size()));
+				result.insert(result.end(), (const UINT8*)&clipCnt, (const UINT8*)(&clipCnt + 1));
+			}
+		}
+		return true;
+	});
+	
+	return;
+}
+
+static void TestDither(void)
+{
+	static const UINT8 MODES[] = {DITHER_TPDF, DITHER_SHAPED};
+	static const double GAINS[] = {1.0, 0.7, 1.3, 0.0};	// (no noise is added with a gain of 0)
+	const size_t modeTests = sizeof(MODES) / sizeof(MODES[0]);
+	const size_t gainTests = sizeof(GAINS) / sizeof(GAINS[0]);
+	
+	// The noise depends only on seed and sample position, so splitting a block has to give the same result.
+	CompareLevels("ApplyGain+Dither", [&](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<INT32> input;
+		std::vector<INT32> data;
+		std::vector<INT32> splitData;
+		bool valid = true;
+		size_t curMode;
+		size_t curGain;
+		
+		randState = 0x510E527F ^ (UINT32)(len * 0x10 + ofs);
+		GenSampleInput(len, 24, input);
+		for (curMode = 0; curMode < modeTests; curMode ++)
+		{
+			for (curGain = 0; curGain < gainTests; curGain ++)
+			{
+				DitherState dither = {MODES[curMode], 0x1234 + (UINT32)ofs, ofs * 1000, 0.0};
+				DitherState splitDither = dither;
+				size_t splitPos = len / 2;
+				size_t clipCnt;
+				size_t splitClipCnt;
+				
+				data = input;
+				clipCnt = ApplyGain(data.data(), len, GAINS[curGain], 24, 16, &dither);
+				result.insert(result.end(), (const UINT8*)data.data(), (const UINT8*)(data.data() + data.size()));
+				result.insert(result.end(), (const UINT8*)&clipCnt, (const UINT8*)(&clipCnt + 1));
+				result.insert(result.end(), (const UINT8*)&dither.error, (const UINT8*)(&dither.error + 1));
+				
+				splitData = input;
+				splitClipCnt = ApplyGain(splitData.data(), splitPos, GAINS[curGain], 24, 16, &splitDither);
+				splitClipCnt += ApplyGain(splitData.data() + splitPos, len - splitPos, GAINS[curGain], 24, 16, &splitDither);
+				valid &= (splitData == data && splitClipCnt == clipCnt && splitDither.smplPos == dither.smplPos &&
+					! memcmp(&splitDither.error, &dither.error, sizeof(double)));
+				if (GAINS[curGain] == 0.0)
+					valid &= (data == std::vector<INT32>(len, 0) && dither.smplPos == ofs * 1000 + len);
+			}
+		}
+		return valid;
+	});
+	
+	return;
+}
+
+// Resamples the signal in blocks of blkSize samples (0 = all at once) and returns the output of both channels, one after another.
+// resmplInit is a freshly initialized resampler for 2 channels. It is copied, as the initialization takes a while.
+static void ResampleBlocks(const Resampler& resmplInit, const std::vector<float>& signal, size_t blkSize, std::vector<float>& result)
+{
+	const UINT16 chnCnt = 2;
+	Resampler resmpl = resmplInit;
+	std::vector<float> chnOutput[chnCnt];
+	SampleBlock srcBlk;
+	SampleBlock dstBlk;
+	size_t smplPos;
+	size_t blkLen;
+	size_t outCnt;
+	UINT16 curChn;
+	
+	if (! blkSize)
+		blkSize = signal.size() ? signal.size() : 1;
+	srcBlk.Setup(SBLK_FLOAT, chnCnt, blkSize);
+	dstBlk.Setup(SBLK_FLOAT, chnCnt, resmpl.GetMaxOutput(blkSize));
+	smplPos = 0;
+	do
+	{
+		blkLen = (signal.size() - smplPos < blkSize) ? (signal.size() - smplPos) : blkSize;
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+		{
+			// the 2nd channel is the inverted signal
+			float* chnData = srcBlk.GetFloat(curChn);
+			size_t curSmpl;
+			for (curSmpl = 0; curSmpl < blkLen; curSmpl ++)
+				chnData[curSmpl] = curChn ? -signal[smplPos + curSmpl] : signal[smplPos + curSmpl];
+		}
+		smplPos += blkLen;
+		outCnt = resmpl.Process(srcBlk, blkLen, dstBlk, smplPos >= signal.size());
+		for (curChn = 0; curChn < chnCnt; curChn ++)
+			chnOutput[curChn].insert(chnOutput[curChn].end(), dstBlk.GetFloat(curChn), dstBlk.GetFloat(curChn) + outCnt);
+	} while(smplPos < signal.size());
+	
+	result.clear();
+	for (curChn = 0; curChn < chnCnt; curChn ++)
+		result.insert(result.end(), chnOutput[curChn].begin(), chnOutput[curChn].end());
+	
+	return;
+}
+
+static void TestResampling(void)
+{
+	CompareLevels("DotProduct", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		std::vector<float> a(ofs + len);
+		std::vector<float> b(len);
+		size_t curVal;
+		double dotProd;
+		
+		randState = 0x9B05688C ^ (UINT32)(len * 0x10 + ofs);
+		for (curVal = 0; curVal < a.size(); curVal ++)
+			a[curVal] = (INT32)RandNext() / (float)0x80000000U;
+		for (curVal = 0; curVal < b.size(); curVal ++)
+			b[curVal] = (INT32)RandNext() / (float)0x80000000U;
+		dotProd = DotProduct(a.data() + ofs, b.data(), len);
+		result.insert(result.end(), (const UINT8*)&dotProd, (const UINT8*)(&dotProd + 1));
+		return true;
+	});
+	
+	// The output must not depend on how the input is split into blocks.
+	CompareLevels("Resampler", [](size_t len, size_t ofs, std::vector<UINT8>& result)
+	{
+		static const UINT32 RATES[TEST_MAX_OFS + 1][2] = {{48000, 44100}, {44100, 48000}, {48000, 16000}, {32000, 48000}};
+		static const size_t BLOCK_SIZES[] = {1, 7, 64, 1000};
+		static Resampler resmplInit[TEST_MAX_OFS + 1];
+		static bool resmplReady[TEST_MAX_OFS + 1] = {false};
+		std::vector<float> signal(len);
+		std::vector<float> refOutput;
+		std::vector<float> blkOutput;
+		bool valid = true;
+		size_t curVal;
+		size_t curBS;
+		
+		// The offset selects the conversion ratio.
+		if (! resmplReady[ofs])
+		{
+			resmplInit[ofs].Init(RATES[ofs][0], RATES[ofs][1], 2);
+			resmplReady[ofs] = true;
+		}
+		randState = 0x1F83D9AB ^ (UINT32)(len * 0x10 + ofs);
+		for (curVal = 0; curVal < len; curVal ++)
+			signal[curVal] = (INT32)RandNext() / (float)0x80000000U;
+		ResampleBlocks(resmplInit[ofs], signal, 0, refOutput);
+		for (curBS = 0; curBS < sizeof(BLOCK_SIZES) / sizeof(BLOCK_SIZES[0]); curBS ++)
+		{
+			ResampleBlocks(resmplInit[ofs], signal, BLOCK_SIZES[curBS], blkOutput);
+			valid &= (blkOutput.size() == refOutput.size() &&
+				! memcmp(blkOutput.data(), refOutput.data(), refOutput.size() * sizeof(float)));
+		}
+		result.insert(result.end(), (const UINT8*)refOutput.data(), (const UINT8*)(refOutput.data() + refOutput.size()));
+		return valid;
+	});
+	
+	return;
+}
+
+int main(int argc, char* argv[])
+{
+	const UINT8 maxLevel = GetSimdLevel();
+	
+	printf("SIMD level: %s\n", GetSimdLevelName(maxLevel));
+	if (maxLevel == SIMD_SCALAR)
+		printf("Note: The CPU has no supported SIMD extensions, the kernels are only checked for consistency.\n");
+	
+	TestConversions();
+	TestSearch();
+	TestReduction();
+	TestGain();
+	TestDither();
+	TestResampling();
+	
+	printf("%u of %u tests passed.\n", testCount - failCount, testCount);
+	return failCount ? 1 : 0;
+}
@@ -4,12 +4,15 @@
 #include <stdio.h>
 #include <vector>
 #include <string>
+#include <map>
 #include <algorithm>
 #include <math.h>
 #include <string.h>
 
 #include "stdtype.h"
 #include "MultiWaveFile.hpp"
+#include "SampleOps.hpp"
+#include "EnvelopeIndex.hpp"
 #include "func.hpp"
 #include "libs/CLI11.hpp"
 
@@ -30,6 +33,15 @@
 #endif
 
 
+struct IOOpts
+{
+	int ioMode;
+	bool readAhead;
+	UINT32 maxOpenFiles;
+	int cacheMode;
+	std::string metaCache;
+};
+
 struct SplitOpts
 {
 	std::string dstPath;
@@ -38,8 +50,13 @@ struct SplitOpts
 };
 
 static UINT8 ParseTrimList(const std::vector<std::string>& tlLines, std::vector<TrimInfo>& result);
+static UINT8 ParseChannelMatrix(const std::string& spec, std::vector<ChannelMix>& result);
 static UINT8 DoSplitFiles(MultiWaveFile& mwf, const std::vector<TrimInfo>& trimList, const SplitOpts& splitOpts, const TrimOpts& trimOpts);
-static UINT8 DoConvert(const std::vector<TrimInfo>& trimList, const SplitOpts& splitOpts, const TrimOpts& trimOpts);
+static UINT8 DoConvert(const std::vector<TrimInfo>& trimList, const SplitOpts& splitOpts, const TrimOpts& trimOpts, const IOOpts& ioOpts);
+static void ApplyIOOpts(MultiWaveFile& mwf, const IOOpts& ioOpts);
+static void PrintIOStats(const MultiWaveFile& mwf);
+static bool OpenEnvelopeIndex(const MultiWaveFile& mwf, const std::string& fileName, EnvelopeIndex& envIdx);
+static bool CheckSampleFormat(const MultiWaveFile& mwf);
 static UINT8 ReadFileIntoStrVector(const std::string& fileName, std::vector<std::string>& result);
 static UINT8 TimeStr2Sample(const char* time, UINT32 sampleRate, UINT64* result);
 static size_t GetLastSepPos(const std::string& fileName);
@@ -57,6 +74,48 @@ static CLI::Option_group* CLI_AddInputFileGroup(CLI::App* app, std::vector<std::
 	return optGrp;
 }
 
+static void CLI_AddIOOptions(CLI::App* app, IOOpts& ioOpts)
+{
+	static const std::map<std::string, int> ioModeMap = {
+		{"read", MWF_IO_READ},
+		{"mmap", MWF_IO_MMAP},
+		{"uring", MWF_IO_URING},
+		{"direct", MWF_IO_DIRECT},
+	};
+	app->add_option("--io", ioOpts.ioMode, "I/O mode: read (default), mmap (memory-mapped), uring (asynchronous io_uring reads, Linux only), direct (bypass the page cache)")
+		->transform(CLI::CheckedTransformer(ioModeMap, CLI::ignore_case));
+	app->add_flag("--prefetch", ioOpts.readAhead, "read the next block in a separate I/O thread (read mode only)");
+	app->add_option("--max-open-files", ioOpts.maxOpenFiles, "maximum number of simultaneously opened WAV files")->check(CLI::PositiveNumber);
+	static const std::map<std::string, int> cacheModeMap = {
+		{"normal", MWF_CACHE_NORMAL},
+		{"stream", MWF_CACHE_STREAM},
+		{"bounds", MWF_CACHE_BOUNDS},
+	};
+	app->add_option("--cache", ioOpts.cacheMode, "page cache usage: normal (default), stream (drop data after reading it), bounds (stream, but keep song boundaries for finetuning)")
+		->transform(CLI::CheckedTransformer(cacheModeMap, CLI::ignore_case));
+	app->add_option("--meta-cache", ioOpts.metaCache, "file for caching the WAV headers, speeds up loading unchanged files");
+	return;
+}
+
+static void CLI_AddIndexOptions(CLI::App* app, std::string& idxFileName, bool& noIndex)
+{
+	app->add_option("-x, --index", idxFileName, "amplitude envelope index (default: first WAV file + .envidx, used when it exists)");
+	app->add_flag("--no-index", noIndex, "ignore the amplitude envelope index and read all samples");
+	return;
+}
+
+static void CLI_AddDitherOption(CLI::App* app, TrimOpts& trimOpts)
+{
+	static const std::map<std::string, int> ditherModeMap = {
+		{"none", DITHER_NONE},
+		{"tpdf", DITHER_TPDF},
+		{"shaped", DITHER_SHAPED},
+	};
+	app->add_option("--dither", trimOpts.ditherMode, "dither for the 24 -> 16 bit conversion: none (default), tpdf (triangular noise), shaped (noise-shaped TPDF)")
+		->transform(CLI::CheckedTransformer(ditherModeMap, CLI::ignore_case));
+	return;
+}
+
 int main(int argc, char* argv[])
 {
 	CLI::App cliApp{"Wave Splitter"};
@@ -66,30 +125,58 @@ int main(int argc, char* argv[])
 	std::vector<std::string> wavFileNames;
 	std::string wavFileList;
 	std::string splitFileName;
-	DetectOpts detOpts = {-81.64, -85.15, 3.0};
-	TrimOpts trimOpts = {false, false};
+	std::string chnMatrix;
+	std::string idxFileName;
+	bool noIndex = false;
+	DetectOpts detOpts = {-81.64, -85.15, 3.0, 0};
+	SweepOpts sweepOpts;
+	TrimOpts trimOpts = {false, false, DITHER_NONE, 0, std::vector<ChannelMix>()};
 	SplitOpts splitOpts = {".", 0, 0};
+	IOOpts ioOpts = {MWF_IO_READ, false, 64, MWF_CACHE_NORMAL, ""};
 	
 	cliApp.require_subcommand();
 	
 	CLI::App* scMag = cliApp.add_subcommand("ampstat", "amplitude statistics");
 	CLI_AddInputFileGroup(scMag, wavFileNames, wavFileList);
+	CLI_AddIOOptions(scMag, ioOpts);
 	scMag->add_option("-s, --start", tStart, "Start Time in [HH:]MM:ss or sample number (plain integer)");
 	scMag->add_option("-t, --length", tLen, "Length in [HH:]MM:ss or number of samples");
 	scMag->add_option("-i, --interval", tDelta, "Measurement interval, number of samples");
+	CLI_AddIndexOptions(scMag, idxFileName, noIndex);
 	
 	CLI::App* scDetect = cliApp.add_subcommand("detect", "detect split points");
 	CLI_AddInputFileGroup(scDetect, wavFileNames, wavFileList);
+	CLI_AddIOOptions(scDetect, ioOpts);
 	scDetect->add_option("-n, --split-names", splitFileName, "TXT file that lists file names for resulting split list")->check(CLI::ExistingFile)->required();
 	scDetect->add_option("-a, --amp-split", detOpts.ampSplit, "Amplitude for defining splitting silence (<0: db, >0: sample value)");
 	scDetect->add_option("-A, --amp-finetune", detOpts.ampFinetune, "Amplitude for split point finetuning (must be lower than amp-split)");
 	scDetect->add_option("-t, --time", detOpts.tSplit, "Minimum time of silence for splitting files (in seconds)");
+	scDetect->add_option("-j, --threads", detOpts.threads, "number of threads for scanning the recording and finetuning (default: number of CPU cores)");
+	CLI_AddIndexOptions(scDetect, idxFileName, noIndex);
+	
+	CLI::App* scSweep = cliApp.add_subcommand("sweep", "run the coarse detection with multiple split settings in one pass, for calibration");
+	CLI_AddInputFileGroup(scSweep, wavFileNames, wavFileList);
+	CLI_AddIOOptions(scSweep, ioOpts);
+	scSweep->add_option("-a, --amp-split", sweepOpts.ampSplit, "Amplitudes for defining splitting silence, comma-separated (<0: db, >0: sample value)")->delimiter(',');
+	scSweep->add_option("-t, --time", sweepOpts.tSplit, "Minimum times of silence for splitting files, comma-separated (in seconds)")->delimiter(',');
+	scSweep->add_option("-j, --threads", detOpts.threads, "number of threads for scanning the recording (default: number of CPU cores)");
+	CLI_AddIndexOptions(scSweep, idxFileName, noIndex);
+	
+	CLI::App* scIndex = cliApp.add_subcommand("index", "create amplitude envelope index (speeds up ampstat and detect)");
+	CLI_AddInputFileGroup(scIndex, wavFileNames, wavFileList);
+	CLI_AddIOOptions(scIndex, ioOpts);
+	scIndex->add_option("-x, --index", idxFileName, "output file (default: first WAV file + .envidx)");
+	scIndex->add_option("-j, --threads", detOpts.threads, "number of threads for reading the recording (default: number of CPU cores)");
 	
 	CLI::App* scSplit = cliApp.add_subcommand("split", "split into multiple files");
 	CLI_AddInputFileGroup(scSplit, wavFileNames, wavFileList);
+	CLI_AddIOOptions(scSplit, ioOpts);
 	scSplit->add_option("-t, --trim-list", splitFileName, "TXT file that lists trim points and file names")->check(CLI::ExistingFile)->required();
 	scSplit->add_flag("-g, --apply-gain", trimOpts.applyGain, "apply trim list gain (ignored by default)");
 	scSplit->add_flag("-1, --force-16b", trimOpts.force16bit, "enforce 16-bit output");
+	CLI_AddDitherOption(scSplit, trimOpts);
+	scSplit->add_option("-r, --output-rate", trimOpts.outRate, "resample the output to this sample rate (in Hz)")->check(CLI::PositiveNumber);
+	scSplit->add_option("-c, --channels", chnMatrix, "output channels, e.g. \"3,4\" or \"1+3:-6,2+4:-6\" (input channels 1-based, '+' mixes, ':' sets the gain in db)");
 	scSplit->add_option("-o, --output-path", splitOpts.dstPath, "output path");
 	scSplit->add_option("-b, --begin-silence", splitOpts.leadSamples, "additional leading samples of silence");
 	scSplit->add_option("-e, --end-silence", splitOpts.trailSamples, "additional trailing samples of silence");
@@ -98,10 +185,23 @@ int main(int argc, char* argv[])
 	scConvert->add_option("-t, --trim-list", splitFileName, "TXT file that lists trim points and file names")->check(CLI::ExistingFile)->required();
 	scConvert->add_flag("-g, --apply-gain", trimOpts.applyGain, "apply trim list gain (ignored by default)");
 	scConvert->add_flag("-1, --force-16b", trimOpts.force16bit, "enforce 16-bit output");
+	CLI_AddDitherOption(scConvert, trimOpts);
+	scConvert->add_option("-r, --output-rate", trimOpts.outRate, "resample the output to this sample rate (in Hz)")->check(CLI::PositiveNumber);
+	scConvert->add_option("-c, --channels", chnMatrix, "output channels, e.g. \"3,4\" or \"1+3:-6,2+4:-6\" (input channels 1-based, '+' mixes, ':' sets the gain in db)");
 	scConvert->add_option("-o, --output-path", splitOpts.dstPath, "output path");
+	CLI_AddIOOptions(scConvert, ioOpts);
 	
 	CLI11_PARSE(cliApp, argc, argv);
 	
+	if (! chnMatrix.empty())
+	{
+		UINT8 retVal = ParseChannelMatrix(chnMatrix, trimOpts.chnMatrix);
+		if (retVal & 0x80)
+		{
+			fprintf(stderr, "Format of channel matrix is invalid!\n");
+			return 1;
+		}
+	}
 	if (! wavFileList.empty())
 	{
 		UINT8 retVal = ReadFileIntoStrVector(wavFileList, wavFileNames);
@@ -127,24 +227,15 @@ int main(int argc, char* argv[])
 		fprintf(stderr, "Amplitude Statistics\n");
 		fprintf(stderr, "--------------------\n");
 		
+		ApplyIOOpts(mwf, ioOpts);
 		retVal = mwf.LoadWaveFiles(wavFileNames);
 		if (retVal)
 		{
 			fprintf(stderr, "WAVE Loading failed!\n");
 			return 3;
 		}
-		if (mwf.GetCompression() != WAVE_FORMAT_PCM)
-		{
-			fprintf(stderr, "Unsupported compression type: %u\n", mwf.GetCompression());
-			fprintf(stderr, "Only uncompressed PCM is supported.\n");
+		if (! CheckSampleFormat(mwf))
 			return 4;
-		}
-		if (! (mwf.GetBitDepth() == 16 || mwf.GetBitDepth() == 24))
-		{
-			fprintf(stderr, "Unsupported bit depth: %u\n", mwf.GetBitDepth());
-			fprintf(stderr, "Only 16 and 24 bit WAVs are supported.\n");
-			return 4;
-		}
 		
 		smplStart = 0;
 		retVal = TimeStr2Sample(tStart.c_str(), mwf.GetSampleRate(), &smplStart);
@@ -161,7 +252,11 @@ int main(int argc, char* argv[])
 			return 1;
 		}
 		
-		return DoAmplitudeStats(mwf, smplStart, smplDurat, tDelta);
+		EnvelopeIndex envIdx;
+		bool useIdx = ! noIndex && OpenEnvelopeIndex(mwf, idxFileName, envIdx);
+		int result = DoAmplitudeStats(mwf, smplStart, smplDurat, tDelta, useIdx ? &envIdx : NULL);
+		PrintIOStats(mwf);
+		return result;
 	}
 	else if (cliApp.got_subcommand(scDetect))
 	{
@@ -189,26 +284,75 @@ int main(int argc, char* argv[])
 		fprintf(stderr, "Detect Split Points\n");
 		fprintf(stderr, "-------------------\n");
 		
+		ApplyIOOpts(mwf, ioOpts);
 		retVal = mwf.LoadWaveFiles(wavFileNames);
 		if (retVal)
 		{
 			fprintf(stderr, "WAVE Loading failed!\n");
 			return 3;
 		}
-		if (mwf.GetCompression() != WAVE_FORMAT_PCM)
-		{
-			fprintf(stderr, "Unsupported compression type: %u\n", mwf.GetCompression());
-			fprintf(stderr, "Only uncompressed PCM is supported.\n");
+		if (! CheckSampleFormat(mwf))
 			return 4;
-		}
-		if (mwf.GetBitDepth() != 24)
+		
+		EnvelopeIndex envIdx;
+		bool useIdx = ! noIndex && OpenEnvelopeIndex(mwf, idxFileName, envIdx);
+		int result = DoSplitDetection(mwf, splitNames, detOpts, useIdx ? &envIdx : NULL);
+		PrintIOStats(mwf);
+		return result;
+	}
+	else if (cliApp.got_subcommand(scSweep))
+	{
+		MultiWaveFile mwf;
+		UINT8 retVal;
+		
+		if (sweepOpts.ampSplit.empty())
+			sweepOpts.ampSplit.push_back(detOpts.ampSplit);
+		if (sweepOpts.tSplit.empty())
+			sweepOpts.tSplit.push_back(detOpts.tSplit);
+		sweepOpts.threads = detOpts.threads;
+		
+		fprintf(stderr, "Split Settings Sweep\n");
+		fprintf(stderr, "--------------------\n");
+		
+		ApplyIOOpts(mwf, ioOpts);
+		retVal = mwf.LoadWaveFiles(wavFileNames);
+		if (retVal)
 		{
-			fprintf(stderr, "Unsupported bit depth: %u\n", mwf.GetBitDepth());
-			fprintf(stderr, "Only 24 bit WAVs are supported.\n");
+			fprintf(stderr, "WAVE Loading failed!\n");
+			return 3;
+		}
+		if (! CheckSampleFormat(mwf))
 			return 4;
+		
+		EnvelopeIndex envIdx;
+		bool useIdx = ! noIndex && OpenEnvelopeIndex(mwf, idxFileName, envIdx);
+		int result = DoSplitSweep(mwf, sweepOpts, useIdx ? &envIdx : NULL);
+		PrintIOStats(mwf);
+		return result;
+	}
+	else if (cliApp.got_subcommand(scIndex))
+	{
+		MultiWaveFile mwf;
+		UINT8 retVal;
+		
+		fprintf(stderr, "Create Amplitude Index\n");
+		fprintf(stderr, "----------------------\n");
+		
+		ApplyIOOpts(mwf, ioOpts);
+		retVal = mwf.LoadWaveFiles(wavFileNames);
+		if (retVal)
+		{
+			fprintf(stderr, "WAVE Loading failed!\n");
+			return 3;
 		}
+		if (! CheckSampleFormat(mwf))
+			return 4;
 		
-		return DoSplitDetection(mwf, splitNames, detOpts);
+		if (idxFileName.empty())
+			idxFileName = EnvelopeIndex::GetDefaultFileName(mwf);
+		int result = DoCreateIndex(mwf, idxFileName, detOpts.threads);
+		PrintIOStats(mwf);
+		return result;
 	}
 	else if (cliApp.got_subcommand(scSplit))
 	{
@@ -243,26 +387,19 @@ int main(int argc, char* argv[])
 		fprintf(stderr, "Split Files\n");
 		fprintf(stderr, "-----------\n");
 		
+		ApplyIOOpts(mwf, ioOpts);
 		retVal = mwf.LoadWaveFiles(wavFileNames);
 		if (retVal)
 		{
 			fprintf(stderr, "WAVE Loading failed!\n");
 			return 3;
 		}
-		if (mwf.GetCompression() != WAVE_FORMAT_PCM)
-		{
-			fprintf(stderr, "Unsupported compression type: %u\n", mwf.GetCompression());
-			fprintf(stderr, "Only uncompressed PCM is supported.\n");
+		if (! CheckSampleFormat(mwf))
 			return 4;
-		}
-		if (! (mwf.GetBitDepth() == 16 || mwf.GetBitDepth() == 24))
-		{
-			fprintf(stderr, "Unsupported bit depth: %u\n", mwf.GetBitDepth());
-			fprintf(stderr, "Only 16 and 24 bit WAVs are supported.\n");
-			return 4;
-		}
 		
-		return DoSplitFiles(mwf, trimList, splitOpts, trimOpts);
+		retVal = DoSplitFiles(mwf, trimList, splitOpts, trimOpts);
+		PrintIOStats(mwf);
+		return retVal;
 	}
 	else if (cliApp.got_subcommand(scConvert))
 	{
@@ -291,7 +428,7 @@ int main(int argc, char* argv[])
 		fprintf(stderr, "-------------\n");
 		
 		ParseTrimList(splitLines, trimList);
-		return DoConvert(trimList, splitOpts, trimOpts);
+		return DoConvert(trimList, splitOpts, trimOpts, ioOpts);
 	}
 	
 	return 0;
@@ -301,6 +438,7 @@ static UINT8 ParseTrimList(const std::vector<std::string>& tlLines, std::vector<
 {
 	size_t curLine;
 	std::vector<double> chnGain;
+	std::vector<ChannelMix> chnMatrix;
 	
 	result.clear();
 	for (curLine = 0; curLine < tlLines.size(); curLine ++)
@@ -334,6 +472,7 @@ static UINT8 ParseTrimList(const std::vector<std::string>& tlLines, std::vector<
 			ti.smplEnd = (UINT64)strtoull(&tLine[colPos[2]], NULL, 0);
 			ti.fileName = tLine.substr(colPos[3]);
 			ti.chnGain = chnGain;
+			ti.chnMatrix = chnMatrix;
 			result.push_back(ti);
 		}
 		else if (tLine[0] == 'b')	// balance
@@ -343,6 +482,67 @@ static UINT8 ParseTrimList(const std::vector<std::string>& tlLines, std::vector<
 			for (chnCol = 1; chnCol < curCol; chnCol ++)
 				chnGain.push_back(atof(&tLine[colPos[chnCol]]));
 		}
+		else if (tLine[0] == 'm')	// channel matrix
+		{
+			if (ParseChannelMatrix(tLine.substr(1), chnMatrix) & 0x80)
+			{
+				fprintf(stderr, "Invalid channel matrix: %s\n", tLine.c_str());
+				chnMatrix.clear();
+			}
+		}
+	}
+	
+	return 0x00;
+}
+
+// Parses a channel matrix like "1+3:-6,2+4:-6".
+// Output channels are separated by commas or spaces, the input channels (1-based) of an output channel by '+'.
+// An input channel can be followed by a gain in db after a colon. An empty matrix keeps all channels.
+static UINT8 ParseChannelMatrix(const std::string& spec, std::vector<ChannelMix>& result)
+{
+	size_t curPos;
+	size_t endPos;
+	
+	result.clear();
+	for (curPos = 0; curPos < spec.length(); curPos = endPos + 1)
+	{
+		std::string outSpec;
+		const char* termPtr;
+		ChannelMix mix;
+		
+		endPos = spec.find_first_of(", \t", curPos);
+		if (endPos == std::string::npos)
+			endPos = spec.length();
+		if (endPos == curPos)
+			continue;	// multiple separators
+		outSpec = spec.substr(curPos, endPos - curPos);
+		termPtr = outSpec.c_str();
+		while(true)
+		{
+			ChannelMixTerm term;
+			char* endPtr;
+			long chn = strtol(termPtr, &endPtr, 10);
+			if (endPtr == termPtr || chn < 1 || chn > 0xFFFF)
+				return 0x80;
+			term.srcChn = (UINT16)(chn - 1);
+			term.gain = 0.0;
+			termPtr = endPtr;
+			if (*termPtr == ':')
+			{
+				termPtr ++;
+				term.gain = strtod(termPtr, &endPtr);
+				if (endPtr == termPtr || ! isfinite(term.gain))
+					return 0x80;	// (strtod() accepts "inf" and "nan")
+				termPtr = endPtr;
+			}
+			mix.push_back(term);
+			if (*termPtr == '\0')
+				break;
+			if (*termPtr != '+')
+				return 0x80;
+			termPtr ++;
+		}
+		result.push_back(mix);
 	}
 	
 	return 0x00;
@@ -376,12 +576,13 @@ static UINT8 DoSplitFiles(MultiWaveFile& mwf, const std::vector<TrimInfo>& trimL
 	return 0;
 }
 
-static UINT8 DoConvert(const std::vector<TrimInfo>& trimList, const SplitOpts& splitOpts, const TrimOpts& trimOpts)
+static UINT8 DoConvert(const std::vector<TrimInfo>& trimList, const SplitOpts& splitOpts, const TrimOpts& trimOpts, const IOOpts& ioOpts)
 {
 	std::vector<std::string> tempFileList(1);
 	MultiWaveFile mwf;
 	size_t curFile;
 	
+	ApplyIOOpts(mwf, ioOpts);
 	for (curFile = 0; curFile < trimList.size(); curFile ++)
 	{
 		TrimInfo ti = trimList[curFile];
@@ -397,18 +598,8 @@ static UINT8 DoConvert(const std::vector<TrimInfo>& trimList, const SplitOpts& s
 			fprintf(stderr, "WAVE Loading failed!\n");
 			continue;
 		}
-		if (mwf.GetCompression() != WAVE_FORMAT_PCM)
-		{
-			fprintf(stderr, "Unsupported compression type: %u\n", mwf.GetCompression());
-			fprintf(stderr, "Only uncompressed PCM is supported.\n");
+		if (! CheckSampleFormat(mwf))
 			continue;
-		}
-		if (! (mwf.GetBitDepth() == 16 || mwf.GetBitDepth() == 24))
-		{
-			fprintf(stderr, "Unsupported bit depth: %u\n", mwf.GetBitDepth());
-			fprintf(stderr, "Only 16 and 24 bit WAVs are supported.\n");
-			continue;
-		}
 		
 		ti.smplStart = 0;
 		ti.smplEnd = mwf.GetTotalSamples();
@@ -424,6 +615,70 @@ static UINT8 DoConvert(const std::vector<TrimInfo>& trimList, const SplitOpts& s
 	return 0;
 }
 
+static void ApplyIOOpts(MultiWaveFile& mwf, const IOOpts& ioOpts)
+{
+	mwf.SetIOMode((UINT8)ioOpts.ioMode);
+	mwf.SetReadAhead(ioOpts.readAhead);
+	mwf.SetMaxOpenFiles(ioOpts.maxOpenFiles);
+	mwf.SetCacheMode((UINT8)ioOpts.cacheMode);
+	mwf.SetMetaCache(ioOpts.metaCache);
+	return;
+}
+
+static void PrintIOStats(const MultiWaveFile& mwf)
+{
+	const ReadAheadStats& ras = mwf.GetReadAheadStats();
+	if (ras.blocks > 0 || ras.misses > 0)
+	{
+		fprintf(stderr, "Read-ahead: %llu blocks, stalled on %llu (%.1f %%), waited %.2f s for I/O, %llu discarded\n",
+			(unsigned long long)ras.blocks, (unsigned long long)ras.stalls,
+			ras.blocks ? (100.0 * ras.stalls / ras.blocks) : 0.0, ras.waitTime, (unsigned long long)ras.misses);
+	}
+	if (ras.ioRequests > 0)
+	{
+		fprintf(stderr, "io_uring: %llu requests, average queue depth %.1f, %.1f MB/s (%.2f s busy)\n",
+			(unsigned long long)ras.ioRequests, (double)ras.ioDepthSum / ras.ioRequests,
+			(ras.ioTime > 0.0) ? (ras.ioBytes / ras.ioTime / 1000000.0) : 0.0, ras.ioTime);
+	}
+	return;
+}
+
+// Open the amplitude envelope index of the recording. Returns false when all samples have to be read instead.
+static bool OpenEnvelopeIndex(const MultiWaveFile& mwf, const std::string& fileName, EnvelopeIndex& envIdx)
+{
+	std::string idxName = fileName.empty() ? EnvelopeIndex::GetDefaultFileName(mwf) : fileName;
+	UINT8 retVal;
+	
+	retVal = envIdx.Open(idxName, mwf);
+	if (! retVal)
+	{
+		fprintf(stderr, "Using amplitude index %s\n", idxName.c_str());
+		return true;
+	}
+	if (retVal == 0x01)
+		fprintf(stderr, "Warning: Index %s doesn't match the WAV files, reading all samples.\n", idxName.c_str());
+	else if (retVal == 0x80 || ! fileName.empty())	// The default index is optional.
+		fprintf(stderr, "Warning: Unable to load index %s, reading all samples.\n", idxName.c_str());
+	return false;
+}
+
+static bool CheckSampleFormat(const MultiWaveFile& mwf)
+{
+	if (mwf.GetSampleFormat() != SFMT_NONE)
+		return true;
+	
+	if (mwf.GetCompression() != WAVE_FORMAT_PCM && mwf.GetCompression() != WAVE_FORMAT_IEEE_FLOAT)
+	{
+		fprintf(stderr, "Unsupported compression type: %u\n", mwf.GetCompression());
+		fprintf(stderr, "Only uncompressed PCM and IEEE float are supported.\n");
+	}
+	else
+	{
+		fprintf(stderr, "Unsupported bit depth: %u\n", mwf.GetBitDepth());
+		fprintf(stderr, "Supported are 8/16/24/32 bit integer and 32/64 bit float WAVs.\n");
+	}
+	return false;
+}
 
 static UINT8 ReadFileIntoStrVector(const std::string& fileName, std::vector<std::string>& result)
 {